@@ -0,0 +1,563 @@
+/*
+ * Mattersplatter - a compiler & interpreter for the Brainf*ck language.
+ * Copyright (C) 2021 Maxwell R. Haley <maxwell.r.haley@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Runs Brainf*ck workloads under the engines of a mattersplatter executable, and
+ * reports one JSON object per workload and engine on stdout.
+ */
+#define _DEFAULT_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <libgen.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <mattersplatter.h>
+
+#include "counters.h"
+
+#define DEFAULT_RUNS 3
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+static const char *usage_msg =
+	"Usage: mattersplatter-bench [-r runs] [-e engines] mattersplatter "
+	"workload...\n"
+	"\n"
+	"       -r runs   \tTime every workload runs times [3].\n"
+	"       -e engines\tComma separated engines to run, among interpreter,\n"
+	"                 \tcompiler and c [interpreter,compiler].";
+
+enum engine {
+ENGINE_INTERPRETER,
+ENGINE_COMPILER,
+ENGINE_C,
+ENGINE_COUNT
+};
+
+static const char *engine_names[ENGINE_COUNT] = {
+	[ENGINE_INTERPRETER] = "interpreter",
+	[ENGINE_COMPILER] = "compiler",
+	[ENGINE_C] = "c",
+};
+
+static const char *counter_keys[COUNTER_EVENT_COUNT] = {
+	[COUNTER_CYCLES] = "cycles",
+	[COUNTER_INSTRUCTIONS] = "instructions",
+	[COUNTER_BRANCH_MISSES] = "branch_misses",
+	[COUNTER_L1D_MISSES] = "l1d_misses",
+	[COUNTER_LLC_MISSES] = "llc_misses",
+	[COUNTER_TASK_CLOCK] = "task_clock_ns",
+};
+
+/* The output of a run, reduced to its length and hash. */
+struct output_digest {
+	uint64_t len;
+	uint64_t hash;
+};
+
+/* Reference behaviour of a workload, as executed by the library. */
+struct reference {
+	uint64_t steps;
+	struct output_digest output;
+};
+
+struct measurement {
+	double wall_seconds;
+	long max_rss_kib;
+	struct output_digest output;
+	struct counters counters;
+	bool has_failed;
+};
+
+static void
+digest_update(struct output_digest *d, const unsigned char *buf,
+	      const size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		d->hash = (d->hash ^ buf[i]) * FNV_PRIME;
+	}
+	d->len += len;
+}
+
+static double
+seconds_since(const struct timespec start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double) (now.tv_sec - start.tv_sec)
+		+ (double) (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static int
+read_nothing(void *ctx)
+{
+	(void) ctx;
+	return -1;
+}
+
+static int
+write_to_digest(int c, void *ctx)
+{
+	const unsigned char byte = c;
+
+	digest_update(ctx, &byte, 1);
+	return 0;
+}
+
+/*
+ * Executes the workload in `src_code` with the library's interpreter, counting
+ * the executed instructions. Returns 0 on success, or an errno value.
+ */
+static int
+reference_run(const char *src_code, const size_t len, struct reference *ref)
+{
+	struct matsplat_tokenize_result tokens = matsplat_tokenize(src_code, len);
+	struct matsplat_node *ast = matsplat_ast_create(tokens.tokens,
+							tokens.len);
+	struct matsplat_program program = matsplat_program_create(ast, 30000);
+	uint64_t *counts = NULL;
+	int err;
+
+	matsplat_tokenize_destory(tokens);
+	matsplat_ast_destroy(ast);
+	if ((err = program.error_code) != 0) {
+		return err;
+	}
+
+	counts = calloc(program.len, sizeof(uint64_t));
+	if (counts == NULL) {
+		matsplat_program_destroy(program);
+		return ENOMEM;
+	}
+
+	*ref = (struct reference) { .output.hash = FNV_OFFSET };
+	struct matsplat_io_callbacks io = {
+		.read = read_nothing,
+		.write = write_to_digest,
+		.ctx = &ref->output
+	};
+	const struct matsplat_execute_options opts = {
+		.io = &io,
+		.profile = counts
+	};
+	struct matsplat_execution_result result =
+		matsplat_program_execute_with_options(&program, &opts);
+	matsplat_execution_result_destory(result);
+
+	for (size_t i = 0; i < program.len; i++) {
+		ref->steps += counts[i];
+	}
+
+	free(counts);
+	matsplat_program_destroy(program);
+	return 0;
+}
+
+/*
+ * Runs `argv` in `dir` (or the current directory if NULL), with its stdin
+ * redirected from /dev/null and its stdout digested. The performance counters
+ * of the command are read when available. Returns 0 if the command ran and
+ * exited successfully.
+ */
+static int
+spawn(char *const argv[], const char *dir, struct measurement *m)
+{
+	struct timespec start;
+	struct rusage usage;
+	int fds[2];
+	int go[2];
+	int status;
+	char byte;
+
+	*m = (struct measurement) { .output.hash = FNV_OFFSET };
+	if (pipe(fds) == -1) {
+		return errno;
+	}
+	if (pipe(go) == -1) {
+		int err = errno;
+		close(fds[0]);
+		close(fds[1]);
+		return err;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	const pid_t pid = fork();
+	if (pid == -1) {
+		int err = errno;
+		close(fds[0]);
+		close(fds[1]);
+		close(go[0]);
+		close(go[1]);
+		return err;
+	}
+
+	if (pid == 0) {
+		const int null_fd = open("/dev/null", O_RDWR);
+		if (null_fd == -1 || dup2(null_fd, STDIN_FILENO) == -1
+		    || dup2(fds[1], STDOUT_FILENO) == -1
+		    || (dir != NULL && chdir(dir) == -1)) {
+			_exit(127);
+		}
+		close(fds[0]);
+		close(fds[1]);
+		close(null_fd);
+
+		/* Wait for the counters, which start on `execv`. */
+		close(go[1]);
+		while (read(go[0], &byte, 1) == -1 && errno == EINTR) {
+			continue;
+		}
+		close(go[0]);
+		execv(argv[0], argv);
+		_exit(127);
+	}
+
+	close(go[0]);
+	counters_open(&m->counters, pid, false);
+	close(go[1]);
+
+	close(fds[1]);
+	unsigned char buf[65536];
+	ssize_t n;
+	while ((n = read(fds[0], buf, sizeof(buf))) != 0) {
+		if (n == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		digest_update(&m->output, buf, n);
+	}
+	close(fds[0]);
+
+	while (wait4(pid, &status, 0, &usage) == -1) {
+		if (errno != EINTR) {
+			int err = errno;
+			counters_close(&m->counters);
+			return err;
+		}
+	}
+
+	m->wall_seconds = seconds_since(start);
+	m->max_rss_kib = usage.ru_maxrss;
+	counters_read(&m->counters);
+	counters_close(&m->counters);
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		return ECHILD;
+	}
+
+	return 0;
+}
+
+/*
+ * Runs `argv` `runs` times, keeping the fastest wall time with its counters,
+ * and the largest resident set. Runs whose output differs from `ref` are
+ * failures.
+ */
+static void
+measure(char *const argv[], const size_t runs, const struct reference *ref,
+	struct measurement *best)
+{
+	struct measurement m;
+
+	*best = (struct measurement) {0};
+	for (size_t i = 0; i < runs; i++) {
+		if (spawn(argv, NULL, &m) != 0
+		    || m.output.len != ref->output.len
+		    || m.output.hash != ref->output.hash) {
+			best->has_failed = true;
+			return;
+		}
+
+		if (i == 0 || m.wall_seconds < best->wall_seconds) {
+			best->wall_seconds = m.wall_seconds;
+			best->counters = m.counters;
+		}
+		if (m.max_rss_kib > best->max_rss_kib) {
+			best->max_rss_kib = m.max_rss_kib;
+		}
+		best->output = m.output;
+	}
+}
+
+static void
+print_result(const char *workload, const enum engine engine,
+	     const struct reference *ref, const struct measurement *m,
+	     const double compile_seconds)
+{
+	printf("{\"workload\": \"%s\", \"engine\": \"%s\", ", workload,
+	       engine_names[engine]);
+	if (m->has_failed) {
+		printf("\"status\": \"failed\"}\n");
+		fflush(stdout);
+		return;
+	}
+
+	printf("\"status\": \"ok\", \"steps\": %" PRIu64 ", "
+	       "\"wall_seconds\": %.6f, \"steps_per_second\": %.0f, "
+	       "\"max_rss_kib\": %ld, \"output_bytes\": %" PRIu64,
+	       ref->steps, m->wall_seconds,
+	       m->wall_seconds > 0 ? ref->steps / m->wall_seconds : 0.0,
+	       m->max_rss_kib, m->output.len);
+	if (engine != ENGINE_INTERPRETER) {
+		printf(", \"compile_seconds\": %.6f", compile_seconds);
+	}
+	for (size_t e = 0; e < COUNTER_EVENT_COUNT; e++) {
+		if (m->counters.has_value[e]) {
+			printf(", \"%s\": %" PRIu64, counter_keys[e],
+			       m->counters.values[e]);
+		}
+	}
+	printf("}\n");
+	fflush(stdout);
+}
+
+static intmax_t
+load_file_to_buffer(char **buffer, const char *filename)
+{
+	intmax_t size = -1;
+
+	FILE *f = fopen(filename, "r");
+	if (f == NULL) {
+		goto load_file_to_buffer_error;
+	}
+
+	if (fseek(f, 0L, SEEK_END) == -1) {
+		goto load_file_to_buffer_error;
+	}
+
+	size = ftell(f);
+	if (size == -1) {
+		goto load_file_to_buffer_error;
+	}
+	rewind(f);
+
+	*buffer = calloc(size + 1, sizeof(char));
+	if (*buffer == NULL) {
+		goto load_file_to_buffer_error;
+	}
+
+	if (fread(*buffer, sizeof(char), size, f) != (size_t) size) {
+		free(*buffer);
+		goto load_file_to_buffer_error;
+	}
+
+	fclose(f);
+	return size;
+
+load_file_to_buffer_error:
+	*buffer = NULL;
+	if (f) {
+		fclose(f);
+	}
+	return -1;
+}
+
+/* Returns the workload name of `path`: its base name without extension. */
+static void
+workload_name(char *name, const size_t len, const char *path)
+{
+	char copy[PATH_MAX];
+
+	snprintf(copy, sizeof(copy), "%s", path);
+	snprintf(name, len, "%s", basename(copy));
+	char *dot = strrchr(name, '.');
+	if (dot != NULL && dot != name) {
+		*dot = '\0';
+	}
+}
+
+/*
+ * Benchmarks the workload at `path` under every enabled engine. Compiled
+ * binaries are built in `tmp_dir`. Returns false if any engine failed.
+ */
+static bool
+bench_workload(char *exe, char *path, const char *tmp_dir,
+	       const bool engines[ENGINE_COUNT], const size_t runs)
+{
+	char name[NAME_MAX + 1];
+	char binary[PATH_MAX + NAME_MAX + 2];
+	struct reference ref;
+	struct measurement m;
+	bool is_ok = true;
+	char *src_code;
+	int err;
+
+	workload_name(name, sizeof(name), path);
+	const intmax_t len = load_file_to_buffer(&src_code, path);
+	if (len < 0) {
+		fprintf(stderr, "Could not read %s: %s\n", path,
+			strerror(errno));
+		return false;
+	}
+
+	err = reference_run(src_code, len, &ref);
+	free(src_code);
+	if (err != 0) {
+		fprintf(stderr, "Could not execute %s: %s\n", path,
+			strerror(err));
+		return false;
+	}
+
+	if (engines[ENGINE_INTERPRETER]) {
+		char *argv[] = { exe, "-b", "-n", path, NULL };
+		measure(argv, runs, &ref, &m);
+		print_result(name, ENGINE_INTERPRETER, &ref, &m, 0);
+		is_ok = is_ok && !m.has_failed;
+	}
+
+	/* The C backend is measured as a baseline for the NASM one. */
+	for (size_t e = ENGINE_COMPILER; e <= ENGINE_C; e++) {
+		char *compile_argv[] = {
+			exe, "-n", "-t", e == ENGINE_C ? "c" : "nasm", "-o",
+			binary, path, NULL
+		};
+		char *run_argv[] = { binary, NULL };
+		struct measurement compile = {0};
+
+		if (!engines[e]) {
+			continue;
+		}
+
+		snprintf(binary, sizeof(binary), "%s/%s", tmp_dir, name);
+		if (spawn(compile_argv, tmp_dir, &compile) != 0) {
+			m = (struct measurement) { .has_failed = true };
+		} else {
+			measure(run_argv, runs, &ref, &m);
+		}
+		print_result(name, e, &ref, &m, compile.wall_seconds);
+		is_ok = is_ok && !m.has_failed;
+		unlink(binary);
+	}
+
+	return is_ok;
+}
+
+static bool
+parse_engines(const char *list, bool engines[ENGINE_COUNT])
+{
+	char copy[64];
+	char *save;
+
+	snprintf(copy, sizeof(copy), "%s", list);
+	memset(engines, 0, ENGINE_COUNT * sizeof(bool));
+	for (char *e = strtok_r(copy, ",", &save); e != NULL;
+	     e = strtok_r(NULL, ",", &save)) {
+		size_t i = 0;
+		while (i < ENGINE_COUNT && strcmp(e, engine_names[i]) != 0) {
+			i++;
+		}
+		if (i == ENGINE_COUNT) {
+			return false;
+		}
+		engines[i] = true;
+	}
+
+	return true;
+}
+
+int
+main(int argc, char *argv[])
+{
+	bool engines[ENGINE_COUNT] = { true, true };
+	char tmp_dir[PATH_MAX];
+	char exe[PATH_MAX];
+	size_t runs = DEFAULT_RUNS;
+	bool is_ok = true;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "e:r:")) != -1) {
+		switch (opt) {
+			case 'e':
+				if (!parse_engines(optarg, engines)) {
+					fprintf(stderr, "Unknown engine in %s.\n",
+						optarg);
+					return EXIT_FAILURE;
+				}
+				break;
+			case 'r':
+				runs = strtoul(optarg, NULL, 10);
+				if (runs == 0) {
+					fprintf(stderr, "%s\n", usage_msg);
+					return EXIT_FAILURE;
+				}
+				break;
+			default:
+				fprintf(stderr, "%s\n", usage_msg);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (argc - optind < 2) {
+		fprintf(stderr, "%s\n", usage_msg);
+		return EXIT_FAILURE;
+	}
+
+	/* Binaries are run from a temporary directory, so resolve the path. */
+	if (realpath(argv[optind], exe) == NULL) {
+		fprintf(stderr, "Could not find %s: %s\n", argv[optind],
+			strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	const char *tmp = getenv("TMPDIR");
+	snprintf(tmp_dir, sizeof(tmp_dir), "%s/mattersplatter-bench.XXXXXX",
+		 tmp != NULL ? tmp : "/tmp");
+	if (mkdtemp(tmp_dir) == NULL) {
+		fprintf(stderr, "Could not create a temporary directory: %s\n",
+			strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	for (int i = optind + 1; i < argc; i++) {
+		char workload[PATH_MAX];
+
+		if (realpath(argv[i], workload) == NULL) {
+			fprintf(stderr, "Could not find %s: %s\n", argv[i],
+				strerror(errno));
+			is_ok = false;
+			continue;
+		}
+		is_ok = bench_workload(exe, workload, tmp_dir, engines, runs)
+			&& is_ok;
+	}
+
+	/* The compiler leaves its intermediate files in the working directory. */
+	char path[PATH_MAX + 16];
+	snprintf(path, sizeof(path), "%s/out.asm", tmp_dir);
+	unlink(path);
+	snprintf(path, sizeof(path), "%s/out.o", tmp_dir);
+	unlink(path);
+	snprintf(path, sizeof(path), "%s/out.c", tmp_dir);
+	unlink(path);
+	rmdir(tmp_dir);
+
+	return is_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,15 @@
+Fib: 3000 consecutive Fibonacci numbers in decimal starting at 1 and 2
+Numbers are kept as arrays of decimal digits with the least
+significant digit first and are added digit by digit with carry
+Exercises long unbalanced loops and produces about a megabyte
+of output
+
+>>>>>>>>>>>>+>>+<<<<<<<<<<<<++++++++++++[-<------[-<>>>>>>>>>>>>[>[-
+>>>+<<<]>[->>+<<<+>]>[->+<]>[->>>+>+<<<<]>>>>[-<<<<+>>>>]<<<[-]>[-]>[-
+<+[->>>+>+<<<<]>>>>[-<<<<+>>>>]<----------<[-]+>[->+>+<<]>>[-
+<<+>>]<[<<[-]>>[-]]<[-]<[<<[-]<+>>>[-]]<]<<<[-]>>[-<<<<+>>>>]<[-
+>>>>>>>>>>+<<<<<<<<<<]<<<<<>>>>>>>>>>>>]>>>[->+>+<<]>>[-
+<<+>>]<[<<<<+>>>[-<+>]>[-
+]]<<<<[>>>>>>>>>>>>]<<<<<<<<<<<<[>>+++++++++++++++++++++++++++++++++++++
++++++++++++.------------------------------------------------
+<<<<<<<<<<<<<<]>>>>[-]++++++++++.[-]<<<<>]>]
@@ -0,0 +1,54 @@
+Hanoi: towers of Hanoi for 20 discs
+The discs are named a to t and the pegs 1 to 3 and every one
+of the 1048575 moves is printed on its own line
+A binary counter spread over one frame of cells per disc picks
+the disc to move so the hot loops walk the tape frame by frame
+
+>>+>>>>>>>>>>+>>+>++++++++++++++++++++++++++++++++++++++++++++++++++++++
++++++++++++++++++++++++++++++++++++++++++++>>>>>>>>+>>++>+++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
++++++++++++>>>>>>>>+>>+>++++++++++++++++++++++++++++++++++++++++++++++++
++++++++++++++++++++++++++++++++++++++++++++++++++++>>>>>>>>+>>++>+++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
++++++++++++++++++++++>>>>>>>>+>>+>++++++++++++++++++++++++++++++++++++++
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++>>>>>>>>+
+>>++>+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
++++++++++++++++++++++++++++++++++++>>>>>>>>+>>+>++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
++++++++>>>>>>>>+>>++>+++++++++++++++++++++++++++++++++++++++++++++++++++
++++++++++++++++++++++++++++++++++++++++++++++++++++++>>>>>>>>+>>+>++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
++++++++++++++++++++++++++++>>>>>>>>+>>++>+++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
++++>>>>>>>>+>>+>++++++++++++++++++++++++++++++++++++++++++++++++++++++++
++++++++++++++++++++++++++++++++++++++++++++++++++++>>>>>>>>+>>++>+++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
++++++++++++++++++++++++++++++>>>>>>>>+>>+>++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
++++++++>>>>>>>>+>>++>+++++++++++++++++++++++++++++++++++++++++++++++++++
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++>>>>>>>>+>>+>
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
++++++++++++++++++++++++++++++++++++++++>>>>>>>>+>>++>+++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
++++++++++++++++++++++>>>>>>>>+>>+>++++++++++++++++++++++++++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
++++>>>>>>>>+>>++>+++++++++++++++++++++++++++++++++++++++++++++++++++++++
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++>>>>>>>>+>>+>
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
++++++++++++++++++++++++++++++++++++++++++++>>>>>>>>+>>++>+++++++++++++++
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
++++++++++++++++++++++++++++++>>>>>>>>+>>>>+<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<[>>>>>>>>>[
+->>>>>>>>>>>]>>>>>>+<[->->+<<]>>[-<<+>>]<[-<<<<<<+>>>>.>>>[-
+]++++++++++++++++++++++++++++++++.[-]<<<<<[->>>>>+>+<<<<<<]>>>>>>[-
+<<<<<<+>>>>>>]<+++++++++++++++++++++++++++++++++++++++++++++++++.[-][-
+]++++++++++++++++++++++++++++++++.[-]<<<<[-<+>>>>>+<<<<]>>>>[-
+<<<<+>>>>]<<<<<[->>>>>>+>+<<<<<<<]>>>>>>>[-<<<<<<<+>>>>>>>]<---<[-]+>[-
+>+>+<<]>>[-<<+>>]<[<<[-]>>[-]]<[-]<[<<<<<[-]>>>>>[-]]<<<<<[-
+>>>>>>+>+<<<<<<<]>>>>>>>[-<<<<<<<+>>>>>>>]<----<[-]+>[->+>+<<]>>[-
+<<+>>]<[<<[-]>>[-]]<[-]<[<<<<<[-]+>>>>>[-]]<<<<<[-
+>>>>>+>+<<<<<<]>>>>>>[-
+<<<<<<+>>>>>>]<+++++++++++++++++++++++++++++++++++++++++++++++++.[-][-
+]++++++++++.[-]<<<<<<[<<<<<<<<<<<]>>>>>]<<<<]
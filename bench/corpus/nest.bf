@@ -0,0 +1,6 @@
+Nest: three nested counting loops of 255 iterations each
+The innermost loop clears a cell on every iteration so it
+cannot be replaced by a multiplication
+Measures raw loop dispatch
+
+-[>-[>-[->+>[-]<<]<-]<-]>>>.<.<.
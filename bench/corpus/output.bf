@@ -0,0 +1,10 @@
+Output: a large output generator
+Prints 64000 lines of the 94 printable ASCII characters
+which is about six megabytes
+Measures the cost of writing output one cell at a time
+
+>>>>>[-]++++++++++<<<<<[-
+]++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++[>[-
+]++++[>[-]------[>[-]+++++++++++++++++++++++++++++++++>[-
+]+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
++++++++++++++++++++++++[<.+>-]>.<<<-]<-]<-]
@@ -0,0 +1,33 @@
+Primes: prime numbers below 256 by trial division
+Every candidate is divided by every smaller number with a
+repeated subtraction loop and the primes are printed in decimal
+one per line
+Exercises arithmetic on a handful of fixed cells with deeply
+nested balanced loops
+
+[-]++>[-]--[>[-]+>[-]++<<<[->>>>+>>>>>+<<<<<<<<<]>>>>>>>>>[-
+<<<<<<<<<+>>>>>>>>>]<<<<<--[>[-]<<<<<[->>>>>>+>>>+<<<<<<<<<]>>>>>>>>>[-
+<<<<<<<<<+>>>>>>>>>]<<<[-<+[->>>+>+<<<<]>>>>[-<<<<+>>>>]<<<<<<[-
+>>>>>>+>+<<<<<<<]>>>>>>>[-<<<<<<<+>>>>>>>]<[-<->]<<[-]+>[->+>+<<]>>[-
+<<+>>]<[<<[-]>>[-]]<[-]<[<<[-]>>[-]]<]>>>[-]+<<<<[-
+>>>>>+>+<<<<<<]>>>>>>[-<<<<<<+>>>>>>]<[<[-]>[-]]<[<<<<<<<[-]>>>>>>>[-
+]]<<<<<<+>-]<<[->>>>>>>+>+<<<<<<<<]>>>>>>>>[-
+<<<<<<<<+>>>>>>>>]<[<<<<<<<<<[-
+>>>>>>>>>>>>>>+>+<<<<<<<<<<<<<<<]>>>>>>>>>>>>>>>[-
+<<<<<<<<<<<<<<<+>>>>>>>>>>>>>>>]<<<<<[-]>[-]>>>[-<<<+[-
+>>>>>+>+<<<<<<]>>>>>>[-<<<<<<+>>>>>>]<----------------------------------
+------------------------------------------------------------------<[-
+]+>[->+>+<<]>>[-<<+>>]<[<<[-]>>[-]]<[-]<[<<<<[-]<+>>>>>[-]]<]<<<[-
+>>>>+<+<<<]>>>[-<<<+>>>]<<[-]>[-]>>[-<<+[->>>+>+<<<<]>>>>[-<<<<+>>>>]<--
+--------<<[-]+>>[->+>+<<]>>[-<<+>>]<[<<<[-]>>>[-]]<[-]<<[<[-]<+>>[-
+]]>]<<<<<[->>>>+>+<<<<<]>>>>>[-
+<<<<<+>>>>>]<[<<<<++++++++++++++++++++++++++++++++++++++++++++++++.-----
+------------------------------------------->>+++++++++++++++++++++++++++
++++++++++++++++++++++.------------------------------------------------
+>>[-]]<<<<[->>>>+>+<<<<<]>>>>>[-<<<<<+>>>>>]<[[-]][-]+<<<<[-
+>>>>>+>+<<<<<<]>>>>>>[-<<<<<<+>>>>>>]<[<[-]>[-]]<[<<[->>>+>+<<<<]>>>>[-
+<<<<+>>>>]<[<<<++++++++++++++++++++++++++++++++++++++++++++++++.--------
+---------------------------------------->>>[-]]<[-
+]]<++++++++++++++++++++++++++++++++++++++++++++++++.--------------------
+----------------------------<<<[-]>[-]>[-]>[-]>[-]++++++++++.[-]<<<<<[-
+]]<<<<<<<<<+>-]
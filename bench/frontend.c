@@ -0,0 +1,432 @@
+/*
+ * Mattersplatter - a compiler & interpreter for the Brainf*ck language.
+ * Copyright (C) 2021 Maxwell R. Haley <maxwell.r.haley@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Times the tokenizer, the parser and the compiler on synthetic sources of
+ * growing size, fits the growth of every phase to a power law, and flags the
+ * phases that grow faster than linearly. Every measurement runs in its own
+ * process, so a phase that crashes or runs away does not end the benchmark.
+ */
+#define _DEFAULT_SOURCE
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <mattersplatter.h>
+
+#define MIN_SIZE 1024
+#define SIZE_STEP 4
+#define DEFAULT_MAX_SIZE (1ULL << 30)
+#define DEFAULT_TIMEOUT 60
+#define DEFAULT_THRESHOLD 1.2
+/* Smaller sources are dominated by fixed costs, so they are not fitted. */
+#define MIN_FIT_SIZE (64 * 1024)
+/* Fast phases are repeated until they ran for this long. */
+#define MIN_MEASURE_SECONDS 0.05
+#define MAX_SIZES 64
+
+static const char *usage_msg =
+	"Usage: mattersplatter-frontend-bench [-M max_size] [-T timeout] "
+	"[-t threshold]\n"
+	"\n"
+	"       -M max_size \tLargest source to generate, with an optional K, M\n"
+	"                   \tor G suffix [1G].\n"
+	"       -T timeout  \tSeconds allowed per measurement [60].\n"
+	"       -t threshold\tLargest growth exponent accepted as linear [1.2].";
+
+enum phase {
+PHASE_TOKENIZE,
+PHASE_PARSE,
+PHASE_COMPILE,
+PHASE_COUNT
+};
+
+static const char *phase_names[PHASE_COUNT] = {
+	[PHASE_TOKENIZE] = "tokenize",
+	[PHASE_PARSE] = "parse",
+	[PHASE_COMPILE] = "compile",
+};
+
+enum shape {
+SHAPE_COMMENTS,
+SHAPE_NESTED,
+SHAPE_STRAIGHT,
+SHAPE_COUNT
+};
+
+static const char *shape_names[SHAPE_COUNT] = {
+	[SHAPE_COMMENTS] = "comments",
+	[SHAPE_NESTED] = "nested",
+	[SHAPE_STRAIGHT] = "straight",
+};
+
+enum status {
+STATUS_OK,
+STATUS_FAILED,
+STATUS_CRASHED,
+STATUS_TIMEOUT,
+};
+
+static const char *status_names[] = {
+	[STATUS_OK] = "ok",
+	[STATUS_FAILED] = "failed",
+	[STATUS_CRASHED] = "crashed",
+	[STATUS_TIMEOUT] = "timeout",
+};
+
+struct measurement {
+	size_t size;
+	double seconds;
+	long max_rss_kib;
+	enum status status;
+};
+
+static double
+seconds_since(const struct timespec start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double) (now.tv_sec - start.tv_sec)
+		+ (double) (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/*
+ * Generates `size` bytes of source in the given shape, NUL terminated.
+ * - comments: lines of prose with a couple of instructions each.
+ * - nested: a single loop nest as deep as the source allows.
+ * - straight: a random walk of `+-<>` without any loop.
+ */
+static char *
+generate(const enum shape shape, const size_t size)
+{
+	static const char prose[] =
+		"Comments explain what the next few cells are for +>\n";
+	static const char ops[] = "+-<>";
+	uint32_t state = 1;
+
+	char *src = malloc(size + 1);
+	if (src == NULL) {
+		return NULL;
+	}
+
+	for (size_t i = 0; i < size; i++) {
+		switch (shape) {
+			case SHAPE_COMMENTS:
+				src[i] = prose[i % (sizeof(prose) - 1)];
+				break;
+			case SHAPE_NESTED:
+				src[i] = i < size / 2 ? '['
+					: i < size / 2 * 2 ? ']' : '\n';
+				break;
+			default:
+				state = state * 1103515245 + 12345;
+				src[i] = i % 64 == 63 ? '\n'
+					: ops[(state >> 16) & 3];
+				break;
+		}
+	}
+
+	src[size] = '\0';
+	return src;
+}
+
+/*
+ * Runs the phase on a source, returning the average time of one run in
+ * `seconds`. The phases it depends on are run once, untimed. Returns false if
+ * the phase reported an error.
+ */
+static bool
+time_phase(const enum phase phase, const char *src, const size_t size,
+	   double *seconds)
+{
+	struct matsplat_tokenize_result tokens = {0};
+	struct matsplat_node *ast = NULL;
+	struct timespec start;
+	double total = 0;
+	size_t runs = 0;
+	bool is_ok = true;
+
+	if (phase > PHASE_TOKENIZE) {
+		tokens = matsplat_tokenize(src, size);
+	}
+	if (phase > PHASE_PARSE) {
+		ast = matsplat_ast_create(tokens.tokens, tokens.len);
+	}
+
+	do {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (phase == PHASE_TOKENIZE) {
+			struct matsplat_tokenize_result t =
+				matsplat_tokenize(src, size);
+			total += seconds_since(start);
+			matsplat_tokenize_destory(t);
+		} else if (phase == PHASE_PARSE) {
+			struct matsplat_node *a =
+				matsplat_ast_create(tokens.tokens, tokens.len);
+			total += seconds_since(start);
+			matsplat_ast_destroy(a);
+		} else {
+			struct matsplat_compilation_result c =
+				matsplat_compile(ast, 30000);
+			total += seconds_since(start);
+			is_ok = c.error_code == 0;
+			matsplat_compilation_result_destroy(c);
+		}
+		runs++;
+	} while (is_ok && total < MIN_MEASURE_SECONDS);
+
+	if (ast != NULL) {
+		matsplat_ast_destroy(ast);
+	}
+	if (phase > PHASE_TOKENIZE) {
+		matsplat_tokenize_destory(tokens);
+	}
+
+	*seconds = total / runs;
+	return is_ok;
+}
+
+/* Measures one phase on one source, in a child process. */
+static struct measurement
+measure(const enum phase phase, const enum shape shape, const size_t size,
+	const unsigned timeout)
+{
+	struct measurement m = { .size = size, .status = STATUS_FAILED };
+	struct rusage usage;
+	int fds[2];
+	int status;
+
+	if (pipe(fds) == -1) {
+		return m;
+	}
+
+	fflush(stdout);
+	const pid_t pid = fork();
+	if (pid == -1) {
+		close(fds[0]);
+		close(fds[1]);
+		return m;
+	}
+
+	if (pid == 0) {
+		double seconds;
+
+		close(fds[0]);
+		char *src = generate(shape, size);
+		alarm(timeout);
+		if (src == NULL || !time_phase(phase, src, size, &seconds)
+		    || write(fds[1], &seconds, sizeof(seconds))
+		       != sizeof(seconds)) {
+			_exit(EXIT_FAILURE);
+		}
+		_exit(EXIT_SUCCESS);
+	}
+
+	close(fds[1]);
+	const bool has_result = read(fds[0], &m.seconds, sizeof(m.seconds))
+		== sizeof(m.seconds);
+	close(fds[0]);
+	while (wait4(pid, &status, 0, &usage) == -1) {
+		if (errno != EINTR) {
+			return m;
+		}
+	}
+
+	m.max_rss_kib = usage.ru_maxrss;
+	if (WIFSIGNALED(status)) {
+		m.status = WTERMSIG(status) == SIGALRM
+			? STATUS_TIMEOUT : STATUS_CRASHED;
+	} else if (WEXITSTATUS(status) == 0 && has_result) {
+		m.status = STATUS_OK;
+	}
+
+	return m;
+}
+
+/*
+ * Fits `seconds = c * size^k` to the measurements by least squares on their
+ * logarithms, and returns `k`. Returns NAN if there are too few measurements.
+ */
+static double
+growth_exponent(const struct measurement *ms, const size_t len)
+{
+	double sx = 0, sy = 0, sxx = 0, sxy = 0;
+	size_t n = 0;
+	size_t min_size = MIN_FIT_SIZE;
+
+	/* Small runs only get fitted when nothing larger was measured. */
+	if (len > 0 && ms[len - 1].size < min_size * SIZE_STEP) {
+		min_size = 0;
+	}
+
+	for (size_t i = 0; i < len; i++) {
+		if (ms[i].size < min_size || ms[i].seconds <= 0) {
+			continue;
+		}
+		const double x = log((double) ms[i].size);
+		const double y = log(ms[i].seconds);
+		sx += x;
+		sy += y;
+		sxx += x * x;
+		sxy += x * y;
+		n++;
+	}
+
+	if (n < 3) {
+		return NAN;
+	}
+
+	return (n * sxy - sx * sy) / (n * sxx - sx * sx);
+}
+
+static bool
+parse_size(const char *s, size_t *size)
+{
+	char *end;
+
+	errno = 0;
+	unsigned long long n = strtoull(s, &end, 10);
+	switch (*end) {
+		case 'G':
+			n <<= 10;
+			/* fall through */
+		case 'M':
+			n <<= 10;
+			/* fall through */
+		case 'K':
+			n <<= 10;
+			end++;
+			break;
+		default:
+			break;
+	}
+
+	if (errno != 0 || end == s || *end != '\0' || n < MIN_SIZE
+	    || n > SIZE_MAX / SIZE_STEP) {
+		return false;
+	}
+
+	*size = n;
+	return true;
+}
+
+int
+main(int argc, char *argv[])
+{
+	size_t max_size = DEFAULT_MAX_SIZE;
+	unsigned timeout = DEFAULT_TIMEOUT;
+	double threshold = DEFAULT_THRESHOLD;
+	bool is_ok = true;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "M:T:t:")) != -1) {
+		switch (opt) {
+			case 'M':
+				if (!parse_size(optarg, &max_size)) {
+					fprintf(stderr, "Invalid size %s.\n",
+						optarg);
+					return EXIT_FAILURE;
+				}
+				break;
+			case 'T':
+				timeout = strtoul(optarg, NULL, 10);
+				break;
+			case 't':
+				threshold = strtod(optarg, NULL);
+				break;
+			default:
+				fprintf(stderr, "%s\n", usage_msg);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (optind != argc || timeout == 0 || !(threshold > 0)) {
+		fprintf(stderr, "%s\n", usage_msg);
+		return EXIT_FAILURE;
+	}
+
+	for (size_t s = 0; s < SHAPE_COUNT; s++) {
+		for (size_t p = 0; p < PHASE_COUNT; p++) {
+			struct measurement ms[MAX_SIZES];
+			size_t len = 0;
+			bool has_failed = false;
+
+			for (size_t size = MIN_SIZE; size <= max_size;
+			     size *= SIZE_STEP) {
+				const struct measurement m =
+					measure(p, s, size, timeout);
+				printf("{\"phase\": \"%s\", \"shape\": \"%s\", "
+				       "\"bytes\": %zu, \"status\": \"%s\"",
+				       phase_names[p], shape_names[s], size,
+				       status_names[m.status]);
+				if (m.status == STATUS_OK) {
+					printf(", \"seconds\": %.9f, "
+					       "\"bytes_per_second\": %.0f, "
+					       "\"max_rss_kib\": %ld",
+					       m.seconds,
+					       m.seconds > 0
+					       ? size / m.seconds : 0.0,
+					       m.max_rss_kib);
+				}
+				printf("}\n");
+
+				/* Larger sources would only fail the same way. */
+				if (m.status != STATUS_OK) {
+					has_failed = true;
+					break;
+				}
+				ms[len++] = m;
+			}
+
+			const double k = growth_exponent(ms, len);
+			const bool is_super_linear = !isnan(k) && k > threshold;
+			printf("{\"phase\": \"%s\", \"shape\": \"%s\", "
+			       "\"fit\": \"power\", \"exponent\": ",
+			       phase_names[p], shape_names[s]);
+			if (isnan(k)) {
+				printf("null");
+			} else {
+				printf("%.3f", k);
+			}
+			printf(", \"super_linear\": %s, \"complete\": %s}\n",
+			       is_super_linear ? "true" : "false",
+			       has_failed ? "false" : "true");
+			fflush(stdout);
+
+			if (is_super_linear) {
+				fprintf(stderr, "%s on %s sources grows as "
+					"size^%.2f.\n", phase_names[p],
+					shape_names[s], k);
+			}
+			is_ok = is_ok && !is_super_linear && !has_failed;
+		}
+	}
+
+	return is_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,312 @@
+/*
+ * Mattersplatter - a compiler & interpreter for the Brainf*ck language.
+ * Copyright (C) 2021 Maxwell R. Haley <maxwell.r.haley@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <linux/perf_event.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "counters.h"
+
+#define CACHE_READ_MISSES(cache) \
+	((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) \
+	 | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+struct event {
+	const char *name;
+	uint32_t type;
+	uint64_t config;
+	/*
+	 * Events between two samples. Frequent events are sampled sparsely,
+	 * and the periods are prime so they do not beat with the loops.
+	 */
+	uint64_t period;
+};
+
+static const struct event events[COUNTER_EVENT_COUNT] = {
+	[COUNTER_CYCLES] = {
+		"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES,
+		1000003
+	},
+	[COUNTER_INSTRUCTIONS] = {
+		"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,
+		1000003
+	},
+	[COUNTER_BRANCH_MISSES] = {
+		"branch-misses", PERF_TYPE_HARDWARE,
+		PERF_COUNT_HW_BRANCH_MISSES, 10007
+	},
+	[COUNTER_L1D_MISSES] = {
+		"L1-dcache-load-misses", PERF_TYPE_HW_CACHE,
+		CACHE_READ_MISSES(PERF_COUNT_HW_CACHE_L1D), 10007
+	},
+	[COUNTER_LLC_MISSES] = {
+		"LLC-load-misses", PERF_TYPE_HW_CACHE,
+		CACHE_READ_MISSES(PERF_COUNT_HW_CACHE_LL), 1009
+	},
+	/* In nanoseconds, so once every 100 microseconds of CPU time. */
+	[COUNTER_TASK_CLOCK] = {
+		"task-clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK,
+		100003
+	},
+};
+
+/* The counters being sampled, as read by the signal handler. */
+static struct counters *sampled;
+static volatile size_t *sampled_position;
+static size_t sampled_len;
+
+const char *
+counters_name(const enum counter_event event)
+{
+	return events[event].name;
+}
+
+size_t
+counters_open(struct counters *counters, const pid_t pid,
+	      const bool is_sampled)
+{
+	size_t opened = 0;
+
+	*counters = (struct counters) {0};
+	for (size_t e = 0; e < COUNTER_EVENT_COUNT; e++) {
+		struct perf_event_attr attr = {
+			.size = sizeof(attr),
+			.type = events[e].type,
+			.config = events[e].config,
+			.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED
+				| PERF_FORMAT_TOTAL_TIME_RUNNING,
+			.disabled = 1,
+			.enable_on_exec = pid != 0,
+			.exclude_kernel = 1,
+			.exclude_hv = 1,
+			.sample_period = is_sampled ? events[e].period : 0,
+			.wakeup_events = is_sampled
+		};
+
+		/* Missing PMUs and a strict perf_event_paranoid end up here. */
+		counters->fds[e] = syscall(SYS_perf_event_open, &attr, pid, -1,
+					   -1, PERF_FLAG_FD_CLOEXEC);
+		opened += counters->fds[e] != -1;
+	}
+
+	return opened;
+}
+
+static void
+on_overflow(int sig, siginfo_t *info, void *context)
+{
+	(void) sig;
+	(void) context;
+
+	if (sampled == NULL) {
+		return;
+	}
+
+	const size_t position = *sampled_position;
+	if (position >= sampled_len) {
+		return;
+	}
+
+	for (size_t e = 0; e < COUNTER_EVENT_COUNT; e++) {
+		if (sampled->fds[e] == info->si_fd
+		    && sampled->samples[e] != NULL) {
+			sampled->samples[e][position] += events[e].period;
+			return;
+		}
+	}
+}
+
+int
+counters_sample(struct counters *counters, volatile size_t *position,
+		const size_t len)
+{
+	struct sigaction action = {
+		.sa_sigaction = on_overflow,
+		.sa_flags = SA_SIGINFO | SA_RESTART
+	};
+
+	for (size_t e = 0; e < COUNTER_EVENT_COUNT; e++) {
+		if (counters->fds[e] == -1) {
+			continue;
+		}
+
+		counters->samples[e] = calloc(len > 0 ? len : 1,
+					      sizeof(uint64_t));
+		if (counters->samples[e] == NULL) {
+			return ENOMEM;
+		}
+	}
+
+	sampled = counters;
+	sampled_position = position;
+	sampled_len = len;
+
+	/*
+	 * Real-time signals queue up, so overflows of several counters at once
+	 * are all delivered, and `si_fd` tells them apart.
+	 */
+	sigemptyset(&action.sa_mask);
+	if (sigaction(SIGRTMIN, &action, NULL) == -1) {
+		return errno;
+	}
+
+	for (size_t e = 0; e < COUNTER_EVENT_COUNT; e++) {
+		const int fd = counters->fds[e];
+		if (fd == -1) {
+			continue;
+		}
+
+		if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_ASYNC) == -1
+		    || fcntl(fd, F_SETSIG, SIGRTMIN) == -1
+		    || fcntl(fd, F_SETOWN, getpid()) == -1) {
+			return errno;
+		}
+	}
+
+	return 0;
+}
+
+void
+counters_start(struct counters *counters)
+{
+	for (size_t e = 0; e < COUNTER_EVENT_COUNT; e++) {
+		if (counters->fds[e] != -1) {
+			ioctl(counters->fds[e], PERF_EVENT_IOC_RESET, 0);
+			ioctl(counters->fds[e], PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+}
+
+void
+counters_stop(struct counters *counters)
+{
+	for (size_t e = 0; e < COUNTER_EVENT_COUNT; e++) {
+		if (counters->fds[e] != -1) {
+			ioctl(counters->fds[e], PERF_EVENT_IOC_DISABLE, 0);
+		}
+	}
+
+	counters_read(counters);
+}
+
+void
+counters_read(struct counters *counters)
+{
+	/* The value, and the times the event was enabled and running. */
+	uint64_t read_values[3];
+
+	for (size_t e = 0; e < COUNTER_EVENT_COUNT; e++) {
+		counters->has_value[e] = false;
+		if (counters->fds[e] == -1
+		    || read(counters->fds[e], read_values, sizeof(read_values))
+		    != sizeof(read_values)
+		    || read_values[2] == 0) {
+			continue;
+		}
+
+		/* Extrapolate events that shared a counter with others. */
+		counters->values[e] = read_values[2] == read_values[1]
+			? read_values[0]
+			: (uint64_t) ((double) read_values[0] * read_values[1]
+				      / read_values[2]);
+		counters->has_value[e] = true;
+	}
+}
+
+void
+counters_close(struct counters *counters)
+{
+	for (size_t e = 0; e < COUNTER_EVENT_COUNT; e++) {
+		if (counters->fds[e] != -1) {
+			close(counters->fds[e]);
+			counters->fds[e] = -1;
+		}
+	}
+
+	if (sampled == counters) {
+		signal(SIGRTMIN, SIG_IGN);
+		sampled = NULL;
+	}
+
+	for (size_t e = 0; e < COUNTER_EVENT_COUNT; e++) {
+		free(counters->samples[e]);
+		counters->samples[e] = NULL;
+	}
+}
+
+/* Prints `event` per thousand instructions, if both were counted. */
+static void
+print_per_instructions(FILE *out, const struct counters *counters,
+		       const enum counter_event event)
+{
+	if (counters->has_value[COUNTER_INSTRUCTIONS]
+	    && counters->values[COUNTER_INSTRUCTIONS] > 0) {
+		fprintf(out, "  %8.3f per 1000 instructions",
+			1000.0 * counters->values[event]
+			/ counters->values[COUNTER_INSTRUCTIONS]);
+	}
+}
+
+void
+counters_print(FILE *out, const struct counters *counters)
+{
+	for (size_t e = 0; e < COUNTER_EVENT_COUNT; e++) {
+		if (!counters->has_value[e]) {
+			fprintf(out, "%22s %18s\n", events[e].name,
+				counters->fds[e] == -1 ? "not supported"
+				: "not counted");
+			continue;
+		}
+
+		fprintf(out, "%22s %18" PRIu64, events[e].name,
+			counters->values[e]);
+		switch (e) {
+			case COUNTER_INSTRUCTIONS:
+				if (counters->has_value[COUNTER_CYCLES]
+				    && counters->values[COUNTER_CYCLES] > 0) {
+					fprintf(out, "  %8.3f per cycle",
+						(double) counters->values[e]
+						/ counters->values
+						[COUNTER_CYCLES]);
+				}
+				break;
+			case COUNTER_BRANCH_MISSES:
+			case COUNTER_L1D_MISSES:
+			case COUNTER_LLC_MISSES:
+				print_per_instructions(out, counters, e);
+				break;
+			case COUNTER_TASK_CLOCK:
+				fprintf(out, "  %8.3f msec",
+					counters->values[e] / 1e6);
+				break;
+			default:
+				break;
+		}
+		fprintf(out, "\n");
+	}
+}
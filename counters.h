@@ -0,0 +1,104 @@
+/*
+ * Mattersplatter - a compiler & interpreter for the Brainf*ck language.
+ * Copyright (C) 2021 Maxwell R. Haley <maxwell.r.haley@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef MATTERSPLATTER_COUNTERS_H
+#define MATTERSPLATTER_COUNTERS_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+/*
+ * The events counted through `perf_event_open`. The task clock is a software
+ * event, so it is there even where the hardware counters are not.
+ */
+enum counter_event {
+COUNTER_CYCLES,
+COUNTER_INSTRUCTIONS,
+COUNTER_BRANCH_MISSES,
+COUNTER_L1D_MISSES,
+COUNTER_LLC_MISSES,
+COUNTER_TASK_CLOCK,
+COUNTER_EVENT_COUNT
+};
+
+/*
+ * Performance counters of a process. Events the kernel or the CPU cannot count
+ * are left closed with a `fd` of -1, and are reported as not supported.
+ */
+struct counters {
+	int fds[COUNTER_EVENT_COUNT];
+	/* Counts of the events, scaled up if the kernel multiplexed them. */
+	uint64_t values[COUNTER_EVENT_COUNT];
+	bool has_value[COUNTER_EVENT_COUNT];
+	/*
+	 * Estimated counts of the events per instruction of a program, when
+	 * sampled by `counters_sample`.
+	 */
+	uint64_t *samples[COUNTER_EVENT_COUNT];
+};
+
+/* Returns the name of `event`, as `perf` spells it. */
+const char *
+counters_name(const enum counter_event event);
+
+/*
+ * Opens the counters of the process `pid`, or of the caller if 0. The counters
+ * of another process start counting when it calls `exec`, and those of the
+ * caller on `counters_start`. If `is_sampled`, the counters also overflow
+ * every so many events to be sampled by `counters_sample`. Returns the amount
+ * of events that could be opened.
+ */
+size_t
+counters_open(struct counters *counters, const pid_t pid,
+	      const bool is_sampled);
+
+/*
+ * Samples the instruction at `*position` every time a counter of the caller,
+ * opened with `is_sampled`, overflows, until `counters_close`. `len` is the
+ * amount of instructions of the program. Returns 0 on success, or an errno
+ * value.
+ */
+int
+counters_sample(struct counters *counters, volatile size_t *position,
+		const size_t len);
+
+/* Resets and starts the counters of the caller. */
+void
+counters_start(struct counters *counters);
+
+/* Stops the counters of the caller, and reads them. */
+void
+counters_stop(struct counters *counters);
+
+/* Reads the counters into `values`. */
+void
+counters_read(struct counters *counters);
+
+/* Closes the counters, and frees their samples. */
+void
+counters_close(struct counters *counters);
+
+/*
+ * Prints the counts to `out`, one event per line, with the ratios that tell a
+ * branch-bound run from a memory-bound one.
+ */
+void
+counters_print(FILE *out, const struct counters *counters);
+
+#endif // MATTERSPLATTER_COUNTERS_H
@@ -0,0 +1,191 @@
+/*
+ * Mattersplatter - a compiler & interpreter for the Brainf*ck language.
+ * Copyright (C) 2021 Maxwell R. Haley <maxwell.r.haley@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <mattersplatter.h>
+
+#include "engine.h"
+
+/*
+ * Cost of compiling a program with NASM and LD: starting both, and assembling
+ * each instruction.
+ */
+#define COMPILE_NS 230000000
+#define COMPILE_NS_PER_INSTRUCTION 60000
+
+/*
+ * How much faster native code is assumed to run than the bytecode before it
+ * ran once, in halves: each level of loops nested in the optimized program
+ * adds a half, up to MAX_SPEEDUP.
+ */
+#define BASE_SPEEDUP 2
+#define MAX_SPEEDUP 8
+
+const char *
+engine_name(const enum engine engine)
+{
+	switch (engine) {
+		case ENGINE_BYTECODE:
+			return "bytecode";
+		case ENGINE_NATIVE:
+			return "native";
+		case ENGINE_AUTO:
+		default:
+			return "auto";
+	}
+}
+
+struct engine_features
+engine_measure(const struct matsplat_program *program)
+{
+	struct engine_features features = { .instructions = program->len };
+	size_t depth = 0;
+
+	for (size_t i = 0; i < program->len; i++) {
+		const struct matsplat_instruction in = program->code[i];
+
+		switch (in.op) {
+			case OP_JUMP_ZERO:
+				features.loops++;
+				if (++depth > features.depth) {
+					features.depth = depth;
+				}
+				break;
+			case OP_JUMP_NOT_ZERO:
+				depth--;
+				break;
+			case OP_SET:
+				/* Clear and multiply loops end clearing. */
+				features.idioms += in.offset == 0;
+				break;
+			case OP_SCAN:
+			case OP_SWEEP:
+				features.idioms++;
+				break;
+			default:
+				break;
+		}
+	}
+
+	return features;
+}
+
+uint64_t
+engine_compile_ns(const struct engine_features *features)
+{
+	return COMPILE_NS
+		+ (uint64_t) features->instructions * COMPILE_NS_PER_INSTRUCTION;
+}
+
+enum engine
+engine_choose(const struct engine_features *features,
+	      const struct engine_history *history, const bool is_compiled)
+{
+	const uint64_t compile_ns = is_compiled ? 0
+		: engine_compile_ns(features);
+
+	/*
+	 * Programs whose loops were all replaced by idioms end before an
+	 * executable could even start, and the interpreter is the only engine
+	 * that can tell how long a program runs without compiling it first,
+	 * or that runs programs which failed to compile.
+	 */
+	if (features->loops == 0 || history->bytecode_ns == 0
+	    || history->native_ns == ENGINE_NOT_BUILT) {
+		return ENGINE_BYTECODE;
+	}
+
+	if (history->native_ns != 0) {
+		return compile_ns + history->native_ns < history->bytecode_ns
+			? ENGINE_NATIVE : ENGINE_BYTECODE;
+	}
+
+	uint64_t speedup = BASE_SPEEDUP + features->depth;
+	if (speedup > MAX_SPEEDUP) {
+		speedup = MAX_SPEEDUP;
+	}
+	const uint64_t native_ns = history->bytecode_ns * BASE_SPEEDUP
+		/ speedup;
+	return compile_ns + native_ns < history->bytecode_ns
+		? ENGINE_NATIVE : ENGINE_BYTECODE;
+}
+
+int
+engine_history_load(const uint64_t key, struct engine_history *history)
+{
+	char path[PATH_MAX];
+
+	*history = (struct engine_history) { .key = key };
+	int err = matsplat_cache_path(path, PATH_MAX, key, "engine");
+	if (err != 0) {
+		return err;
+	}
+
+	FILE *f = fopen(path, "r");
+	if (f == NULL) {
+		return errno == ENOENT ? 0 : errno;
+	}
+
+	/* Histories that cannot be read are started over. */
+	if (fscanf(f, "bytecode %" SCNu64 " native %" SCNu64,
+		   &history->bytecode_ns, &history->native_ns) != 2) {
+		history->bytecode_ns = 0;
+		history->native_ns = 0;
+	}
+	fclose(f);
+	return 0;
+}
+
+int
+engine_history_save(const struct engine_history *history)
+{
+	char path[PATH_MAX];
+	char tmp_path[PATH_MAX];
+
+	int err = matsplat_cache_path(path, PATH_MAX, history->key, "engine");
+	if (err != 0) {
+		return err;
+	}
+
+	/* Concurrent runs replace the history whole, like cached artifacts. */
+	int written = snprintf(tmp_path, PATH_MAX, "%s.%ld.tmp", path,
+			       (long) getpid());
+	if (written < 0 || written >= PATH_MAX) {
+		return ENAMETOOLONG;
+	}
+
+	FILE *f = fopen(tmp_path, "w");
+	if (f == NULL) {
+		return errno;
+	}
+	fprintf(f, "bytecode %" PRIu64 "\nnative %" PRIu64 "\n",
+		history->bytecode_ns, history->native_ns);
+	if (fclose(f) != 0 || rename(tmp_path, path) == -1) {
+		err = errno;
+		unlink(tmp_path);
+		return err;
+	}
+
+	return 0;
+}
@@ -0,0 +1,93 @@
+/*
+ * Mattersplatter - a compiler & interpreter for the Brainf*ck language.
+ * Copyright (C) 2021 Maxwell R. Haley <maxwell.r.haley@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef MATTERSPLATTER_ENGINE_H
+#define MATTERSPLATTER_ENGINE_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <mattersplatter.h>
+
+/* The native time of programs that could not be compiled. */
+#define ENGINE_NOT_BUILT UINT64_MAX
+
+/* The engines programs run on in batch mode. */
+enum engine {
+ENGINE_AUTO,
+ENGINE_BYTECODE,
+ENGINE_NATIVE,
+};
+
+/*
+ * Static features of an optimized program. `loops` counts the loops left after
+ * optimization, `idioms` the loops replaced by SET, SCAN and SWEEP
+ * instructions, and `depth` is how deep the loops left are nested.
+ */
+struct engine_features {
+	size_t instructions;
+	size_t loops;
+	size_t idioms;
+	size_t depth;
+};
+
+/*
+ * The last observed execution times of a program, in nanoseconds, on the
+ * bytecode interpreter and as a native executable. Engines that never ran the
+ * program have a time of 0, and programs that could not be compiled a native
+ * time of ENGINE_NOT_BUILT.
+ */
+struct engine_history {
+	uint64_t key;
+	uint64_t bytecode_ns;
+	uint64_t native_ns;
+};
+
+/* Returns the name of `engine`, as given to --engine. */
+const char *
+engine_name(const enum engine engine);
+
+/* Measures the static features of `program`. */
+struct engine_features
+engine_measure(const struct matsplat_program *program);
+
+/* Returns the estimated time to compile a program to a native executable. */
+uint64_t
+engine_compile_ns(const struct engine_features *features);
+
+/*
+ * Returns the engine expected to run a program in the least time, counting
+ * the time to compile it unless `is_compiled` is set because its executable is
+ * cached already. Programs are first interpreted, and only compiled once their
+ * interpreted run time shows compiling them could pay off.
+ */
+enum engine
+engine_choose(const struct engine_features *features,
+	      const struct engine_history *history, const bool is_compiled);
+
+/*
+ * Loads the history of the program cached under `key`. A program without a
+ * history gets an empty one. Returns 0 on success, or an errno value.
+ */
+int
+engine_history_load(const uint64_t key, struct engine_history *history);
+
+/* Stores `history` in the cache. Returns 0 on success, or an errno value. */
+int
+engine_history_save(const struct engine_history *history);
+
+#endif // MATTERSPLATTER_ENGINE_H
@@ -78,10 +78,88 @@ struct matsplat_node {
 	struct matsplat_src_token *token;
 };
 
+/*
+ * Each value represents an operation of the Mattersplatter bytecode. Unlike
+ * tokens, operations carry operands: runs of the same token are folded into a
+ * single operation, and common loops are replaced by the operation they
+ * compute. Offsets are relative to the pointer, and wrap around the tape like
+ * pointer movement does. A JUMP_ZERO with a non-zero `arg` starts a counted
+ * loop, which runs the current cell times `arg` times, modulo 256.
+ */
+enum matsplat_op {
+OP_ADD,			/* Add `arg` to the cell at `offset`. */
+OP_MOVE,		/* Move the pointer by `arg` cells. */
+OP_SET,			/* Set the cell at `offset` to `arg`. */
+OP_MUL,			/* Add the current cell times `arg` to the cell at `offset`. */
+OP_OUTPUT,		/* Output the cell at `offset`. */
+OP_INPUT,		/* Read into the cell at `offset`. */
+OP_JUMP_ZERO,		/* Jump to `jump` if the current cell is zero. */
+OP_JUMP_NOT_ZERO,	/* Jump to `jump` if the current cell is not zero. */
+OP_END,			/* Stop execution. */
+OP_SCAN,		/* Move the pointer by `arg` cells until the cell is zero. */
+OP_SWEEP,		/* Loop of the ADDs up to `jump`, moving by `arg`. */
+OP_COUNT
+};
+
+/*
+ * Flags of an instruction, set by `matsplat_program_create` where it can prove
+ * them from the movements of the pointer alone.
+ */
+enum matsplat_instruction_flags {
+MATSPLAT_IN_BOUNDS = 1 << 0,	/* Its cell, or pointer move, never wraps. */
+};
+
+/*
+ * A single bytecode instruction. The layout is fixed, as programs are saved to
+ * and executed from disk as arrays of instructions.
+ */
+struct matsplat_instruction {
+	uint8_t op;
+	uint8_t flags;
+	uint8_t reserved[2];
+	int32_t offset;
+	int32_t arg;
+	uint32_t jump;
+};
+
+/*
+ * The position of the source token an instruction was generated from, using
+ * the same `column` and `row` as `matsplat_src_token`.
+ */
+struct matsplat_source_position {
+	uint32_t column;
+	uint32_t row;
+};
+
+/*
+ * An optimized program, ready to be executed by `matsplat_program_execute`.
+ * Contains the array of instructions, the lenght of said array, the source
+ * position of each instruction, and the amount of cells the program was
+ * optimized for. If `error_code` is non-zero, the program could not be
+ * created. The program should be destroyed by `matsplat_program_destroy`.
+ */
+struct matsplat_program {
+	size_t len;
+	size_t cell_count;
+	const struct matsplat_instruction *code;
+	const struct matsplat_source_position *positions;
+	/*
+	 * The cells accessed by instructions flagged `MATSPLAT_IN_BOUNDS` all
+	 * lie below this one. Kernels are created for a tape of unknown size,
+	 * so their flags only hold for tapes of at least this many cells.
+	 */
+	size_t bounded_cells;
+	/* Set if `code` points into a file mapped by `matsplat_program_load`. */
+	void *mapping;
+	size_t mapping_len;
+	int error_code;
+};
+
 /*
  * The result of the execution process. Contains the final location of the
  * pointer, the count of cells used in execution, and resulting memory cells
- * array.
+ * array. If the cells could not be allocated, nothing was executed and
+ * `memory_cells` is NULL.
  */
 struct matsplat_execution_result {
 	size_t pointer;
@@ -89,6 +167,146 @@ struct matsplat_execution_result {
 	int8_t *memory_cells;
 };
 
+/*
+ * The execution counts of a loop, as recorded by a profiling run. `entries`
+ * counts how many times the loop was reached, and `iterations` how many times
+ * its body ran. Loops are identified by the position of their `[`.
+ */
+struct matsplat_loop_count {
+	struct matsplat_source_position position;
+	uint64_t entries;
+	uint64_t iterations;
+};
+
+/*
+ * The loop counts of a program, sorted by position. If `error_code` is
+ * non-zero, the profile could not be created. The profile should be destroyed
+ * by `matsplat_profile_destroy`.
+ */
+struct matsplat_profile {
+	size_t len;
+	struct matsplat_loop_count *loops;
+	int error_code;
+};
+
+/*
+ * The amount of cells a program compiled into a kernel must be created for.
+ * Kernels are handed their tape at run time, so their code must not assume any
+ * tape size.
+ */
+#define MATSPLAT_KERNEL_CELL_COUNT ((size_t) INT64_MAX)
+
+/* The kind of entry point generated by the compiler. */
+enum matsplat_entry_point {
+MATSPLAT_ENTRY_START,	/* A standalone program, entered at `_start`. */
+MATSPLAT_ENTRY_KERNEL,	/* A `bf_run` function, see `matsplat_kernel`. */
+};
+
+/* The language of the code generated by the compiler. */
+enum matsplat_target {
+MATSPLAT_TARGET_NASM,	/* x86_64 assembly, for `nasm -felf64`. */
+MATSPLAT_TARGET_C,	/* C11 with POSIX I/O, for the system C compiler. */
+};
+
+/*
+ * Options of the compilation process. `cell_count` is the size of the tape of
+ * a standalone program. It is ignored for kernels, which are handed their tape
+ * by the caller. If `profile` is not NULL, its loop counts guide the layout
+ * and unrolling of loops. If `profile_path` is not NULL, the program counts
+ * the entries and iterations of its loops, and saves them to `profile_path`
+ * when it ends, for `matsplat_profile_load`. Only standalone NASM programs can
+ * be instrumented this way. C programs leave layout and unrolling to the C
+ * compiler, and ignore `profile`.
+ */
+struct matsplat_compile_options {
+	size_t cell_count;
+	enum matsplat_entry_point entry_point;
+	const struct matsplat_profile *profile;
+	const char *profile_path;
+	enum matsplat_target target;
+};
+
+/*
+ * I/O callbacks of a compiled kernel or an executed program. `read` returns the
+ * next input byte, or a negative value on EOF (leaving the cell untouched).
+ * `write` outputs a single byte, and returns a negative value on failure,
+ * which stops the program. Both are passed `ctx` as is.
+ */
+struct matsplat_io_callbacks {
+	int (*read)(void *ctx);
+	int (*write)(int c, void *ctx);
+	void *ctx;
+};
+
+/*
+ * Signature of the `bf_run` function exported by programs compiled with
+ * `MATSPLAT_ENTRY_KERNEL`. Runs the program on the `n` cells of `tape`, with
+ * the pointer starting at the first cell. Returns 0 once the program ends, or
+ * -1 if `n` is 0 or a write failed.
+ */
+typedef int (*matsplat_kernel)(uint8_t *tape, size_t n,
+			       struct matsplat_io_callbacks *io);
+
+/*
+ * Totals of an execution: the amount of instructions executed, and of bytes
+ * read and written. Memoized loops are looked up `memo_lookups` times, and
+ * skipped `memo_hits` times.
+ */
+struct matsplat_execution_stats {
+	uint64_t steps;
+	uint64_t bytes_read;
+	uint64_t bytes_written;
+	uint64_t memo_lookups;
+	uint64_t memo_hits;
+};
+
+/*
+ * Input of an executed program, served from memory: `,` reads the `len` bytes
+ * at `data` in order. Set `mapping` if `data` points into a file mapped by
+ * `matsplat_input_map`.
+ */
+struct matsplat_input {
+	const uint8_t *data;
+	size_t len;
+	void *mapping;
+	size_t mapping_len;
+};
+
+/* What `,` leaves in the current cell once the input has ended. */
+enum matsplat_eof {
+MATSPLAT_EOF_UNCHANGED,
+MATSPLAT_EOF_ZERO,
+MATSPLAT_EOF_MINUS_ONE,
+};
+
+/*
+ * Options of the execution of a program. If `io` is NULL, the program reads
+ * from stdin and writes to stdout. If `input` is not NULL, it is read from
+ * instead of `io`, and `eof` decides what reading past the end of either
+ * does. If `profile` is not NULL, it points to one counter per instruction,
+ * incremented every time the instruction executes.
+ * If `position` is not NULL along with `profile`, the index of every
+ * instruction is stored there before it executes, for signal handlers to
+ * sample. If `stats` is not NULL, it is filled in once the program ends.
+ * If `memo_entries` is not 0 and `profile` is NULL, the outcomes of loops
+ * that nest loops without I/O are memoized in a table of `memo_entries`
+ * entries, rounded down to a power of 2.
+ * If `is_cancelled` is not NULL, it is called with `cancel_ctx` as the program
+ * loops, every 65536 iterations or so, and the program stops as if it ended
+ * once it returns true.
+ */
+struct matsplat_execute_options {
+	struct matsplat_io_callbacks *io;
+	uint64_t *profile;
+	volatile size_t *position;
+	struct matsplat_execution_stats *stats;
+	size_t memo_entries;
+	const struct matsplat_input *input;
+	enum matsplat_eof eof;
+	bool (*is_cancelled)(void *ctx);
+	void *cancel_ctx;
+};
+
 /*
  * The result of the compilation process. Contains the ASM source code, it's
  * length, and a potential error code.
@@ -99,6 +317,29 @@ struct matsplat_compilation_result {
 	int error_code;
 };
 
+/*
+ * A stretch of top-level code compiled to assembly of its own, exporting the
+ * function `s_<key>` with `key` in 16 hexadecimal digits. The key is a hash of
+ * the bytecode of the segment, the amount of cells and the version of
+ * Mattersplatter, so segments with the same key assemble to the same object.
+ */
+struct matsplat_segment {
+	uint64_t key;
+	struct matsplat_compilation_result code;
+};
+
+/*
+ * The result of compiling a program in segments. `main` holds the entry point
+ * and subroutines, and calls the segments in turn. `segments` holds every
+ * distinct segment once, sorted by key.
+ */
+struct matsplat_segmented_compilation_result {
+	struct matsplat_compilation_result main;
+	struct matsplat_segment *segments;
+	size_t len;
+	int error_code;
+};
+
 /*
  * Tokenizes Brainf*ck source code. Takes in the Brainf*ck source code as a
  * buffer, and the lenght of the source code. Returns a
@@ -121,8 +362,8 @@ struct matsplat_node *
 matsplat_ast_create(struct matsplat_src_token *tokens, size_t len);
 
 /*
- * Frees any memory used up by the all nodes that are decendants of the passed
- * in node (typically the root node).
+ * Frees any memory used up by the all nodes of the tree whose root node is
+ * passed in, as returned by `matsplat_ast_create`.
  */
 void
 matsplat_ast_destroy(struct matsplat_node *root);
@@ -143,6 +384,117 @@ matsplat_execute(struct matsplat_node *start, size_t cell_count);
 void
 matsplat_execution_result_destory(struct matsplat_execution_result result);
 
+/*
+ * Takes in the root node of an AST & the requested amount of cells. Converts
+ * the AST to optimized bytecode, and flags the instructions that provably do
+ * not wrap around the tape. Returns a program that should be destroyed by
+ * `matsplat_program_destroy` to free up heap space.
+ */
+struct matsplat_program
+matsplat_program_create(struct matsplat_node *ast, size_t cell_count);
+
+/* Frees (or unmaps) the instructions of a program. */
+void
+matsplat_program_destroy(struct matsplat_program program);
+
+/*
+ * Saves a program to `path` in the versioned `.bfc` format. Returns 0 on
+ * success, EINVAL if the program could not be loaded back, or another errno
+ * value on failure.
+ */
+int
+matsplat_program_save(const struct matsplat_program *program,
+		      const char *path);
+
+/*
+ * Maps a program saved by `matsplat_program_save` into memory. The
+ * instructions are executed directly from the mapping. Returns 0 on success,
+ * ENOEXEC if `path` is not a program at all, EINVAL if it is a corrupt
+ * program, ENOTSUP if it was saved in another version of the format, or
+ * another errno value on failure.
+ */
+int
+matsplat_program_load(const char *path, struct matsplat_program *program);
+
+/*
+ * Writes a standalone executable to `path`: a copy of the runtime executable
+ * at `runtime`, followed by `program` and a trailer that locates it. Returns 0
+ * on success, or an errno value on failure, like `matsplat_program_save`.
+ */
+int
+matsplat_program_bundle(const struct matsplat_program *program,
+			const char *runtime, const char *path);
+
+/*
+ * Maps the program bundled into the executable at `path` by
+ * `matsplat_program_bundle`, with a single `mmap` of the program. Returns the
+ * same values as `matsplat_program_load`, with ENOEXEC if `path` holds no
+ * bundled program.
+ */
+int
+matsplat_program_load_bundle(const char *path,
+			     struct matsplat_program *program);
+
+/*
+ * Executes a program, reading from stdin and writing to stdout. Returns the
+ * same result structure as `matsplat_execute`.
+ */
+struct matsplat_execution_result
+matsplat_program_execute(const struct matsplat_program *program);
+
+/*
+ * Same as `matsplat_program_execute`, but with control over the execution
+ * through `options`.
+ */
+struct matsplat_execution_result
+matsplat_program_execute_with_options(const struct matsplat_program *program,
+				      const struct matsplat_execute_options
+				      *options);
+
+/*
+ * Maps the file at `path` into memory as the input of an execution, to be read
+ * in place. Returns 0 on success, or an errno value on failure.
+ */
+int
+matsplat_input_map(const char *path, struct matsplat_input *input);
+
+/* Unmaps the file of an input mapped by `matsplat_input_map`. */
+void
+matsplat_input_unmap(struct matsplat_input input);
+
+/*
+ * Collects the loop counts of `program` from the per instruction `counts` of a
+ * profiled execution.
+ */
+struct matsplat_profile
+matsplat_profile_create(const struct matsplat_program *program,
+			const uint64_t *counts);
+
+/* Frees the loop counts of a profile. */
+void
+matsplat_profile_destroy(struct matsplat_profile profile);
+
+/* Returns the counts of the loop at `position`, or NULL if there are none. */
+const struct matsplat_loop_count *
+matsplat_profile_find(const struct matsplat_profile *profile,
+		      const struct matsplat_source_position position);
+
+/*
+ * Saves a profile to `path` as text. Returns 0 on success, or an errno value
+ * on failure.
+ */
+int
+matsplat_profile_save(const struct matsplat_profile *profile,
+		      const char *path);
+
+/*
+ * Loads a profile saved by `matsplat_profile_save`. Returns 0 on success,
+ * EINVAL if `path` is not a valid profile, ENOTSUP if it was saved in another
+ * version of the format, or another errno value on failure.
+ */
+int
+matsplat_profile_load(const char *path, struct matsplat_profile *profile);
+
 /*
  * Takes in a starting node & the reqeusted amount of cells. Coverts the AST to
  * assembly source code. Returns a result strucutre that contains the source
@@ -151,11 +503,82 @@ matsplat_execution_result_destory(struct matsplat_execution_result result);
 struct matsplat_compilation_result
 matsplat_compile(struct matsplat_node *ast, size_t cell_count);
 
+/*
+ * Same as `matsplat_compile`, but with control over the generated code through
+ * `options`.
+ */
+struct matsplat_compilation_result
+matsplat_compile_with_options(struct matsplat_node *ast,
+			      const struct matsplat_compile_options *options);
+
+/*
+ * Same as `matsplat_compile_with_options`, but generates the code from an
+ * already optimized `program`. Programs compiled into kernels must have been
+ * created for `MATSPLAT_KERNEL_CELL_COUNT` cells, and standalone programs for
+ * the `cell_count` of `options`.
+ */
+struct matsplat_compilation_result
+matsplat_program_compile(const struct matsplat_program *program,
+			 const struct matsplat_compile_options *options);
+
 /* Free's up memory used by the compilation result struct. */
 void
 matsplat_compilation_result_destroy(struct matsplat_compilation_result result);
 
+/*
+ * Same as `matsplat_program_compile`, but splits the program into segments
+ * assembled apart, so a build can reuse the objects of the segments an edit
+ * did not change. Only standalone NASM programs without a profile can be
+ * segmented; anything else fails with EINVAL.
+ */
+struct matsplat_segmented_compilation_result
+matsplat_program_compile_segments(
+	const struct matsplat_program *program,
+	const struct matsplat_compile_options *options);
+
+/* Frees the memory used by a segmented compilation result. */
+void
+matsplat_segmented_compilation_result_destroy(
+	struct matsplat_segmented_compilation_result result);
+
 struct matsplat_token_human_readable
 matsplat_token_to_human_readable(const enum matsplat_token type);
 
+/*
+ * Computes the cache key of a program. The key is a hash of the source code,
+ * the requested amount of cells, and the version of Mattersplatter along with
+ * the revisions of its generated code and bytecode, so a change to any of them
+ * results in a different key.
+ */
+uint64_t
+matsplat_cache_key(const char *src_code, const size_t len,
+		   const size_t cell_count);
+
+/*
+ * Writes the path of the cached artifact of type `kind` (used as the file
+ * extension, e.g. "bin") for `key` into `path`. The cache lives in
+ * `$XDG_CACHE_HOME/mattersplatter`, or `$HOME/.cache/mattersplatter` when
+ * `XDG_CACHE_HOME` is unset, and is created if it does not exist. Returns 0 on
+ * success, or an errno value on failure.
+ */
+int
+matsplat_cache_path(char *path, const size_t path_len, const uint64_t key,
+		    const char *kind);
+
+/*
+ * Copies the cached artifact of type `kind` for `key` to `dest_path`. Returns
+ * 0 on a cache hit, ENOENT on a cache miss, or another errno value on failure.
+ */
+int
+matsplat_cache_fetch(const uint64_t key, const char *kind,
+		     const char *dest_path);
+
+/*
+ * Stores a copy of the file at `src_path` in the cache as the artifact of type
+ * `kind` for `key`. Returns 0 on success, or an errno value on failure.
+ */
+int
+matsplat_cache_store(const uint64_t key, const char *kind,
+		     const char *src_path);
+
 #endif // MATTERSPLATTER_H
@@ -0,0 +1,32 @@
+/*
+ * Mattersplatter - a compiler & interpreter for the Brainf*ck language.
+ * Copyright (C) 2021 Maxwell R. Haley <maxwell.r.haley@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef MATTERSPLATTER_REVISION_H
+#define MATTERSPLATTER_REVISION_H
+
+/* Version of the `.bfc` format, bumped with every change to its layout. */
+#define BYTECODE_VERSION 6
+
+/*
+ * Revision of the code generated from a program, bumped with every change to
+ * the optimizer or a backend that changes its output. Cache keys hash it along
+ * with BYTECODE_VERSION, so artifacts built by an older library are not served
+ * from the cache once the code that built them changed.
+ */
+#define CODEGEN_REVISION 1
+
+#endif // MATTERSPLATTER_REVISION_H
@@ -0,0 +1,35 @@
+/*
+ * Mattersplatter - a compiler & interpreter for the Brainf*ck language.
+ * Copyright (C) 2021 Maxwell R. Haley <maxwell.r.haley@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef MATTERSPLATTER_TRANSLATOR_H
+#define MATTERSPLATTER_TRANSLATOR_H
+#include <stdint.h>
+
+#include "mattersplatter.h"
+
+/*
+ * Translates `program` to C, for `matsplat_program_compile` with
+ * `MATSPLAT_TARGET_C`. `reach` is the largest distance between the pointer and
+ * a cell the program accesses: kernels handed a tape no larger than this run
+ * a copy of the program that wraps offsets any number of times.
+ */
+struct matsplat_compilation_result
+translate_program(const struct matsplat_program *program,
+		  const struct matsplat_compile_options *options,
+		  const uint64_t reach);
+
+#endif // MATTERSPLATTER_TRANSLATOR_H
@@ -0,0 +1,1522 @@
+/*
+ * Mattersplatter - a compiler & interpreter for the Brainf*ck language.
+ * Copyright (C) 2021 Maxwell R. Haley
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mattersplatter.h"
+#include "revision.h"
+
+#define BYTECODE_MAGIC "MSBC"
+
+/*
+ * The largest tape of a saved program. Larger counts are taken for a corrupt
+ * header, rather than handed to an allocation that could never succeed.
+ */
+#define MAX_CELL_COUNT (1ULL << 32)
+
+#define BUNDLE_MAGIC "MSBUNDLE"
+#define BUNDLE_ALIGN 65536
+
+/*
+ * The widest stretch of tape, in cells, whose stores are checked for being
+ * overwritten before they are read.
+ */
+#define DEAD_STORE_MAX_SPAN 65536
+
+/*
+ * Header of a serialized program. It is followed directly by `len`
+ * instructions, so the instructions of a mapped file can be executed in place,
+ * and then by the `len` source positions of the instructions. All fields are
+ * stored in host byte order.
+ */
+struct bytecode_header {
+	char magic[4];
+	uint32_t version;
+	uint64_t cell_count;
+	uint64_t len;
+};
+
+/*
+ * Trailer of a bundle, which ends with it. The serialized program starts
+ * `offset` bytes into the bundle, aligned to `BUNDLE_ALIGN` bytes for it to be
+ * mapped on any page size, and is `len` bytes long.
+ */
+struct bundle_trailer {
+	uint64_t offset;
+	uint64_t len;
+	char magic[8];
+};
+
+/*
+ * A growable array of instructions, and of their source positions. Emitted
+ * instructions are attributed to `position`.
+ */
+struct code_buffer {
+	struct matsplat_instruction *code;
+	struct matsplat_source_position *positions;
+	size_t len;
+	size_t cap;
+	struct matsplat_source_position position;
+	int error_code;
+};
+
+/* A pending addition to the cell at `offset` from the pointer. */
+struct pending_add {
+	int32_t offset;
+	int32_t delta;
+};
+
+/*
+ * A slot of the index of pending additions by offset. It refers to
+ * `adds[index]` only while its generation is that of the run.
+ */
+struct pending_slot {
+	size_t generation;
+	size_t index;
+};
+
+/*
+ * Straight-line `+-<>` code is not emitted as soon as it is read. Instead, the
+ * additions are collected relative to where the pointer was at the start of
+ * the run, and the pointer movement is summed up in `position`. The run is
+ * flushed as one ADD per touched cell followed by a single MOVE.
+ */
+struct pending_run {
+	struct pending_add *adds;
+	size_t len;
+	size_t cap;
+	/*
+	 * Open addressed index of `adds`, with twice `cap` slots. Flushing the
+	 * run starts a new generation, which empties every slot at once.
+	 */
+	struct pending_slot *slots;
+	size_t generation;
+	int64_t position;
+	/* Source position of the first token of the run. */
+	struct matsplat_source_position start;
+};
+
+struct builder {
+	struct code_buffer out;
+	struct pending_run run;
+	/* Source position of the token being translated. */
+	struct matsplat_source_position token;
+	size_t cell_count;
+	/* Largest offset that can be addressed without wrapping twice. */
+	int64_t reach;
+};
+
+static void
+emit(struct code_buffer *out, const enum matsplat_op op, const int32_t offset,
+     const int32_t arg)
+{
+	if (out->error_code != 0) {
+		return;
+	}
+
+	if (out->len == out->cap) {
+		size_t cap = out->cap == 0 ? 64 : out->cap * 2;
+		struct matsplat_instruction *code =
+			realloc(out->code, cap * sizeof(*code));
+		if (code == NULL) {
+			out->error_code = errno;
+			return;
+		}
+		out->code = code;
+
+		struct matsplat_source_position *positions =
+			realloc(out->positions, cap * sizeof(*positions));
+		if (positions == NULL) {
+			out->error_code = errno;
+			return;
+		}
+		out->positions = positions;
+		out->cap = cap;
+	}
+
+	out->code[out->len] = (struct matsplat_instruction) {
+		.op = op, .offset = offset, .arg = arg, .jump = 0
+	};
+	out->positions[out->len] = out->position;
+	out->len++;
+}
+
+/*
+ * Returns the slot of the pending addition to the cell at `offset`, or the
+ * empty slot it would take.
+ */
+static struct pending_slot *
+pending_slot(const struct pending_run *run, const int32_t offset)
+{
+	const size_t mask = run->cap * 2 - 1;
+	size_t i = ((uint32_t) offset * UINT32_C(2654435761)) & mask;
+
+	while (run->slots[i].generation == run->generation
+	       && run->adds[run->slots[i].index].offset != offset) {
+		i = (i + 1) & mask;
+	}
+
+	return &run->slots[i];
+}
+
+/* Doubles the room for pending additions. Returns 0, or an errno value. */
+static int
+grow_run(struct pending_run *run)
+{
+	size_t cap = run->cap == 0 ? 16 : run->cap * 2;
+	struct pending_add *adds = realloc(run->adds, cap * sizeof(*adds));
+	if (adds == NULL) {
+		return errno;
+	}
+	run->adds = adds;
+
+	struct pending_slot *slots = calloc(cap * 2, sizeof(*slots));
+	if (slots == NULL) {
+		return errno;
+	}
+	free(run->slots);
+	run->slots = slots;
+	run->cap = cap;
+
+	/* Slots start out empty in generation 0, so runs count from 1. */
+	run->generation = 1;
+	for (size_t i = 0; i < run->len; i++) {
+		*pending_slot(run, run->adds[i].offset) =
+			(struct pending_slot) { .generation = 1, .index = i };
+	}
+
+	return 0;
+}
+
+static void
+pending_add(struct builder *b, const int32_t delta)
+{
+	struct pending_run *run = &b->run;
+
+	if (run->len == 0 && run->position == 0) {
+		run->start = b->token;
+	}
+
+	if (run->len > 0) {
+		struct pending_slot *slot =
+			pending_slot(run, (int32_t) run->position);
+		if (slot->generation == run->generation) {
+			struct pending_add *add = &run->adds[slot->index];
+			add->delta = (add->delta + delta) & 0xff;
+			return;
+		}
+	}
+
+	if (run->len == run->cap) {
+		int err = grow_run(run);
+		if (err != 0) {
+			b->out.error_code = err;
+			return;
+		}
+	}
+
+	*pending_slot(run, (int32_t) run->position) = (struct pending_slot) {
+		.generation = run->generation, .index = run->len
+	};
+	run->adds[run->len] = (struct pending_add) {
+		.offset = (int32_t) run->position, .delta = delta & 0xff
+	};
+	run->len++;
+}
+
+/* Emits the pending additions, leaving the pointer movement pending. */
+static void
+flush_adds(struct builder *b)
+{
+	b->out.position = b->run.start;
+	for (size_t i = 0; i < b->run.len; i++) {
+		if (b->run.adds[i].delta != 0) {
+			emit(&b->out, OP_ADD, b->run.adds[i].offset,
+			     (int8_t) b->run.adds[i].delta);
+		}
+	}
+
+	b->run.len = 0;
+	b->run.generation++;
+}
+
+/* Emits the whole pending run, leaving the pointer where the source has it. */
+static void
+flush_run(struct builder *b)
+{
+	flush_adds(b);
+
+	int64_t move = b->run.position % (int64_t) b->cell_count;
+	b->out.position = b->run.start;
+	if (move != 0) {
+		emit(&b->out, OP_MOVE, 0, (int32_t) move);
+	}
+
+	b->run.position = 0;
+}
+
+static void
+pending_move(struct builder *b, const int64_t delta)
+{
+	/*
+	 * Offsets must stay within one tape length of the pointer, so they can
+	 * be wrapped with a single comparison at run time.
+	 */
+	if (b->run.position + delta > b->reach
+	    || b->run.position + delta < -b->reach) {
+		flush_run(b);
+	}
+
+	if (b->run.len == 0 && b->run.position == 0) {
+		b->run.start = b->token;
+	}
+
+	/* Moving by a whole tape goes nowhere, as on a tape of one cell. */
+	b->run.position = (b->run.position + delta) % (int64_t) b->cell_count;
+}
+
+/*
+ * Returns the number of iterations per unit in its cell that a loop adding the
+ * odd `step` to its cell runs: the number that `step` times is -1 modulo 256.
+ */
+static uint8_t
+step_factor(const int64_t step)
+{
+	uint8_t factor = 1;
+
+	while ((uint8_t) (step * factor) != UINT8_MAX) {
+		factor += 2;
+	}
+
+	return factor;
+}
+
+/* A cell written by a loop being rewritten, and what an iteration leaves. */
+struct closed_cell {
+	int64_t offset;
+	bool is_set;
+	/* The value the cell is set to, or what is added to it. */
+	uint8_t value;
+};
+
+/*
+ * Attempts to turn the loop starting at `start` into a sweep: a loop that adds
+ * constants around the pointer, then moves by a fixed stride. Its iterations
+ * only depend on each other through the cells they test, so it can run many
+ * at once, unless an iteration adds to a cell a later one tests. Returns true
+ * if the loop was turned into a sweep.
+ */
+static bool
+rewrite_sweep(struct builder *b, const size_t start)
+{
+	struct code_buffer *out = &b->out;
+	const size_t body = start + 1;
+
+	if (out->len - body < 2 || out->code[out->len - 1].op != OP_MOVE) {
+		return false;
+	}
+
+	const int32_t stride = out->code[out->len - 1].arg;
+	for (size_t i = body; i < out->len - 1; i++) {
+		const int32_t offset = out->code[i].offset;
+		if (out->code[i].op != OP_ADD
+		    || (offset % stride == 0 && offset / stride > 0)) {
+			return false;
+		}
+	}
+
+	out->len--;
+	out->code[start].op = OP_SWEEP;
+	out->code[start].arg = stride;
+	out->code[start].jump = out->len;
+	return true;
+}
+
+/*
+ * Attempts to replace the loop starting at `start`, whose body has just been
+ * emitted, with straight-line code, a scan or a sweep. Returns true if the
+ * loop was replaced.
+ */
+static bool
+rewrite_idiom(struct builder *b, const size_t start)
+{
+	struct code_buffer *out = &b->out;
+	const size_t body = start + 1;
+
+	/* `[>]` and friends: the loop only moves, looking for a zero cell. */
+	if (out->len - body == 1 && out->code[body].op == OP_MOVE) {
+		const int32_t stride = out->code[body].arg;
+		out->len = start;
+		emit(out, OP_SCAN, 0, stride);
+		return true;
+	}
+
+	if (rewrite_sweep(b, start)) {
+		return true;
+	}
+
+	/*
+	 * `[-]`, `[->+>++<<]`, `[->+>[-]<<]` and friends: the loop only adds
+	 * to and sets cells at fixed offsets, and its own cell changes by an
+	 * odd step, so it always reaches zero. It is replaced by what it leaves
+	 * behind. An even step may never reach zero, and such loops are kept,
+	 * as are loops that cannot be rewritten for lack of memory.
+	 */
+	const size_t body_len = out->len - body;
+	struct closed_cell *cells = malloc(body_len * sizeof(*cells));
+	size_t cells_len = 0;
+	int64_t position = 0;
+	int64_t low = 0;
+	int64_t high = 0;
+	int64_t step = 0;
+	bool has_set = false;
+	bool is_closed = cells != NULL;
+
+	for (size_t i = body; is_closed && i < out->len; i++) {
+		const struct matsplat_instruction in = out->code[i];
+		const int64_t offset = position + in.offset;
+
+		if (in.op == OP_MOVE) {
+			position += in.arg;
+			continue;
+		}
+		if ((in.op != OP_ADD && in.op != OP_SET)
+		    || offset > b->reach || offset < -b->reach
+		    || (in.op == OP_SET && offset == 0)) {
+			is_closed = false;
+			break;
+		}
+		if (offset == 0) {
+			step += in.arg;
+			continue;
+		}
+
+		low = offset < low ? offset : low;
+		high = offset > high ? offset : high;
+		size_t c = 0;
+		while (c < cells_len && cells[c].offset != offset) {
+			c++;
+		}
+		if (c == cells_len) {
+			cells[cells_len++] = (struct closed_cell) {
+				.offset = offset
+			};
+		}
+		if (in.op == OP_SET) {
+			cells[c].is_set = true;
+			cells[c].value = in.arg;
+			has_set = true;
+		} else {
+			cells[c].value += in.arg;
+		}
+	}
+
+	/* No two cells may be the same one, wrapped around the tape. */
+	if (!is_closed || position != 0 || step % 2 == 0
+	    || (uint64_t) (high - low) >= b->cell_count) {
+		free(cells);
+		return false;
+	}
+
+	/*
+	 * Cells only added to get a multiple of the loop's cell, while cells
+	 * set keep their last value. Setting a cell only happens if the loop
+	 * runs at all, so loops that set cells become a loop that runs once.
+	 */
+	const uint8_t factor = step_factor(step);
+
+	out->len = has_set ? body : start;
+	for (size_t c = 0; c < cells_len; c++) {
+		if (!cells[c].is_set) {
+			emit(out, OP_MUL, cells[c].offset,
+			     (int8_t) (cells[c].value * factor));
+		}
+	}
+	for (size_t c = 0; c < cells_len; c++) {
+		if (cells[c].is_set) {
+			emit(out, OP_SET, cells[c].offset,
+			     (int8_t) cells[c].value);
+		}
+	}
+	emit(out, OP_SET, 0, 0);
+	free(cells);
+
+	if (has_set) {
+		emit(out, OP_JUMP_NOT_ZERO, 0, 0);
+		if (out->error_code == 0) {
+			out->code[start].jump = out->len;
+			out->code[out->len - 1].jump = start + 1;
+		}
+	}
+
+	return true;
+}
+
+static struct matsplat_source_position
+source_position(const struct matsplat_src_token *token)
+{
+	return (struct matsplat_source_position) {
+		.column = token->column < UINT32_MAX
+			? (uint32_t) token->column : UINT32_MAX,
+		.row = token->row < UINT32_MAX
+			? (uint32_t) token->row : UINT32_MAX
+	};
+}
+
+static void
+build_chain(struct builder *b, struct matsplat_node *node)
+{
+	for (; node != NULL; node = node->right_child) {
+		struct matsplat_source_position loop_position;
+		size_t start;
+
+		b->token = source_position(node->token);
+		switch (node->token->type) {
+			case POINTER_RIGHT:
+				pending_move(b, 1);
+				break;
+			case POINTER_LEFT:
+				pending_move(b, -1);
+				break;
+			case INCREMENT:
+				pending_add(b, 1);
+				break;
+			case DECREMENT:
+				pending_add(b, -1);
+				break;
+			case OUTPUT:
+				flush_adds(b);
+				b->out.position = b->token;
+				emit(&b->out, OP_OUTPUT,
+				     (int32_t) b->run.position, 0);
+				break;
+			case INPUT:
+				flush_adds(b);
+				b->out.position = b->token;
+				emit(&b->out, OP_INPUT,
+				     (int32_t) b->run.position, 0);
+				break;
+			case JUMP_FORWARD:
+				/*
+				 * Both jumps of a loop, and any instruction
+				 * replacing it, are attributed to its `[`.
+				 */
+				loop_position = b->token;
+				flush_run(b);
+				start = b->out.len;
+				b->out.position = loop_position;
+				emit(&b->out, OP_JUMP_ZERO, 0, 0);
+				build_chain(b, node->left_child);
+				flush_run(b);
+
+				b->out.position = loop_position;
+				if (b->out.error_code != 0
+				    || rewrite_idiom(b, start)) {
+					break;
+				}
+
+				emit(&b->out, OP_JUMP_NOT_ZERO, 0, 0);
+				if (b->out.error_code == 0) {
+					b->out.code[start].jump = b->out.len;
+					b->out.code[b->out.len - 1].jump =
+						start + 1;
+				}
+				break;
+			case JUMP_BACKWARDS:
+			case END:
+				/*
+				 * Both end the current chain, just like they
+				 * end `execute()` in the tree interpreter.
+				 */
+				return;
+			case COMMENT:
+			default:
+				break;
+		}
+	}
+}
+
+/* A loop met by `bound_pointer`, and what was known of the pointer at `[`. */
+struct bound_frame {
+	size_t start;
+	/* Sum of the moves of an iteration, counting nested loops as 0. */
+	int64_t move;
+	bool is_balanced;
+	bool is_known;
+	int64_t position;
+};
+
+/*
+ * Follows the pointer of `program` from cell 0, and sets `flags` to
+ * `MATSPLAT_IN_BOUNDS` for the instructions whose cell, or whose move, is
+ * known not to wrap. The pointer is known until the first move that may wrap,
+ * scan, sweep, or loop that does not return the pointer to where it started.
+ * Such balanced loops leave it known, as every iteration ends where the loop
+ * began. Sets `bounded_cells` to one past the highest cell a flagged
+ * instruction reaches. Returns 0 on success, EINVAL if the loops of `program`
+ * do not nest, or another errno value on failure.
+ */
+static int
+bound_pointer(const struct matsplat_program *program, uint8_t *flags,
+	      size_t *bounded_cells)
+{
+	const struct matsplat_instruction *code = program->code;
+	const int64_t cells = (int64_t) program->cell_count;
+	struct bound_frame *frames = calloc(program->len, sizeof(*frames));
+	bool *is_balanced = calloc(program->len, sizeof(*is_balanced));
+	bool is_known = true;
+	int64_t position = 0;
+	size_t depth = 0;
+	int err = 0;
+
+	*bounded_cells = 0;
+	if (frames == NULL || is_balanced == NULL) {
+		err = ENOMEM;
+		goto bound_done;
+	}
+
+	/* Balance is decided by a loop's `]`, but needed at its `[`. */
+	for (size_t i = 0; i < program->len; i++) {
+		const struct matsplat_instruction in = code[i];
+		struct bound_frame *top = depth > 0 ? &frames[depth - 1] : NULL;
+
+		switch (in.op) {
+			case OP_MOVE:
+				if (top != NULL) {
+					top->move += in.arg;
+				}
+				break;
+			case OP_SWEEP:
+				i = in.jump - 1;
+				/* Fallthrough */
+			case OP_SCAN:
+				if (top != NULL) {
+					top->is_balanced = false;
+				}
+				break;
+			case OP_JUMP_ZERO:
+				frames[depth++] = (struct bound_frame) {
+					.start = i, .is_balanced = true
+				};
+				break;
+			case OP_JUMP_NOT_ZERO:
+				if (top == NULL || top->start + 1 != in.jump) {
+					err = EINVAL;
+					goto bound_done;
+				}
+				depth--;
+				is_balanced[top->start] = top->is_balanced
+					&& top->move % cells == 0;
+				if (!is_balanced[top->start] && depth > 0) {
+					frames[depth - 1].is_balanced = false;
+				}
+				break;
+			default:
+				break;
+		}
+	}
+
+	if (depth != 0) {
+		err = EINVAL;
+		goto bound_done;
+	}
+
+	for (size_t i = 0; i < program->len; i++) {
+		const struct matsplat_instruction in = code[i];
+		const int64_t index = position + (in.op == OP_MOVE ? in.arg
+						  : in.offset);
+		const bool is_in_bounds = is_known && index >= 0
+			&& index < cells;
+
+		flags[i] = 0;
+		switch (in.op) {
+			case OP_MOVE:
+				is_known = is_in_bounds;
+				position = index;
+				/* Fallthrough */
+			case OP_ADD:
+			case OP_SET:
+			case OP_MUL:
+			case OP_OUTPUT:
+			case OP_INPUT:
+				if (is_in_bounds) {
+					flags[i] = MATSPLAT_IN_BOUNDS;
+					if ((size_t) index >= *bounded_cells) {
+						*bounded_cells = index + 1;
+					}
+				}
+				break;
+			case OP_SWEEP:
+				for (size_t j = i + 1; j < in.jump; j++) {
+					flags[j] = 0;
+				}
+				i = in.jump - 1;
+				/* Fallthrough */
+			case OP_SCAN:
+				is_known = false;
+				break;
+			case OP_JUMP_ZERO:
+				frames[depth++] = (struct bound_frame) {
+					.start = i, .is_known = is_known,
+					.position = position
+				};
+				is_known &= is_balanced[i];
+				break;
+			case OP_JUMP_NOT_ZERO:
+				depth--;
+				is_known = frames[depth].is_known
+					&& is_balanced[frames[depth].start];
+				position = frames[depth].position;
+				break;
+			default:
+				break;
+		}
+	}
+
+bound_done:
+	free(frames);
+	free(is_balanced);
+	return err;
+}
+
+/*
+ * Returns the factor of the loop starting at `start` if it is counted, or 0.
+ * A counted loop has a body of straight-line code that returns the pointer to
+ * where it started, and changes the loop's cell only by the same odd step
+ * every iteration, so the cell reaches zero after a number of iterations known
+ * on entry.
+ */
+static uint8_t
+count_loop(const struct matsplat_program *program, const size_t start)
+{
+	const struct matsplat_instruction *code = program->code;
+	const int64_t cells = (int64_t) program->cell_count;
+	int64_t position = 0;
+	int64_t step = 0;
+
+	for (size_t i = start + 1; i < code[start].jump - 1; i++) {
+		const struct matsplat_instruction in = code[i];
+		const int64_t cell = position + in.offset;
+
+		switch (in.op) {
+			case OP_MOVE:
+				position += in.arg;
+				if (position <= -cells || position >= cells) {
+					return 0;
+				}
+				continue;
+			case OP_ADD:
+				if (cell == 0) {
+					step += in.arg;
+					continue;
+				}
+				break;
+			case OP_OUTPUT:
+				continue;
+			case OP_SET:
+			case OP_MUL:
+			case OP_INPUT:
+				break;
+			default:
+				return 0;
+		}
+
+		/* Any other write must miss the loop's cell, even wrapped. */
+		if (cell % cells == 0) {
+			return 0;
+		}
+	}
+
+	return position == 0 && step % 2 != 0 ? step_factor(step) : 0;
+}
+
+/*
+ * Returns true if the loop starting at `start`, once entered, never ends: its
+ * body is straight-line code that returns the pointer to where it started, and
+ * never writes the loop's cell, even wrapped.
+ */
+static bool
+never_ends(const struct matsplat_instruction *code, const size_t start,
+	   const int64_t cells)
+{
+	int64_t position = 0;
+
+	for (size_t i = start + 1; i < code[start].jump - 1; i++) {
+		const int64_t cell = position + code[i].offset;
+
+		switch (code[i].op) {
+			case OP_MOVE:
+				position += code[i].arg;
+				if (position <= -cells || position >= cells) {
+					return false;
+				}
+				break;
+			case OP_ADD:
+			case OP_SET:
+			case OP_MUL:
+			case OP_INPUT:
+				if (cell % cells == 0) {
+					return false;
+				}
+				break;
+			case OP_OUTPUT:
+				break;
+			default:
+				return false;
+		}
+	}
+
+	return position == 0;
+}
+
+/*
+ * Marks the code that cannot change what a program does, following the value
+ * of the current cell where it is known. The tape starts out zero, and a loop,
+ * scan or sweep only ends on a zero cell, so loops entered right after them or
+ * at the start never run, and neither do MULs of a zero cell or SETs of a cell
+ * to its value. A loop entered on a known non-zero cell that never ends leaves
+ * the rest of the program unreachable. Only loops outside of any other are
+ * followed that far, so the code after them can simply be dropped.
+ */
+static void
+mark_unreachable(const struct code_buffer *out, const int64_t cells,
+		 bool *is_dead)
+{
+	const struct matsplat_instruction *code = out->code;
+	bool is_tape_zero = true;
+	bool is_known = true;
+	uint8_t value = 0;
+	size_t depth = 0;
+
+	for (size_t i = 0; i < out->len; i++) {
+		const struct matsplat_instruction in = code[i];
+		const bool is_zero = is_known && value == 0;
+		/* Offsets of a whole number of tapes wrap to the current cell. */
+		const bool is_current = in.offset % cells == 0;
+
+		switch (in.op) {
+			case OP_JUMP_ZERO:
+			case OP_SWEEP:
+				if (is_zero) {
+					memset(is_dead + i, true, in.jump - i);
+					i = in.jump - 1;
+					break;
+				} else if (in.op == OP_SWEEP) {
+					is_known = true;
+					value = 0;
+					is_tape_zero = false;
+					i = in.jump - 1;
+					break;
+				} else if (is_known && depth == 0
+					   && never_ends(code, i, cells)) {
+					memset(is_dead + in.jump, true,
+					       out->len - 1 - in.jump);
+					return;
+				}
+				is_known = false;
+				is_tape_zero = false;
+				depth++;
+				break;
+			case OP_JUMP_NOT_ZERO:
+				is_known = true;
+				value = 0;
+				depth--;
+				break;
+			case OP_SCAN:
+				is_dead[i] = is_zero;
+				is_known = true;
+				value = 0;
+				break;
+			case OP_ADD:
+				value += is_current ? in.arg : 0;
+				is_tape_zero = false;
+				break;
+			case OP_SET:
+				if (!is_current) {
+					is_dead[i] = is_tape_zero
+						     && in.arg == 0;
+					is_tape_zero = is_dead[i];
+				} else if (is_known
+					   && value == (uint8_t) in.arg) {
+					is_dead[i] = true;
+				} else {
+					is_known = true;
+					value = in.arg;
+					is_tape_zero = false;
+				}
+				break;
+			case OP_MUL:
+				is_dead[i] = is_zero;
+				is_tape_zero = is_tape_zero && is_zero;
+				is_known = is_known && (is_zero || !is_current);
+				break;
+			case OP_MOVE:
+				is_known = is_tape_zero;
+				break;
+			case OP_INPUT:
+				is_known = is_known && !is_current;
+				is_tape_zero = false;
+				break;
+			case OP_OUTPUT:
+			case OP_END:
+			default:
+				break;
+		}
+	}
+}
+
+/*
+ * Marks the stores of the straight-line code from `begin` up to `end` that no
+ * instruction reads before they are overwritten, and folds additions into the
+ * SET of their cell before them. Cells are told apart by their distance from
+ * the pointer at `begin`, which must not wrap, so runs spanning the whole tape,
+ * or more than `DEAD_STORE_MAX_SPAN` cells, are left alone. Returns 0 on
+ * success, or an errno value.
+ */
+static int
+mark_dead_stores(struct code_buffer *out, const size_t begin, const size_t end,
+		 const int64_t cells, bool *is_dead)
+{
+	struct matsplat_instruction *code = out->code;
+	int64_t position = 0;
+	int64_t low = 0;
+	int64_t high = 0;
+
+	for (size_t i = begin; i < end; i++) {
+		const int64_t cell = position + code[i].offset;
+		low = cell < low ? cell : low;
+		high = cell > high ? cell : high;
+		position += code[i].op == OP_MOVE ? code[i].arg : 0;
+		low = position < low ? position : low;
+		high = position > high ? position : high;
+	}
+	if (high - low >= cells || high - low >= DEAD_STORE_MAX_SPAN) {
+		return 0;
+	}
+
+	/*
+	 * Per cell, the SET an addition may fold into going forwards, and
+	 * whether the cell is set before being read going backwards.
+	 */
+	size_t *sets = calloc(high - low + 1, sizeof(*sets));
+	if (sets == NULL) {
+		return errno;
+	}
+
+	/* Additions to a cell just set change what it is set to. */
+	position = 0;
+	for (size_t i = begin; i < end; i++) {
+		const struct matsplat_instruction in = code[i];
+		const int64_t cell = position + in.offset - low;
+
+		if (in.op == OP_MOVE) {
+			position += in.arg;
+			continue;
+		} else if (is_dead[i]) {
+			continue;
+		}
+		switch (in.op) {
+			case OP_ADD:
+				if (sets[cell] != 0) {
+					code[sets[cell] - 1].arg = (int8_t)
+						(code[sets[cell] - 1].arg
+						 + in.arg);
+					is_dead[i] = true;
+				}
+				break;
+			case OP_SET:
+				sets[cell] = i + 1;
+				break;
+			case OP_MUL:
+				sets[position - low] = 0;
+				sets[cell] = 0;
+				break;
+			case OP_OUTPUT:
+			default:
+				sets[cell] = 0;
+				break;
+		}
+	}
+
+	/* Going backwards, a store is dead if its cell is set before a read. */
+	memset(sets, 0, (high - low + 1) * sizeof(*sets));
+	for (size_t i = end; i-- > begin;) {
+		const struct matsplat_instruction in = code[i];
+		position -= in.op == OP_MOVE ? in.arg : 0;
+		const int64_t cell = position + in.offset - low;
+
+		if (is_dead[i] || in.op == OP_MOVE) {
+			continue;
+		} else if (in.op == OP_OUTPUT) {
+			sets[cell] = false;
+			continue;
+		}
+
+		is_dead[i] = sets[cell];
+		if (in.op == OP_SET) {
+			sets[cell] = true;
+		} else if (in.op == OP_MUL && !is_dead[i]) {
+			sets[position - low] = false;
+		}
+	}
+
+	free(sets);
+	return 0;
+}
+
+/*
+ * Removes the code of `out` that cannot change what the program does, see
+ * `mark_unreachable` and `mark_dead_stores`, and moves the jumps over it.
+ * Returns 0 on success, or an errno value.
+ */
+static int
+eliminate_dead_code(struct code_buffer *out, const size_t cell_count)
+{
+	const int64_t cells = (int64_t) cell_count;
+	struct matsplat_instruction *code = out->code;
+	bool *is_dead = calloc(out->len, sizeof(*is_dead));
+	size_t *index = malloc((out->len + 1) * sizeof(*index));
+	int err = 0;
+
+	if (is_dead == NULL || index == NULL) {
+		err = ENOMEM;
+		goto eliminate_dead_code_cleanup;
+	}
+
+	mark_unreachable(out, cells, is_dead);
+
+	/* Straight-line runs end at I/O, loops, scans and sweeps. */
+	for (size_t begin = 0, end = 0; err == 0 && end < out->len; end++) {
+		const enum matsplat_op op = code[end].op;
+		if (op == OP_ADD || op == OP_SET || op == OP_MUL
+		    || op == OP_MOVE || op == OP_OUTPUT) {
+			continue;
+		}
+
+		if (end > begin) {
+			err = mark_dead_stores(out, begin, end, cells,
+					       is_dead);
+		}
+		if (op == OP_SWEEP) {
+			end = code[end].jump - 1;
+		}
+		begin = end + 1;
+	}
+	if (err != 0) {
+		goto eliminate_dead_code_cleanup;
+	}
+
+	size_t len = 0;
+	for (size_t i = 0; i < out->len; i++) {
+		index[i] = len;
+		len += !is_dead[i];
+	}
+	index[out->len] = len;
+
+	for (size_t i = 0; i < out->len; i++) {
+		if (is_dead[i]) {
+			continue;
+		}
+
+		struct matsplat_instruction in = code[i];
+		if (in.op == OP_JUMP_ZERO || in.op == OP_JUMP_NOT_ZERO
+		    || in.op == OP_SWEEP) {
+			in.jump = index[in.jump];
+		}
+		code[index[i]] = in;
+		out->positions[index[i]] = out->positions[i];
+	}
+	out->len = len;
+
+eliminate_dead_code_cleanup:
+	free(is_dead);
+	free(index);
+	return err;
+}
+
+struct matsplat_program
+matsplat_program_create(struct matsplat_node *ast, size_t cell_count)
+{
+	struct matsplat_program program = {0};
+	struct builder b = { .cell_count = cell_count };
+
+	if (cell_count == 0) {
+		program.error_code = EINVAL;
+		return program;
+	}
+
+	b.reach = cell_count - 1 < INT32_MAX ? (int64_t) cell_count - 1
+		: INT32_MAX;
+
+	build_chain(&b, ast);
+	flush_run(&b);
+	b.out.position = b.token;
+	emit(&b.out, OP_END, 0, 0);
+	free(b.run.adds);
+	free(b.run.slots);
+	if (b.out.error_code == 0) {
+		b.out.error_code = eliminate_dead_code(&b.out, cell_count);
+	}
+
+	program.code = b.out.code;
+	program.positions = b.out.positions;
+	program.len = b.out.len;
+	program.cell_count = cell_count;
+
+	uint8_t *flags = NULL;
+	if (b.out.error_code == 0) {
+		flags = malloc(b.out.len * sizeof(*flags));
+		b.out.error_code = flags == NULL ? ENOMEM
+			: bound_pointer(&program, flags,
+					&program.bounded_cells);
+	}
+	for (size_t i = 0; b.out.error_code == 0 && i < b.out.len; i++) {
+		b.out.code[i].flags = flags[i];
+		if (b.out.code[i].op == OP_JUMP_ZERO) {
+			b.out.code[i].arg = count_loop(&program, i);
+		}
+	}
+	free(flags);
+
+	if (b.out.error_code != 0) {
+		free(b.out.code);
+		free(b.out.positions);
+		return (struct matsplat_program) {
+			.error_code = b.out.error_code
+		};
+	}
+
+	return program;
+}
+
+void
+matsplat_program_destroy(struct matsplat_program program)
+{
+	if (program.mapping) {
+		munmap(program.mapping, program.mapping_len);
+	} else {
+		free((struct matsplat_instruction *) program.code);
+		free((struct matsplat_source_position *) program.positions);
+	}
+
+	program.code = NULL;
+	program.positions = NULL;
+	program.len = 0;
+}
+
+static int
+write_all(const int fd, const void *data, size_t len)
+{
+	const char *bytes = data;
+
+	while (len > 0) {
+		ssize_t written = write(fd, bytes, len);
+		if (written == -1) {
+			return errno;
+		}
+		bytes += written;
+		len -= written;
+	}
+
+	return 0;
+}
+
+/*
+ * Checks that every instruction of a program can be executed without reading
+ * or jumping out of bounds, as saved and loaded programs must.
+ */
+static bool
+program_is_valid(const struct matsplat_program *program)
+{
+	const int64_t cells = (int64_t) program->cell_count;
+
+	if (program->cell_count == 0 || program->cell_count > MAX_CELL_COUNT
+	    || program->len == 0
+	    || program->code[program->len - 1].op != OP_END) {
+		return false;
+	}
+
+	for (size_t i = 0; i < program->len; i++) {
+		const struct matsplat_instruction in = program->code[i];
+
+		if (in.op >= OP_COUNT
+		    || in.offset >= cells || -(int64_t) in.offset >= cells) {
+			return false;
+		}
+
+		switch (in.op) {
+			case OP_MOVE:
+			case OP_SCAN:
+				if (in.arg >= cells || -(int64_t) in.arg >= cells) {
+					return false;
+				}
+				break;
+			case OP_SWEEP:
+				/* Only ADDs make up the body, and END follows. */
+				if (in.arg >= cells || -(int64_t) in.arg >= cells
+				    || in.jump <= i + 1 || in.jump >= program->len) {
+					return false;
+				}
+				for (size_t j = i + 1; j < in.jump; j++) {
+					if (program->code[j].op != OP_ADD) {
+						return false;
+					}
+				}
+				break;
+			case OP_JUMP_ZERO:
+				/* The matching JUMP_NOT_ZERO ends the loop. */
+				if (in.jump <= i + 1 || in.jump >= program->len
+				    || program->code[in.jump - 1].op
+				    != OP_JUMP_NOT_ZERO
+				    || program->code[in.jump - 1].jump != i + 1) {
+					return false;
+				}
+				break;
+			case OP_JUMP_NOT_ZERO:
+				if (in.jump >= program->len) {
+					return false;
+				}
+				break;
+			default:
+				break;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Writes `program` to `fd` in the `.bfc` format. Returns EINVAL, without
+ * writing anything, for programs that could not be loaded back.
+ */
+static int
+write_program(const int fd, const struct matsplat_program *program)
+{
+	if (!program_is_valid(program)) {
+		return EINVAL;
+	}
+
+	struct bytecode_header header = {
+		.version = BYTECODE_VERSION,
+		.cell_count = program->cell_count,
+		.len = program->len
+	};
+	memcpy(header.magic, BYTECODE_MAGIC, sizeof(header.magic));
+
+	int err = write_all(fd, &header, sizeof(header));
+	if (err == 0) {
+		err = write_all(fd, program->code,
+				program->len * sizeof(*program->code));
+	}
+	if (err == 0) {
+		err = write_all(fd, program->positions,
+				program->len * sizeof(*program->positions));
+	}
+
+	return err;
+}
+
+int
+matsplat_program_save(const struct matsplat_program *program,
+		      const char *path)
+{
+	char tmp_path[PATH_MAX];
+
+	int written = snprintf(tmp_path, PATH_MAX, "%s.XXXXXX", path);
+	if (written < 0 || written >= PATH_MAX) {
+		return ENAMETOOLONG;
+	}
+
+	/*
+	 * Write to a unique temporary file and rename it into place, so a
+	 * reader never maps a half written program, even when several threads
+	 * save the same program at once.
+	 */
+	int fd = mkstemp(tmp_path);
+	if (fd == -1) {
+		return errno;
+	}
+
+	int err = fchmod(fd, 0644) == -1 ? errno : 0;
+	if (err == 0) {
+		err = write_program(fd, program);
+	}
+	if (close(fd) == -1 && err == 0) {
+		err = errno;
+	}
+	if (err == 0 && rename(tmp_path, path) == -1) {
+		err = errno;
+	}
+	if (err != 0) {
+		unlink(tmp_path);
+	}
+
+	return err;
+}
+
+/* Appends `len` zero bytes to `fd`. */
+static int
+write_zeros(const int fd, size_t len)
+{
+	static const char zeros[4096];
+
+	while (len > 0) {
+		const size_t chunk = len < sizeof(zeros) ? len : sizeof(zeros);
+		int err = write_all(fd, zeros, chunk);
+		if (err != 0) {
+			return err;
+		}
+		len -= chunk;
+	}
+
+	return 0;
+}
+
+/* Copies the rest of `in` to `out`, and returns how many bytes it copied. */
+static int
+copy_all(const int in, const int out, uint64_t *copied)
+{
+	char buf[65536];
+	ssize_t len;
+
+	*copied = 0;
+	while ((len = read(in, buf, sizeof(buf))) > 0) {
+		int err = write_all(out, buf, len);
+		if (err != 0) {
+			return err;
+		}
+		*copied += len;
+	}
+
+	return len == -1 ? errno : 0;
+}
+
+int
+matsplat_program_bundle(const struct matsplat_program *program,
+			const char *runtime, const char *path)
+{
+	char tmp_path[PATH_MAX];
+	struct bundle_trailer trailer = {
+		.len = sizeof(struct bytecode_header)
+			+ program->len * (sizeof(*program->code)
+					  + sizeof(*program->positions))
+	};
+	memcpy(trailer.magic, BUNDLE_MAGIC, sizeof(trailer.magic));
+	uint64_t runtime_len = 0;
+
+	int written = snprintf(tmp_path, PATH_MAX, "%s.XXXXXX", path);
+	if (written < 0 || written >= PATH_MAX) {
+		return ENAMETOOLONG;
+	}
+
+	int in = open(runtime, O_RDONLY);
+	if (in == -1) {
+		return errno;
+	}
+
+	int fd = mkstemp(tmp_path);
+	if (fd == -1) {
+		int err = errno;
+		close(in);
+		return err;
+	}
+
+	int err = fchmod(fd, 0755) == -1 ? errno : 0;
+	if (err == 0) {
+		err = copy_all(in, fd, &runtime_len);
+	}
+	close(in);
+
+	/* The program is mapped straight out of the bundle. */
+	trailer.offset = (runtime_len + BUNDLE_ALIGN - 1) / BUNDLE_ALIGN
+		* BUNDLE_ALIGN;
+	if (err == 0) {
+		err = write_zeros(fd, trailer.offset - runtime_len);
+	}
+	if (err == 0) {
+		err = write_program(fd, program);
+	}
+	if (err == 0) {
+		err = write_all(fd, &trailer, sizeof(trailer));
+	}
+	if (close(fd) == -1 && err == 0) {
+		err = errno;
+	}
+	if (err == 0 && rename(tmp_path, path) == -1) {
+		err = errno;
+	}
+	if (err != 0) {
+		unlink(tmp_path);
+	}
+
+	return err;
+}
+
+/*
+ * Maps the `size` bytes of a serialized program found `offset` bytes into
+ * `fd`, which must be a multiple of the page size, and validates them.
+ */
+static int
+map_program(const int fd, const off_t offset, const uint64_t size,
+	    struct matsplat_program *program)
+{
+	struct bytecode_header header;
+	int err = 0;
+
+	if (size < sizeof(header) || size > SIZE_MAX) {
+		return ENOEXEC;
+	}
+
+	void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, offset);
+	if (mapping == MAP_FAILED) {
+		return errno;
+	}
+
+	memcpy(&header, mapping, sizeof(header));
+	if (memcmp(header.magic, BYTECODE_MAGIC, sizeof(header.magic)) != 0) {
+		err = ENOEXEC;
+		goto load_error;
+	}
+
+	if (header.version != BYTECODE_VERSION) {
+		err = ENOTSUP;
+		goto load_error;
+	}
+
+	const size_t entry_size =
+		sizeof(*program->code) + sizeof(*program->positions);
+	if (header.cell_count == 0 || header.cell_count > MAX_CELL_COUNT
+	    || header.len != (size - sizeof(header)) / entry_size
+	    || (size - sizeof(header)) % entry_size != 0) {
+		err = EINVAL;
+		goto load_error;
+	}
+
+	struct matsplat_program loaded = {
+		.len = header.len,
+		.cell_count = header.cell_count,
+		.code = (const struct matsplat_instruction *)
+			((const char *) mapping + sizeof(header)),
+		.positions = (const struct matsplat_source_position *)
+			((const char *) mapping + sizeof(header)
+			 + header.len * sizeof(*program->code)),
+		.mapping = mapping,
+		.mapping_len = size
+	};
+
+	if (!program_is_valid(&loaded)) {
+		err = EINVAL;
+		goto load_error;
+	}
+
+	/*
+	 * Flags and counted loops are trusted by the backends, so they are
+	 * proven again.
+	 */
+	uint8_t *flags = malloc(loaded.len * sizeof(*flags));
+	if (flags == NULL) {
+		err = ENOMEM;
+		goto load_error;
+	}
+	err = bound_pointer(&loaded, flags, &loaded.bounded_cells);
+	for (size_t i = 0; err == 0 && i < loaded.len; i++) {
+		const struct matsplat_instruction in = loaded.code[i];
+		if ((in.flags & ~flags[i]) != 0
+		    || (in.op == OP_JUMP_ZERO && in.arg != 0
+			&& in.arg != count_loop(&loaded, i))) {
+			err = EINVAL;
+		}
+	}
+	free(flags);
+	if (err != 0) {
+		goto load_error;
+	}
+
+	*program = loaded;
+	return 0;
+
+load_error:
+	munmap(mapping, size);
+	return err;
+}
+
+int
+matsplat_program_load(const char *path, struct matsplat_program *program)
+{
+	struct stat st;
+	int err = 0;
+
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		return errno;
+	}
+
+	if (fstat(fd, &st) == -1) {
+		err = errno;
+	} else {
+		err = map_program(fd, 0, st.st_size, program);
+	}
+
+	close(fd);
+	return err;
+}
+
+int
+matsplat_program_load_bundle(const char *path,
+			     struct matsplat_program *program)
+{
+	struct bundle_trailer trailer;
+	struct stat st;
+	int err = 0;
+
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		return errno;
+	}
+
+	if (fstat(fd, &st) == -1) {
+		err = errno;
+	} else if ((uint64_t) st.st_size < sizeof(trailer)
+		   || pread(fd, &trailer, sizeof(trailer),
+			    st.st_size - sizeof(trailer))
+		   != (ssize_t) sizeof(trailer)
+		   || memcmp(trailer.magic, BUNDLE_MAGIC,
+			     sizeof(trailer.magic)) != 0) {
+		err = ENOEXEC;
+	} else if (trailer.offset % BUNDLE_ALIGN != 0
+		   || trailer.offset > st.st_size - sizeof(trailer)
+		   || trailer.len != st.st_size - sizeof(trailer)
+		   - trailer.offset) {
+		err = EINVAL;
+	} else {
+		err = map_program(fd, trailer.offset, trailer.len, program);
+	}
+
+	close(fd);
+	return err;
+}
@@ -0,0 +1,243 @@
+/*
+ * Mattersplatter - a compiler & interpreter for the Brainf*ck language.
+ * Copyright (C) 2021 Maxwell R. Haley
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mattersplatter.h"
+#include "revision.h"
+
+#ifndef MATSPLAT_VERSION
+#define MATSPLAT_VERSION "unknown"
+#endif
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+static uint64_t
+fnv1a(uint64_t hash, const void *data, const size_t len)
+{
+	const unsigned char *bytes = data;
+
+	for (size_t i = 0; i < len; i++) {
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+uint64_t
+matsplat_cache_key(const char *src_code, const size_t len,
+		   const size_t cell_count)
+{
+	/*
+	 * The cell count is hashed byte by byte so the key does not depend on
+	 * the host's endianness.
+	 */
+	unsigned char cells[sizeof(uint64_t)];
+	uint64_t count = cell_count;
+	for (size_t i = 0; i < sizeof(cells); i++) {
+		cells[i] = (count >> (i * 8)) & 0xff;
+	}
+
+	/*
+	 * The version only changes with releases, so the revisions of the
+	 * generated code and of the bytecode keep artifacts of older builds
+	 * from being served between them.
+	 */
+	const unsigned char revisions[] = { CODEGEN_REVISION, BYTECODE_VERSION };
+
+	uint64_t hash = FNV_OFFSET_BASIS;
+	hash = fnv1a(hash, MATSPLAT_VERSION, strlen(MATSPLAT_VERSION) + 1);
+	hash = fnv1a(hash, revisions, sizeof(revisions));
+	hash = fnv1a(hash, cells, sizeof(cells));
+	return fnv1a(hash, src_code, len);
+}
+
+static int
+make_directory(const char *path)
+{
+	if (mkdir(path, 0755) == -1 && errno != EEXIST) {
+		return errno;
+	}
+
+	return 0;
+}
+
+int
+matsplat_cache_path(char *path, const size_t path_len, const uint64_t key,
+		    const char *kind)
+{
+	char dir[PATH_MAX];
+	const char *xdg_cache = getenv("XDG_CACHE_HOME");
+	const char *home = getenv("HOME");
+	int written;
+	int err;
+
+	/* An empty or relative XDG_CACHE_HOME is invalid per the spec. */
+	if (xdg_cache != NULL && xdg_cache[0] == '/') {
+		written = snprintf(dir, PATH_MAX, "%s", xdg_cache);
+	} else if (home != NULL && home[0] != '\0') {
+		written = snprintf(dir, PATH_MAX, "%s/.cache", home);
+	} else {
+		return ENOENT;
+	}
+
+	if (written < 0 || written >= PATH_MAX) {
+		return ENAMETOOLONG;
+	}
+
+	if ((err = make_directory(dir)) != 0) {
+		return err;
+	}
+
+	if (strlen(dir) + strlen("/mattersplatter") >= PATH_MAX) {
+		return ENAMETOOLONG;
+	}
+	strcat(dir, "/mattersplatter");
+
+	if ((err = make_directory(dir)) != 0) {
+		return err;
+	}
+
+	written = snprintf(path, path_len, "%s/%016" PRIx64 ".%s", dir, key,
+			   kind);
+	if (written < 0 || (size_t) written >= path_len) {
+		return ENAMETOOLONG;
+	}
+
+	return 0;
+}
+
+/*
+ * Copies the file at `from` to `to`, giving `to` the same permission bits as
+ * `from`. Returns 0 on success, or the errno value of the failing call.
+ */
+static int
+copy_file(const char *from, const char *to)
+{
+	char buf[1 << 16];
+	int in = -1;
+	int out = -1;
+	struct stat st;
+	ssize_t read_len;
+	int err = 0;
+
+	in = open(from, O_RDONLY);
+	if (in == -1 || fstat(in, &st) == -1) {
+		goto copy_file_error;
+	}
+
+	out = open(to, O_WRONLY | O_CREAT | O_TRUNC, st.st_mode & 0777);
+	if (out == -1) {
+		goto copy_file_error;
+	}
+
+	while ((read_len = read(in, buf, sizeof(buf))) > 0) {
+		for (ssize_t done = 0; done < read_len;) {
+			ssize_t w = write(out, buf + done, read_len - done);
+			if (w == -1) {
+				goto copy_file_error;
+			}
+			done += w;
+		}
+	}
+
+	if (read_len == -1 || fchmod(out, st.st_mode & 0777) == -1) {
+		goto copy_file_error;
+	}
+
+	close(in);
+	if (close(out) == -1) {
+		return errno;
+	}
+	return 0;
+
+copy_file_error:
+	err = errno;
+	if (in != -1) {
+		close(in);
+	}
+	if (out != -1) {
+		close(out);
+	}
+	return err;
+}
+
+int
+matsplat_cache_fetch(const uint64_t key, const char *kind,
+		     const char *dest_path)
+{
+	char path[PATH_MAX];
+	int err;
+
+	if ((err = matsplat_cache_path(path, PATH_MAX, key, kind)) != 0) {
+		return err;
+	}
+
+	if (access(path, R_OK) == -1) {
+		return errno;
+	}
+
+	return copy_file(path, dest_path);
+}
+
+int
+matsplat_cache_store(const uint64_t key, const char *kind,
+		     const char *src_path)
+{
+	char path[PATH_MAX];
+	char tmp_path[PATH_MAX];
+	int err;
+
+	if ((err = matsplat_cache_path(path, PATH_MAX, key, kind)) != 0) {
+		return err;
+	}
+
+	/*
+	 * Copy to a private temporary name first and rename it into place, so
+	 * concurrent builds never observe a partially written artifact.
+	 */
+	int written = snprintf(tmp_path, PATH_MAX, "%s.%ld.tmp", path,
+			       (long) getpid());
+	if (written < 0 || written >= PATH_MAX) {
+		return ENAMETOOLONG;
+	}
+
+	if ((err = copy_file(src_path, tmp_path)) != 0) {
+		unlink(tmp_path);
+		return err;
+	}
+
+	if (rename(tmp_path, path) == -1) {
+		err = errno;
+		unlink(tmp_path);
+		return err;
+	}
+
+	return 0;
+}
@@ -17,20 +17,55 @@
  */
 #define _POSIX_C_SOURCE 200809L
 #include <errno.h>
-#include <math.h>
+#include <inttypes.h>
 #include <stdarg.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "mattersplatter.h"
+#include "translator.h"
+
+/* Loops executed at least this many times may be treated as hot. */
+#define HOT_LOOP_MIN_ITERATIONS 1024
+/* Hot loops run at least 1/HOT_LOOP_RATIO as often as the hottest loop. */
+#define HOT_LOOP_RATIO 16
+/* Only innermost loops of up to this many instructions are unrolled. */
+#define UNROLL_MAX_BODY 16
+/* Copies of the body of a counted loop run between two checks of its count. */
+#define COUNTED_UNROLL 4
+/* Header of the loop counts saved by instrumented programs. */
+#define LOOP_PROFILE_HEADER "MSPROF 2\n"
+/* Bytes per line of data emitted with `db`. */
+#define DB_LINE_BYTES 16
+/* Cells held in registers at once within straight-line code. */
+#define CACHED_CELLS 4
+/* Instructions looked ahead for another use of a cell worth caching. */
+#define CACHE_LOOKAHEAD 64
+/*
+ * Segments hold at least SEGMENT_MIN_LEN instructions, and end after a
+ * top-level unit where a rolling hash of the last units has the bits of
+ * SEGMENT_CUT_MASK clear, or once they reach SEGMENT_MAX_LEN instructions.
+ */
+#define SEGMENT_MIN_LEN 1024
+#define SEGMENT_MAX_LEN 65536
+#define SEGMENT_CUT_MASK 0x3ff
 
 enum subroutine_flags {
-SR_POINTER_RIGHT = 1 << 0,
-SR_POINTER_LEFT = 1 << 1,
-SR_PRINT = 1 << 2,
-SR_READ = 1 << 3,
+SR_PRINT = 1 << 0,
+SR_READ = 1 << 1,
+SR_WRAP_INDEX = 1 << 2,
+SR_SCAN_RIGHT = 1 << 3,
+SR_SCAN_LEFT = 1 << 4,
+};
+
+/* Layout decisions for a loop, derived from a profile. */
+enum loop_hint {
+HINT_NONE = 0,
+HINT_HOT = 1 << 0,	/* Align the head of the loop. */
+HINT_COLD = 1 << 1,	/* Place the body out of line. */
 };
 
 struct source_block {
@@ -44,6 +79,56 @@ struct source {
 	struct source_block bss;
 	struct source_block text;
 	struct source_block start;
+	struct source_block cold;
+};
+
+/* Per loop layout, indexed by the loop's JUMP_ZERO. */
+struct loop_plan {
+	uint8_t hints;
+	uint8_t unroll;
+	/* Index of the loop among all loops, and of its counters. */
+	size_t counter;
+};
+
+/*
+ * A cell held in a register, `offset` cells away from the pointer. Cells set
+ * to a constant are only held in `value` until something needs the register.
+ */
+struct cached_cell {
+	int32_t offset;
+	bool is_used;
+	/* Set if the cell holds a value not yet stored to the tape. */
+	bool is_dirty;
+	bool is_constant;
+	uint8_t value;
+};
+
+struct codegen {
+	const struct matsplat_program *program;
+	struct loop_plan *plans;
+	/* Prefix of the labels of the copy of the program being generated. */
+	const char *prefix;
+	/*
+	 * Set while generating the copy of a kernel for tapes that offsets may
+	 * wrap around more than once.
+	 */
+	bool is_wrapping;
+	/* Address of the last cell returned by `emit_index` without a wrap. */
+	char address[32];
+	/*
+	 * Cells held in r8 to r11 by straight-line code, and the register still
+	 * holding the current cell right after they were stored, if any.
+	 */
+	struct cached_cell cache[CACHED_CELLS];
+	const char *tested;
+	/* Smallest tape the copy being generated runs on. */
+	uint64_t min_cells;
+	/* Set when every loop counts its entries and iterations. */
+	bool is_instrumented;
+	size_t loop_count;
+	uint8_t included_subroutines;
+	size_t label_count;
+	int error_code;
 };
 
 /* Global scaffolding text. */
@@ -53,8 +138,6 @@ static size_t global_start_len;
 /* Data section skeleton text. */
 static char *data_section;
 static size_t data_section_len;
-static char *size_def;
-static size_t size_def_len;
 
 /* BSS skeleton text.  */
 static char *bss_section;
@@ -63,32 +146,20 @@ static size_t bss_section_len;
 /* Text section skeketon text. */
 static char *text_section;
 static size_t text_section_len;
-static char *sr_pointer_right;
-static size_t sr_pointer_right_len;
-static char *call_sr_pointer_right;
-static size_t call_sr_pointer_right_len;
-static char *sr_pointer_left;
-static size_t sr_pointer_left_len;
-static char *call_sr_pointer_left;
-static size_t call_sr_pointer_left_len;
-static char *increment;
-static size_t increment_len;
-static char *decrement;
-static size_t decrement_len;
 static char *sr_print;
 static size_t sr_print_len;
-static char *call_sr_print;
-static size_t call_sr_print_len;
 static char *sr_read;
 static size_t sr_read_len;
-static char *call_sr_read;
-static size_t call_sr_read_len;
-static char *loop_start;
-static size_t loop_start_len;
-static char *loop_end;
-static size_t loop_end_len;
+static char *sr_wrap_index;
+static size_t sr_wrap_index_len;
+static char *sr_scan_right;
+static size_t sr_scan_right_len;
+static char *sr_scan_left;
+static size_t sr_scan_left_len;
 static char *done;
 static size_t done_len;
+static char *done_instrumented;
+static size_t done_instrumented_len;
 
 /* Start section skeketon text. */
 static char *start_section;
@@ -101,18 +172,19 @@ static struct source_block data;
 static struct source_block bss;
 static struct source_block text;
 static struct source_block start;
+static struct source_block cold;
 
 static size_t
 source_block_create(struct source_block *src_blk, const char *block,
 		    const size_t len)
 {
-	src_blk->block = calloc(len, sizeof(char *));
+	src_blk->block = calloc(len + 1, sizeof(char));
 
 	if (src_blk->block == NULL) {
 		return errno;
 	}
 
-	strncpy(src_blk->block, block, len);
+	memcpy(src_blk->block, block, len);
 	src_blk->len = len;
 
 	return 0;
@@ -129,6 +201,7 @@ source_blocks_destroy(const size_t count, ...)
 		blk = va_arg(blks,  struct source_block *);
 		blk->len = 0;
 		free(blk->block);
+		blk->block = NULL;
 	}
 
 	va_end(blks);
@@ -138,29 +211,83 @@ static size_t
 append_to_block(struct source_block *src_block, const char *string, size_t len)
 {
 	size_t new_len = len + src_block->len;
-	src_block->block = realloc(src_block->block, new_len + 1);
+	char *block = realloc(src_block->block, new_len + 1);
 
-	if (errno) {
+	/*
+	 * Only trust errno when realloc actually failed; it may hold a stale
+	 * value from an unrelated call made before compilation started.
+	 */
+	if (block == NULL) {
 		return errno;
 	}
-	strncat(src_block->block, string, len * sizeof(char *));
+	src_block->block = block;
+	memcpy(src_block->block + src_block->len, string, len);
+	src_block->block[new_len] = '\0';
 	src_block->len = new_len;
 	return 0;
 }
 
+/* Appends a formatted line of assembly, recording the first failure. */
+static void
+emitf(struct codegen *cg, struct source_block *blk, const char *format, ...)
+{
+	char line[128];
+	va_list args;
+
+	if (cg->error_code != 0) {
+		return;
+	}
+
+	va_start(args, format);
+	int len = vsnprintf(line, sizeof(line), format, args);
+	va_end(args);
+
+	if (len < 0 || (size_t) len >= sizeof(line)) {
+		cg->error_code = EOVERFLOW;
+		return;
+	}
+
+	cg->error_code = append_to_block(blk, line, len);
+}
+
+/* Emits `len` bytes of data at `label`, as lines of `db`. */
+static void
+emit_bytes(struct codegen *cg, const char *label, const void *bytes,
+	   const size_t len)
+{
+	const uint8_t *b = bytes;
+	char line[128];
+
+	emitf(cg, &data, "%s:\n", label);
+	for (size_t i = 0; i < len; i += DB_LINE_BYTES) {
+		int line_len = 0;
+		for (size_t j = i; j < len && j < i + DB_LINE_BYTES; j++) {
+			line_len += snprintf(line + line_len,
+					     sizeof(line) - line_len,
+					     j == i ? "db %u" : ", %u", b[j]);
+		}
+		emitf(cg, &data, "%s\n", line);
+	}
+}
+
 static struct matsplat_compilation_result
 source_to_string(const struct source src)
 {
-	struct matsplat_compilation_result result;
+	struct matsplat_compilation_result result = {0};
 	const size_t src_length =
 		src.global.len
 		+ src.data.len
 		+ src.bss.len
 		+ src.text.len
 		+ src.start.len
+		+ src.cold.len
 		+ 1;
 
-	result.source_code = calloc(src_length, sizeof(char *));
+	result.source_code = calloc(src_length, sizeof(char));
+	if (result.source_code == NULL) {
+		result.error_code = errno;
+		return result;
+	}
 	result.source_code_len = src_length;
 
 	strncat(result.source_code, src.global.block, src.global.len);
@@ -168,12 +295,13 @@ source_to_string(const struct source src)
 	strncat(result.source_code, src.bss.block, src.bss.len);
 	strncat(result.source_code, src.text.block, src.text.len);
 	strncat(result.source_code, src.start.block, src.start.len);
+	strncat(result.source_code, src.cold.block, src.cold.len);
 
 	return result;
 }
 
 static void
-initialize_asm_values()
+initialize_asm_values(const enum matsplat_entry_point entry_point)
 {
 	/* Global scaffolding text. */
 	global_start = "global _start\n";
@@ -182,78 +310,234 @@ initialize_asm_values()
 	/* Data section skeleton text. */
 	data_section = "section .data\n";
 	data_section_len = strlen(data_section);
-	size_def = "size: equ";
-	size_def_len = strlen(size_def);
 
 	/* BSS skeleton text.  */
 	bss_section = "section .bss\n" "array: resb size\n";
 	bss_section_len = strlen(bss_section);
 
-	/* Text section skeketon text. */
+	/*
+	 * Text section skeketon text. The generated code keeps its state in
+	 * callee-saved registers: rbx holds the address of the tape, r12 the
+	 * pointer, r13 the amount of cells, and r14 the I/O callbacks of a
+	 * kernel. This way, a kernel can call back into C without spilling.
+	 * The I/O subroutines take the address of the cell in rsi.
+	 */
 	text_section = "section .text\n";
 	text_section_len = strlen(text_section);
-	sr_pointer_right =
-		"pointer_right:\n"
-		"cmp r9, size - 1\n"
-		"je pointer_right_overflow\n"
-		"inc r9\n"
-		"ret\n"
-		"pointer_right_overflow:\n"
-		"mov r9, 0\n"
-		"ret\n";
-	sr_pointer_right_len = strlen(sr_pointer_right);
-	call_sr_pointer_right = "call pointer_right\n";
-	call_sr_pointer_right_len = strlen(call_sr_pointer_right);
-	sr_pointer_left = "pointer_left:\n"
-		"cmp r9, 0\n"
-		"je pointer_left_overflow\n"
-		"dec r9\n"
-		"ret\n"
-		"pointer_left_overflow:\n"
-		"mov r9, size - 1\n"
-		"ret\n";
-	sr_pointer_left_len = strlen(sr_pointer_left);
-	call_sr_pointer_left = "call pointer_left\n";
-	call_sr_pointer_left_len = strlen(call_sr_pointer_left);
-	increment = "inc byte [rdx + r9]\n";
-	increment_len = strlen(increment);
-	decrement = "dec byte [rdx + r9]\n";
-	decrement_len = strlen(decrement);
 	sr_print = "print:\n"
 		"mov rax, 1\n"
 		"mov rdi, 1\n"
-		"add rdx, r9\n"
-		"mov rsi, rdx\n"
 		"mov rdx, 1\n"
 		"syscall\n"
-		"mov rdx, array\n"
 		"ret\n";
 	sr_print_len = strlen(sr_print);
-	call_sr_print = "call print\n";
-	call_sr_print_len = strlen(call_sr_print);
 	sr_read = "read:\n"
-		"add rdx, r9\n"
 		"mov rax, 0\n"
 		"mov rdi, 0\n"
-		"mov rsi, rdx\n"
 		"mov rdx, 1\n"
 		"syscall\n"
-		"mov rdx, array\n"
 		"ret\n";
 	sr_read_len = strlen(sr_read);
-	call_sr_read = "call read\n";
-	call_sr_read_len = strlen(call_sr_read);
-	loop_start = "loop_%p:\n" "cmp byte [rdx + r9], 0\n" "je loop_%p_end\n";
-	loop_start_len = strlen(loop_start);
-	loop_end = "jnz loop_%p\n" "loop_%p_end:\n";
-	loop_end_len = strlen(loop_end);
+	/*
+	 * Puts the index of the cell rax cells away from the pointer in rcx,
+	 * for tapes smaller than the offset.
+	 */
+	sr_wrap_index = "wrap_index:\n"
+		"test rax, rax\n"
+		"js wrap_index_negative\n"
+		"xor edx, edx\n"
+		"div r13\n"
+		"lea rcx, [r12 + rdx]\n"
+		"mov rdx, rcx\n"
+		"sub rdx, r13\n"
+		"cmovae rcx, rdx\n"
+		"ret\n"
+		"wrap_index_negative:\n"
+		"neg rax\n"
+		"xor edx, edx\n"
+		"div r13\n"
+		"mov rcx, r12\n"
+		"sub rcx, rdx\n"
+		"lea rdx, [rcx + r13]\n"
+		"cmovb rcx, rdx\n"
+		"ret\n";
+	sr_wrap_index_len = strlen(sr_wrap_index);
+	/*
+	 * Move the pointer by rsi cells right, or left, until the cell is zero.
+	 * Where the stride divides 16, edi masks the cells of a 16 byte block
+	 * the scan visits, and whole blocks are compared at once. The cells
+	 * near the ends of the tape, and other strides, are stepped through
+	 * one at a time.
+	 */
+	sr_scan_right = "scan_right:\n"
+		"test edi, edi\n"
+		"jz scan_right_step\n"
+		"lea rax, [r12 + 16]\n"
+		"cmp rax, r13\n"
+		"ja scan_right_step\n"
+		"movdqu xmm0, [rbx + r12]\n"
+		"pxor xmm1, xmm1\n"
+		"pcmpeqb xmm0, xmm1\n"
+		"pmovmskb eax, xmm0\n"
+		"and eax, edi\n"
+		"jnz scan_right_found\n"
+		"add r12, 16\n"
+		"cmp r12, r13\n"
+		"jb scan_right\n"
+		"xor r12, r12\n"
+		"jmp scan_right\n"
+		"scan_right_found:\n"
+		"bsf eax, eax\n"
+		"add r12, rax\n"
+		"ret\n"
+		"scan_right_step:\n"
+		"cmp byte [rbx + r12], 0\n"
+		"je scan_right_done\n"
+		"add r12, rsi\n"
+		"mov rax, r12\n"
+		"sub rax, r13\n"
+		"cmovae r12, rax\n"
+		"jmp scan_right\n"
+		"scan_right_done:\n"
+		"ret\n";
+	sr_scan_right_len = strlen(sr_scan_right);
+	sr_scan_left = "scan_left:\n"
+		"test edi, edi\n"
+		"jz scan_left_step\n"
+		"cmp r12, 15\n"
+		"jb scan_left_step\n"
+		"movdqu xmm0, [rbx + r12 - 15]\n"
+		"pxor xmm1, xmm1\n"
+		"pcmpeqb xmm0, xmm1\n"
+		"pmovmskb eax, xmm0\n"
+		"and eax, edi\n"
+		"jnz scan_left_found\n"
+		"sub r12, 16\n"
+		"jae scan_left\n"
+		"add r12, r13\n"
+		"jmp scan_left\n"
+		"scan_left_found:\n"
+		"bsr eax, eax\n"
+		"lea r12, [r12 + rax - 15]\n"
+		"ret\n"
+		"scan_left_step:\n"
+		"cmp byte [rbx + r12], 0\n"
+		"je scan_left_done\n"
+		"sub r12, rsi\n"
+		"lea rax, [r12 + r13]\n"
+		"cmovb r12, rax\n"
+		"jmp scan_left\n"
+		"scan_left_done:\n"
+		"ret\n";
+	sr_scan_left_len = strlen(sr_scan_left);
 	done = "done:\n" "mov rax, 60\n" "xor rdi, rdi\n" "syscall\n";
 	done_len = strlen(done);
+	/*
+	 * Saves the loop counts of an instrumented program before exiting:
+	 * the header and positions from .data, then the counts from .bss. The
+	 * file is opened with O_WRONLY | O_CREAT | O_TRUNC and mode 0644. The
+	 * program itself succeeded, so failing to save is not an error.
+	 */
+	done_instrumented = "done:\n"
+		"mov rax, 2\n"
+		"mov rdi, loop_profile_path\n"
+		"mov rsi, 577\n"
+		"mov rdx, 420\n"
+		"syscall\n"
+		"test rax, rax\n"
+		"js done_exit\n"
+		"mov r15, rax\n"
+		"mov rax, 1\n"
+		"mov rdi, r15\n"
+		"mov rsi, loop_profile\n"
+		"mov rdx, loop_profile_len\n"
+		"syscall\n"
+		"mov rax, 1\n"
+		"mov rdi, r15\n"
+		"mov rsi, loop_counts\n"
+		"mov rdx, loop_counts_len\n"
+		"syscall\n"
+		"mov rax, 3\n"
+		"mov rdi, r15\n"
+		"syscall\n"
+		"done_exit:\n"
+		"mov rax, 60\n"
+		"xor rdi, rdi\n"
+		"syscall\n";
+	done_instrumented_len = strlen(done_instrumented);
 
 	/* Start section skeketon text. */
-	start_section = "_start:\n" "mov rdx, array\n" "mov r9, 0\n";
+	start_section = "_start:\n" "mov rbx, array\n" "xor r12, r12\n"
+		"mov r13, size\n";
 	start_section_len = strlen(start_section);
 
+	if (entry_point != MATSPLAT_ENTRY_KERNEL) {
+		return;
+	}
+
+	/*
+	 * A kernel works on a tape owned by the caller, and does its I/O
+	 * through the caller's `matsplat_io_callbacks`. Subroutines are entered
+	 * with a misaligned stack, so they realign it before calling into C.
+	 * A failed write unwinds the subroutine's return address and returns
+	 * straight to the caller. The GNU-stack note keeps the host from
+	 * getting an executable stack.
+	 */
+	global_start = "global bf_run:function\n"
+		"section .note.GNU-stack noalloc noexec nowrite progbits\n";
+	global_start_len = strlen(global_start);
+	bss_section = "section .bss\n";
+	bss_section_len = strlen(bss_section);
+	sr_print = "print:\n"
+		"sub rsp, 8\n"
+		"movzx edi, byte [rsi]\n"
+		"mov rsi, [r14 + 16]\n"
+		"call [r14 + 8]\n"
+		"add rsp, 8\n"
+		"test eax, eax\n"
+		"js print_error\n"
+		"ret\n"
+		"print_error:\n"
+		"add rsp, 8\n"
+		"mov eax, -1\n"
+		"jmp done_return\n";
+	sr_print_len = strlen(sr_print);
+	sr_read = "read:\n"
+		"push rsi\n"
+		"mov rdi, [r14 + 16]\n"
+		"call [r14]\n"
+		"pop rsi\n"
+		"test eax, eax\n"
+		"js read_eof\n"
+		"mov byte [rsi], al\n"
+		"read_eof:\n"
+		"ret\n";
+	sr_read_len = strlen(sr_read);
+	done = "done:\n"
+		"xor eax, eax\n"
+		"done_return:\n"
+		"pop r15\n"
+		"pop r14\n"
+		"pop r13\n"
+		"pop r12\n"
+		"pop rbx\n"
+		"ret\n";
+	done_len = strlen(done);
+	/* r15 is only pushed to keep the stack 16 byte aligned. */
+	start_section = "bf_run:\n"
+		"push rbx\n"
+		"push r12\n"
+		"push r13\n"
+		"push r14\n"
+		"push r15\n"
+		"mov eax, -1\n"
+		"test rsi, rsi\n"
+		"jz done_return\n"
+		"mov rbx, rdi\n"
+		"xor r12, r12\n"
+		"mov r13, rsi\n"
+		"mov r14, rdx\n";
+	start_section_len = strlen(start_section);
 }
 
 static int
@@ -286,139 +570,1331 @@ initialize_source_blocks()
 		goto init_failure;
 	}
 
+	if ((result = source_block_create(&cold, "", 0)) != 0) {
+		goto init_failure;
+	}
+
 	return result;
 
 init_failure:
 	return result;
 }
 
-void
-compile(struct matsplat_node *node, uint8_t *included_subroutines)
+static void
+include_subroutine(struct codegen *cg, const enum subroutine_flags flag,
+		   const char *subroutine, const size_t len)
 {
-	enum matsplat_token t = node->token->type;
-	char *temp = NULL;
+	if ((cg->included_subroutines & flag) == 0x0) {
+		cg->included_subroutines |= flag;
+		if (cg->error_code == 0) {
+			cg->error_code = append_to_block(&text, subroutine, len);
+		}
+	}
+}
 
-	switch (t) {
-		case POINTER_RIGHT:
-			if ((*included_subroutines & SR_POINTER_RIGHT) == 0x0) {
-				*included_subroutines |= SR_POINTER_RIGHT;
-				append_to_block(&text, sr_pointer_right, sr_pointer_right_len);
-			}
+/*
+ * Emits code putting the index of the cell `offset` cells away from the
+ * pointer into `reg`, and returns the register holding the index. Offsets
+ * are smaller than the tape, so a single conditional wrap is enough, except
+ * in the wrapping copy of a kernel. Cells of instructions flagged in bounds
+ * are addressed from the pointer directly, and moving the pointer itself by
+ * such an instruction is a plain addition.
+ */
+static const char *
+emit_index(struct codegen *cg, struct source_block *blk, const char *reg,
+	   const int32_t offset, const bool is_in_bounds)
+{
+	if (offset == 0) {
+		return "r12";
+	}
 
-			append_to_block(&start, call_sr_pointer_right,
-					call_sr_pointer_right_len);
-			break;
-		case POINTER_LEFT:
-			if ((*included_subroutines & SR_POINTER_LEFT) == 0x0) {
-				*included_subroutines |= SR_POINTER_LEFT;
-				append_to_block(&text, sr_pointer_left, sr_pointer_left_len);
-			}
+	if (cg->is_wrapping) {
+		include_subroutine(cg, SR_WRAP_INDEX, sr_wrap_index,
+				   sr_wrap_index_len);
+		emitf(cg, blk, "mov rax, %" PRId32 "\n" "call wrap_index\n",
+		      offset);
+		if (strcmp(reg, "rcx") != 0) {
+			emitf(cg, blk, "mov %s, rcx\n", reg);
+		}
+		return reg;
+	}
 
-			append_to_block(&start, call_sr_pointer_left,
-					call_sr_pointer_left_len);
-			break;
-		case INCREMENT:
-			append_to_block(&start, increment, increment_len);
-			break;
-		case DECREMENT:
-			append_to_block(&start, decrement, decrement_len);
-			break;
-		case OUTPUT:
-			if ((*included_subroutines & SR_PRINT) == 0x0) {
-				*included_subroutines |= SR_PRINT;
-				append_to_block(&text, sr_print,
-						sr_print_len);
-			}
-			append_to_block(&start, call_sr_print,
-					call_sr_print_len);
-			break;
-		case INPUT:
-			if ((*included_subroutines & SR_READ) == 0x0) {
-				*included_subroutines |= SR_READ;
-				append_to_block(&text, sr_read,
-						sr_read_len);
-			}
-			append_to_block(&start, call_sr_read,
-					call_sr_read_len);
-			break;
-		case JUMP_FORWARD:
-			temp = calloc(loop_start_len, sizeof(char *));
-			sprintf(temp, loop_start, node, node);
-			append_to_block(&start, temp, strlen(temp));
-			free(temp);
-			/* push_jump_stack(current, &jump_stack); */
-			/* is_flow_left = true; */
-			break;
-		case END:
-			append_to_block(&start, done, done_len);
-			append_to_block(&start, "\n", 1);
-			/* is_not_complete = false; */
-			break;
-		case JUMP_BACKWARDS:
-		default:
+	if (is_in_bounds && strcmp(reg, "r12") == 0) {
+		emitf(cg, blk, "add r12, %" PRId32 "\n", offset);
+		return reg;
+	} else if (is_in_bounds) {
+		snprintf(cg->address, sizeof(cg->address), "r12 %c %" PRId64,
+			 offset < 0 ? '-' : '+',
+			 offset < 0 ? -(int64_t) offset : offset);
+		return cg->address;
+	}
+
+	if (offset > 0) {
+		emitf(cg, blk,
+		      "lea %s, [r12 + %" PRId32 "]\n"
+		      "mov rdx, %s\n"
+		      "sub rdx, r13\n"
+		      "cmovae %s, rdx\n",
+		      reg, offset, reg, reg);
+	} else {
+		if (strcmp(reg, "r12") != 0) {
+			emitf(cg, blk, "mov %s, r12\n", reg);
+		}
+		emitf(cg, blk,
+		      "sub %s, %" PRId64 "\n"
+		      "lea rdx, [%s + r13]\n"
+		      "cmovb %s, rdx\n",
+		      reg, -(int64_t) offset, reg, reg);
+	}
+
+	return reg;
+}
+
+/* Registers of the cached cells, by their byte and doubleword names. */
+static const char *const cache_bytes[CACHED_CELLS] = {
+	"r8b", "r9b", "r10b", "r11b"
+};
+static const char *const cache_dwords[CACHED_CELLS] = {
+	"r8d", "r9d", "r10d", "r11d"
+};
+
+/* Stores the cached cell in `slot` if it changed, and forgets it. */
+static void
+spill_cell(struct codegen *cg, struct source_block *blk, const size_t slot)
+{
+	const struct cached_cell cell = cg->cache[slot];
+	const char *index = emit_index(cg, blk, "rcx", cell.offset, true);
+
+	if (cell.is_dirty && cell.is_constant) {
+		emitf(cg, blk, "mov byte [rbx + %s], %" PRIu8 "\n", index,
+		      cell.value);
+	} else if (cell.is_dirty) {
+		emitf(cg, blk, "mov byte [rbx + %s], %s\n", index,
+		      cache_bytes[slot]);
+	}
+	cg->cache[slot] = (struct cached_cell) {0};
+}
+
+/*
+ * Stores the cached cells that changed, and forgets all of them. Called before
+ * the pointer moves, I/O, and loops. If the current cell was in a register,
+ * the register is left in `tested`, so that a loop test right after does not
+ * load the cell just stored.
+ */
+static void
+spill_cells(struct codegen *cg, struct source_block *blk)
+{
+	cg->tested = NULL;
+	for (size_t slot = 0; slot < CACHED_CELLS; slot++) {
+		const struct cached_cell cell = cg->cache[slot];
+		if (cell.is_used && cell.offset == 0 && !cell.is_constant) {
+			cg->tested = cache_bytes[slot];
+		}
+		if (cell.is_used) {
+			spill_cell(cg, blk, slot);
+		}
+	}
+}
+
+/* Emits a test of the current cell, for a jump on whether it is zero. */
+static void
+emit_cell_test(struct codegen *cg, struct source_block *blk)
+{
+	if (cg->tested != NULL) {
+		emitf(cg, blk, "test %s, %s\n", cg->tested, cg->tested);
+	} else {
+		emitf(cg, blk, "cmp byte [rbx + r12], 0\n");
+	}
+	cg->tested = NULL;
+}
+
+/*
+ * Returns how many times the straight-line instructions from `at` up to `end`
+ * use the cell `offset` cells away from the pointer, counting the test of the
+ * loop that may follow them. Only the next `CACHE_LOOKAHEAD` instructions are
+ * looked at, so long runs are not scanned again for every cell.
+ */
+static size_t
+cell_uses(const struct codegen *cg, size_t at, size_t end,
+	  const int32_t offset)
+{
+	const struct matsplat_instruction *code = cg->program->code;
+	size_t uses = 0;
+
+	if (end - at > CACHE_LOOKAHEAD) {
+		end = at + CACHE_LOOKAHEAD;
+	}
+	for (; at < end; at++) {
+		const enum matsplat_op op = code[at].op;
+		if (op != OP_ADD && op != OP_SET && op != OP_MUL) {
 			break;
+		}
+		uses += (code[at].offset == offset)
+			+ (op == OP_MUL && offset == 0);
 	}
 
-	if (t == END || t == JUMP_BACKWARDS) {
-		return;
-	} else if (t == JUMP_FORWARD) {
-		compile(node->left_child, included_subroutines);
+	if (offset == 0 && at < cg->program->len
+	    && (code[at].op == OP_JUMP_ZERO
+		|| code[at].op == OP_JUMP_NOT_ZERO)) {
+		uses++;
+	}
+
+	return uses;
+}
+
+/*
+ * Returns the slot of the cell `offset` cells away from the pointer among the
+ * cached cells, or -1. The cell is cached if it is used again by the
+ * instructions from `at` up to `end`, its address needs no wrap, and a
+ * register is free. It is loaded unless `is_overwritten`, in which case the
+ * caller sets it. Cached cells it may be, wrapped around the tape, are stored
+ * first.
+ */
+static int
+cache_cell(struct codegen *cg, struct source_block *blk, const size_t at,
+	   const size_t end, const int32_t offset, const bool is_in_bounds,
+	   const bool is_overwritten)
+{
+	int slot = -1;
+
+	for (size_t i = 0; i < CACHED_CELLS; i++) {
+		const struct cached_cell cell = cg->cache[i];
+		const int64_t distance = (int64_t) cell.offset - offset;
+		const uint64_t magnitude = distance < 0 ? -distance : distance;
+
+		if (cell.is_used && distance == 0) {
+			return i;
+		} else if (cell.is_used && magnitude >= cg->min_cells) {
+			spill_cell(cg, blk, i);
+		}
+		if (slot < 0 && !cg->cache[i].is_used) {
+			slot = i;
+		}
+	}
+
+	if (slot < 0 || cg->is_wrapping || (offset != 0 && !is_in_bounds)
+	    || cell_uses(cg, at, end, offset) < 2) {
+		return -1;
+	}
 
-		temp = calloc(loop_end_len, sizeof(char *));
-		sprintf(temp, loop_end, node, node);
-		append_to_block(&start, temp, strlen(temp));
-		free(temp);
+	if (!is_overwritten) {
+		emitf(cg, blk, "movzx %s, byte [rbx + %s]\n",
+		      cache_dwords[slot],
+		      emit_index(cg, blk, "rcx", offset, true));
+	}
+	cg->cache[slot] = (struct cached_cell) {
+		.offset = offset, .is_used = true
+	};
+	return slot;
+}
+
+/*
+ * Returns the register of the cell cached in `slot`, first moving a constant
+ * it was set to into it.
+ */
+static const char *
+cached_register(struct codegen *cg, struct source_block *blk, const int slot)
+{
+	struct cached_cell *cell = &cg->cache[slot];
+
+	if (cell->is_constant) {
+		emitf(cg, blk, "mov %s, %" PRIu8 "\n", cache_dwords[slot],
+		      cell->value);
+		cell->is_constant = false;
+	}
+
+	return cache_dwords[slot];
+}
+
+/* Marks the cell cached in `slot`, if any, as changed. */
+static void
+cell_written(struct codegen *cg, const int slot)
+{
+	if (slot >= 0) {
+		cg->cache[slot].is_dirty = true;
+	}
+}
+
+/*
+ * Emits the MUL instruction at `at`, keeping its cells in registers when they
+ * are used again before `end`.
+ */
+static void
+emit_mul(struct codegen *cg, struct source_block *blk, const size_t at,
+	 const size_t end)
+{
+	const struct matsplat_instruction in = cg->program->code[at];
+	const bool is_in_bounds = in.flags & MATSPLAT_IN_BOUNDS;
+	int source = cache_cell(cg, blk, at, end, 0, true, false);
+	const int target = cache_cell(cg, blk, at, end, in.offset,
+				      is_in_bounds, false);
+	const char *index = NULL;
+
+	/* Caching the target may have stored the source, if they may alias. */
+	if (source >= 0 && !cg->cache[source].is_used) {
+		source = -1;
+	}
 
-		compile(node->right_child, included_subroutines);
+	if (source >= 0 && cg->cache[source].is_constant) {
+		const uint8_t product = cg->cache[source].value * in.arg;
+		if (target >= 0 && cg->cache[target].is_constant) {
+			cg->cache[target].value += product;
+		} else if (target >= 0) {
+			emitf(cg, blk, "add %s, %" PRIu8 "\n",
+			      cache_dwords[target], product);
+		} else {
+			index = emit_index(cg, blk, "rcx", in.offset,
+					   is_in_bounds);
+			emitf(cg, blk, "add byte [rbx + %s], %" PRIu8 "\n",
+			      index, product);
+		}
+		cell_written(cg, target);
 		return;
+	}
+
+	/* The index is computed first, as it uses rax. */
+	if (target < 0) {
+		index = emit_index(cg, blk, "rcx", in.offset, is_in_bounds);
+	}
+	if (source >= 0) {
+		emitf(cg, blk, "mov eax, %s\n", cache_dwords[source]);
+	} else {
+		emitf(cg, blk, "movzx eax, byte [rbx + r12]\n");
+	}
+
+	if (in.arg != 1 && in.arg != -1) {
+		emitf(cg, blk, "imul eax, eax, %" PRId32 "\n", in.arg);
+	}
+	if (target >= 0) {
+		emitf(cg, blk, "%s %s, eax\n", in.arg == -1 ? "sub" : "add",
+		      cached_register(cg, blk, target));
 	} else {
-		compile(node->right_child, included_subroutines);
+		emitf(cg, blk, "%s byte [rbx + %s], al\n",
+		      in.arg == -1 ? "sub" : "add", index);
+	}
+	cell_written(cg, target);
+}
+
+static size_t
+compile_range(struct codegen *cg, struct source_block *blk, size_t begin,
+	      const size_t end);
+
+/*
+ * Emits one copy of the body of the loop starting at `jz`. Instrumented loops
+ * count an iteration every time a copy is entered.
+ */
+static void
+compile_body(struct codegen *cg, struct source_block *blk, const size_t jz)
+{
+	if (cg->is_instrumented) {
+		emitf(cg, blk, "inc qword [loop_counts + %zu]\n",
+		      16 * cg->plans[jz].counter + 8);
+	}
+
+	compile_range(cg, blk, jz + 1, cg->program->code[jz].jump - 1);
+}
+
+/*
+ * Emits the counted loop starting at `jz`. Its trip count is worked out from
+ * its cell on entry, so the body runs `COUNTED_UNROLL` copies at a time
+ * without testing the cell, then one copy at a time for the rest. The count
+ * is kept in r15, which no body of a counted loop otherwise uses.
+ */
+static void
+compile_counted_loop(struct codegen *cg, struct source_block *blk,
+		     const size_t jz, const size_t label, const bool is_hot)
+{
+	const uint8_t factor = cg->program->code[jz].arg;
+	const char *p = cg->prefix;
+
+	if (cg->tested != NULL) {
+		emitf(cg, blk, "movzx r15d, %s\n", cg->tested);
+		cg->tested = NULL;
+	} else {
+		emitf(cg, blk, "movzx r15d, byte [rbx + r12]\n");
+	}
+	if (factor == 1) {
+		emitf(cg, blk, "test r15d, r15d\n");
+	} else {
+		emitf(cg, blk,
+		      "imul r15d, r15d, %" PRIu8 "\n"
+		      "and r15d, 255\n",
+		      factor);
+	}
+	emitf(cg, blk, "jz %s_loop_%zu_end\n", p, label);
+	emitf(cg, blk,
+	      "cmp r15d, %d\n"
+	      "jb %s_loop_%zu_rest\n",
+	      COUNTED_UNROLL, p, label);
+	if (is_hot) {
+		emitf(cg, blk, "align 16\n");
+	}
+	emitf(cg, blk, "%s_loop_%zu_body:\n", p, label);
+
+	for (int i = 0; i < COUNTED_UNROLL; i++) {
+		compile_body(cg, blk, jz);
+	}
+
+	emitf(cg, blk,
+	      "sub r15d, %d\n"
+	      "cmp r15d, %d\n"
+	      "jae %s_loop_%zu_body\n",
+	      COUNTED_UNROLL, COUNTED_UNROLL, p, label);
+	emitf(cg, blk,
+	      "test r15d, r15d\n"
+	      "jz %s_loop_%zu_end\n"
+	      "%s_loop_%zu_rest:\n",
+	      p, label, p, label);
+	compile_body(cg, blk, jz);
+	emitf(cg, blk,
+	      "dec r15d\n"
+	      "jnz %s_loop_%zu_rest\n"
+	      "%s_loop_%zu_end:\n",
+	      p, label, p, label);
+}
+
+/*
+ * Emits the loop starting at `jz`. Hot loops get an aligned head and may be
+ * unrolled, so the back edge is taken less often. The bodies of cold loops are
+ * moved out of line, keeping the hot path dense. Small counted loops are
+ * unrolled whether hot or not, as they need no test between copies.
+ */
+static void
+compile_loop(struct codegen *cg, struct source_block *blk, const size_t jz)
+{
+	const struct loop_plan plan = cg->plans[jz];
+	const size_t label = cg->label_count++;
+	const char *p = cg->prefix;
+
+	if (cg->is_instrumented) {
+		emitf(cg, blk, "inc qword [loop_counts + %zu]\n",
+		      16 * plan.counter);
+	}
+
+	if (plan.hints & HINT_COLD) {
+		emit_cell_test(cg, blk);
+		emitf(cg, blk,
+		      "jne %s_loop_%zu_cold\n"
+		      "%s_loop_%zu_end:\n",
+		      p, label, p, label);
+		emitf(cg, &cold, "%s_loop_%zu_cold:\n", p, label);
+		compile_body(cg, &cold, jz);
+		emit_cell_test(cg, &cold);
+		emitf(cg, &cold,
+		      "jne %s_loop_%zu_cold\n"
+		      "jmp %s_loop_%zu_end\n",
+		      p, label, p, label);
 		return;
 	}
+
+	/*
+	 * The copy of a kernel for small tapes cannot tell the cells of a
+	 * counted loop apart from its own cell, so it tests the cell.
+	 */
+	const struct matsplat_instruction in = cg->program->code[jz];
+	if (in.arg != 0 && !cg->is_wrapping
+	    && in.jump - jz - 2 <= UNROLL_MAX_BODY) {
+		compile_counted_loop(cg, blk, jz, label, plan.hints & HINT_HOT);
+		return;
+	}
+
+	emit_cell_test(cg, blk);
+	emitf(cg, blk, "je %s_loop_%zu_end\n", p, label);
+	if (plan.hints & HINT_HOT) {
+		emitf(cg, blk, "align 16\n");
+	}
+	emitf(cg, blk, "%s_loop_%zu_body:\n", p, label);
+
+	compile_body(cg, blk, jz);
+	for (uint8_t i = 1; i < plan.unroll; i++) {
+		emit_cell_test(cg, blk);
+		emitf(cg, blk, "je %s_loop_%zu_end\n", p, label);
+		compile_body(cg, blk, jz);
+	}
+
+	emit_cell_test(cg, blk);
+	emitf(cg, blk,
+	      "jne %s_loop_%zu_body\n"
+	      "%s_loop_%zu_end:\n",
+	      p, label, p, label);
+}
+
+/*
+ * Returns the mask of the cells of a 16 byte block that a scan by `stride`
+ * visits, starting from its first byte, or its last one when scanning left.
+ * Strides that do not divide the block get 0.
+ */
+static uint32_t
+stride_mask(const uint64_t stride, const bool is_left)
+{
+	switch (stride) {
+		case 1:
+			return 0xffff;
+		case 2:
+			return is_left ? 0xaaaa : 0x5555;
+		case 4:
+			return is_left ? 0x8888 : 0x1111;
+		case 8:
+			return is_left ? 0x8080 : 0x0101;
+		default:
+			return 0;
+	}
+}
+
+/*
+ * Emits a scan by `stride` cells. The copy of a kernel for small tapes may
+ * have strides larger than the tape, so it steps with `wrap_index` instead.
+ */
+static void
+emit_scan(struct codegen *cg, struct source_block *blk, const int32_t stride)
+{
+	const bool is_left = stride < 0;
+	const uint64_t magnitude = is_left ? -(int64_t) stride : stride;
+
+	if (cg->is_wrapping) {
+		const size_t label = cg->label_count++;
+		const char *p = cg->prefix;
+
+		emitf(cg, blk, "jmp %s_scan_%zu_check\n" "%s_scan_%zu_step:\n",
+		      p, label, p, label);
+		emit_index(cg, blk, "r12", stride, false);
+		emitf(cg, blk,
+		      "%s_scan_%zu_check:\n"
+		      "cmp byte [rbx + r12], 0\n"
+		      "jne %s_scan_%zu_step\n",
+		      p, label, p, label);
+		return;
+	}
+
+	if (is_left) {
+		include_subroutine(cg, SR_SCAN_LEFT, sr_scan_left,
+				   sr_scan_left_len);
+	} else {
+		include_subroutine(cg, SR_SCAN_RIGHT, sr_scan_right,
+				   sr_scan_right_len);
+	}
+	emitf(cg, blk,
+	      "mov esi, %" PRIu64 "\n"
+	      "mov edi, 0x%" PRIx32 "\n"
+	      "call %s\n",
+	      magnitude, stride_mask(magnitude, is_left),
+	      is_left ? "scan_left" : "scan_right");
+}
+
+/* The cells of a sweep's block starting `start` cells from its first one. */
+struct sweep_window {
+	int64_t start;
+	uint8_t adds[16];
+};
+
+/*
+ * Sums the ADDs of the sweep at `at` into the 16 byte windows of a block they
+ * touch, so every window is loaded and stored once per block, and the next
+ * block loads exactly what this one stored. Windows are laid out from the
+ * ADD with the lowest offset. Returns the amount of windows, or 0 if they
+ * could not be allocated.
+ */
+static size_t
+sweep_windows(struct codegen *cg, const size_t at, const uint32_t mask,
+	      struct sweep_window **windows)
+{
+	const struct matsplat_instruction *code = cg->program->code;
+	const size_t jump = code[at].jump;
+	size_t len = 0;
+	int32_t low = 0;
+
+	/* Every ADD spans at most two windows. */
+	*windows = calloc(2 * (jump - at - 1), sizeof(**windows));
+	if (*windows == NULL) {
+		cg->error_code = errno;
+		return 0;
+	}
+
+	for (size_t i = at + 1; i < jump; i++) {
+		low = code[i].offset < low ? code[i].offset : low;
+	}
+
+	for (size_t i = at + 1; i < jump; i++) {
+		for (size_t lane = 0; lane < 16; lane++) {
+			if (((mask >> lane) & 1) == 0) {
+				continue;
+			}
+
+			const int64_t cell = code[i].offset - low + lane;
+			const int64_t start = low + cell / 16 * 16;
+			size_t w = 0;
+			while (w < len && (*windows)[w].start != start) {
+				w++;
+			}
+			if (w == len) {
+				(*windows)[len++].start = start;
+			}
+			(*windows)[w].adds[cell % 16] += (uint8_t) code[i].arg;
+		}
+	}
+
+	return len;
+}
+
+/*
+ * Emits the sweep at `at`. Like the interpreter, it runs 16 cells worth of
+ * iterations at once where the stride divides 16, none of them stops the
+ * sweep, and the cells they touch lie within the tape. The remaining
+ * iterations, and those of the wrapping copy of a kernel, run one at a time.
+ */
+static void
+emit_sweep(struct codegen *cg, struct source_block *blk, const size_t at)
+{
+	const struct matsplat_instruction *code = cg->program->code;
+	const struct matsplat_instruction in = code[at];
+	const bool is_left = in.arg < 0;
+	const uint64_t stride = is_left ? -(int64_t) in.arg : in.arg;
+	const uint32_t mask = cg->is_wrapping ? 0
+		: stride_mask(stride, is_left);
+	const size_t label = cg->label_count++;
+	const char *p = cg->prefix;
+	struct sweep_window *windows = NULL;
+	const char *index;
+
+	emitf(cg, blk, "%s_sweep_%zu_block:\n", p, label);
+	const size_t windows_len = mask != 0
+		? sweep_windows(cg, at, mask, &windows) : 0;
+	if (windows_len > 0) {
+		/* Blocks start on the pointer, or end on it sweeping left. */
+		const int64_t first = is_left ? -15 : 0;
+		int64_t low = windows[0].start;
+		int64_t high = windows[0].start;
+		for (size_t w = 1; w < windows_len; w++) {
+			low = windows[w].start < low ? windows[w].start : low;
+			high = windows[w].start > high ? windows[w].start : high;
+		}
+
+		if (first + low < 0) {
+			emitf(cg, blk,
+			      "cmp r12, %" PRId64 "\n"
+			      "jb %s_sweep_%zu_step\n",
+			      -(first + low), p, label);
+		}
+		emitf(cg, blk,
+		      "lea rax, [r12 + %" PRId64 "]\n"
+		      "cmp rax, r13\n"
+		      "ja %s_sweep_%zu_step\n",
+		      first + high + 16, p, label);
+		emitf(cg, blk,
+		      "movdqu xmm0, [rbx + r12 %+" PRId64 "]\n"
+		      "pxor xmm1, xmm1\n"
+		      "pcmpeqb xmm0, xmm1\n"
+		      "pmovmskb eax, xmm0\n",
+		      first);
+		emitf(cg, blk,
+		      "test eax, 0x%" PRIx32 "\n"
+		      "jnz %s_sweep_%zu_step\n",
+		      mask, p, label);
+
+		for (size_t w = 0; w < windows_len; w++) {
+			char name[64];
+			snprintf(name, sizeof(name), "%s_sweep_%zu_add_%zu", p,
+				 label, w);
+			emit_bytes(cg, name, windows[w].adds,
+				   sizeof(windows[w].adds));
+			emitf(cg, blk,
+			      "movdqu xmm0, [rbx + r12 %+" PRId64 "]\n"
+			      "movdqu xmm1, [rel %s]\n"
+			      "paddb xmm0, xmm1\n"
+			      "movdqu [rbx + r12 %+" PRId64 "], xmm0\n",
+			      first + windows[w].start, name,
+			      first + windows[w].start);
+		}
+
+		if (is_left) {
+			emitf(cg, blk,
+			      "sub r12, 16\n"
+			      "lea rax, [r12 + r13]\n"
+			      "cmovb r12, rax\n");
+		} else {
+			emitf(cg, blk,
+			      "add r12, 16\n"
+			      "mov rax, r12\n"
+			      "sub rax, r13\n"
+			      "cmovae r12, rax\n");
+		}
+		emitf(cg, blk, "jmp %s_sweep_%zu_block\n", p, label);
+	}
+	free(windows);
+
+	emitf(cg, blk,
+	      "%s_sweep_%zu_step:\n"
+	      "cmp byte [rbx + r12], 0\n"
+	      "je %s_sweep_%zu_end\n",
+	      p, label, p, label);
+	for (size_t i = at + 1; i < in.jump; i++) {
+		index = emit_index(cg, blk, "rcx", code[i].offset, false);
+		emitf(cg, blk, "add byte [rbx + %s], %" PRId32 "\n", index,
+		      code[i].arg);
+	}
+	emit_index(cg, blk, "r12", in.arg, false);
+	emitf(cg, blk,
+	      "jmp %s_sweep_%zu_block\n"
+	      "%s_sweep_%zu_end:\n",
+	      p, label, p, label);
+}
+
+/*
+ * Emits the instructions from `begin` up to `end`, not included. Returns the
+ * index of the instruction following the last one emitted.
+ */
+static size_t
+compile_range(struct codegen *cg, struct source_block *blk, size_t begin,
+	      const size_t end)
+{
+	const struct matsplat_instruction *code = cg->program->code;
+	const char *index;
+
+	while (begin < end) {
+		const struct matsplat_instruction in = code[begin];
+		const bool is_in_bounds = in.flags & MATSPLAT_IN_BOUNDS;
+		int slot;
+
+		/* Cells are only cached within straight-line code. */
+		if (in.op != OP_ADD && in.op != OP_SET && in.op != OP_MUL) {
+			spill_cells(cg, blk);
+		}
+		if (in.op != OP_JUMP_ZERO) {
+			cg->tested = NULL;
+		}
+
+		switch (in.op) {
+			case OP_ADD:
+				slot = cache_cell(cg, blk, begin, end,
+						  in.offset, is_in_bounds,
+						  false);
+				if (slot >= 0 && cg->cache[slot].is_constant) {
+					cg->cache[slot].value += in.arg;
+				} else if (slot >= 0) {
+					emitf(cg, blk, "add %s, %" PRId32 "\n",
+					      cache_dwords[slot], in.arg);
+				} else {
+					index = emit_index(cg, blk, "rcx",
+							   in.offset,
+							   is_in_bounds);
+					emitf(cg, blk, "add byte [rbx + %s], %"
+					      PRId32 "\n", index, in.arg);
+				}
+				cell_written(cg, slot);
+				break;
+			case OP_MOVE:
+				emit_index(cg, blk, "r12", in.arg, is_in_bounds);
+				break;
+			case OP_SCAN:
+				emit_scan(cg, blk, in.arg);
+				break;
+			case OP_SWEEP:
+				emit_sweep(cg, blk, begin);
+				begin = in.jump;
+				continue;
+			case OP_SET:
+				slot = cache_cell(cg, blk, begin, end,
+						  in.offset, is_in_bounds,
+						  true);
+				if (slot >= 0) {
+					cg->cache[slot].is_constant = true;
+					cg->cache[slot].value = in.arg;
+				} else {
+					index = emit_index(cg, blk, "rcx",
+							   in.offset,
+							   is_in_bounds);
+					emitf(cg, blk, "mov byte [rbx + %s], %"
+					      PRId32 "\n", index, in.arg);
+				}
+				cell_written(cg, slot);
+				break;
+			case OP_MUL:
+				emit_mul(cg, blk, begin, end);
+				break;
+			case OP_OUTPUT:
+				include_subroutine(cg, SR_PRINT, sr_print,
+						   sr_print_len);
+				index = emit_index(cg, blk, "rcx", in.offset,
+						   is_in_bounds);
+				emitf(cg, blk, "lea rsi, [rbx + %s]\n"
+				      "call print\n", index);
+				break;
+			case OP_INPUT:
+				include_subroutine(cg, SR_READ, sr_read,
+						   sr_read_len);
+				index = emit_index(cg, blk, "rcx", in.offset,
+						   is_in_bounds);
+				emitf(cg, blk, "lea rsi, [rbx + %s]\n"
+				      "call read\n", index);
+				break;
+			case OP_JUMP_ZERO:
+				compile_loop(cg, blk, begin);
+				begin = in.jump;
+				continue;
+			case OP_END:
+				emitf(cg, blk, "jmp done\n");
+				break;
+			case OP_JUMP_NOT_ZERO:
+			default:
+				/* Emitted along with their JUMP_ZERO. */
+				break;
+		}
+
+		begin++;
+	}
+
+	spill_cells(cg, blk);
+	return begin;
+}
+
+/*
+ * Decides the layout of every loop from the loop counts of `profile`. Loops
+ * the profile knows nothing about are left alone.
+ */
+static int
+plan_loops(struct codegen *cg, const struct matsplat_profile *profile)
+{
+	const struct matsplat_program *program = cg->program;
+	uint64_t max_iterations = 0;
+
+	cg->plans = calloc(program->len, sizeof(*cg->plans));
+	if (cg->plans == NULL) {
+		return errno;
+	}
+
+	for (size_t i = 0; i < program->len; i++) {
+		cg->plans[i].unroll = 1;
+		if (program->code[i].op == OP_JUMP_ZERO) {
+			cg->plans[i].counter = cg->loop_count++;
+		}
+	}
+
+	if (profile == NULL) {
+		return 0;
+	}
+
+	for (size_t i = 0; i < profile->len; i++) {
+		if (profile->loops[i].iterations > max_iterations) {
+			max_iterations = profile->loops[i].iterations;
+		}
+	}
+
+	for (size_t i = 0; i < program->len; i++) {
+		const struct matsplat_instruction in = program->code[i];
+		if (in.op != OP_JUMP_ZERO) {
+			continue;
+		}
+
+		const struct matsplat_loop_count *count =
+			matsplat_profile_find(profile, program->positions[i]);
+		if (count == NULL) {
+			continue;
+		}
+
+		if (count->entries == 0) {
+			cg->plans[i].hints |= HINT_COLD;
+			continue;
+		}
+
+		if (count->iterations < HOT_LOOP_MIN_ITERATIONS
+		    || count->iterations < max_iterations / HOT_LOOP_RATIO) {
+			continue;
+		}
+		cg->plans[i].hints |= HINT_HOT;
+
+		/*
+		 * Unroll small innermost loops by how many times they usually
+		 * iterate, so code size only grows where it pays off.
+		 */
+		const size_t body_len = in.jump - i - 2;
+		bool is_innermost = true;
+		for (size_t j = i + 1; j < in.jump - 1; j++) {
+			is_innermost &= program->code[j].op != OP_JUMP_ZERO;
+		}
+
+		const uint64_t average = count->iterations / count->entries;
+		if (is_innermost && body_len <= UNROLL_MAX_BODY) {
+			cg->plans[i].unroll = average >= 8 ? 4
+				: average >= 2 ? 2 : 1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Returns the largest distance between the pointer and a cell accessed by
+ * `program`, or between the cell of a counted loop and the cells of its body.
+ * A tape larger than this never needs more than one wrap, and never has a
+ * counted loop write its own cell.
+ */
+static uint64_t
+max_reach(const struct matsplat_program *program)
+{
+	uint64_t reach = 0;
+	/* Distance from the cell of the counted loop being walked, if any. */
+	int64_t position = 0;
+	size_t counted_end = 0;
+
+	for (size_t i = 0; i < program->len; i++) {
+		const struct matsplat_instruction in = program->code[i];
+		int64_t distance = in.op == OP_MOVE || in.op == OP_SCAN
+			|| in.op == OP_SWEEP ? in.arg : in.offset;
+
+		if (in.op == OP_JUMP_ZERO && in.arg != 0) {
+			position = 0;
+			counted_end = in.jump;
+		} else if (i < counted_end) {
+			distance += position;
+			position += in.op == OP_MOVE ? in.arg : 0;
+		}
+
+		const uint64_t magnitude = distance < 0 ? -distance : distance;
+		if (magnitude > reach) {
+			reach = magnitude;
+		}
+	}
+
+	return reach;
+}
+
+/*
+ * Emits the data of an instrumented program: the path its loop counts are
+ * saved to, and the header and loop positions written ahead of the counts.
+ * The counts themselves, entries then iterations for every loop, are in .bss.
+ */
+static void
+emit_loop_profile(struct codegen *cg, const char *path)
+{
+	const struct matsplat_program *program = cg->program;
+
+	emit_bytes(cg, "loop_profile_path", path, strlen(path) + 1);
+	emit_bytes(cg, "loop_profile", LOOP_PROFILE_HEADER,
+		   strlen(LOOP_PROFILE_HEADER));
+	emitf(cg, &data, "dq %zu\n", cg->loop_count);
+	for (size_t i = 0; i < program->len; i++) {
+		if (program->code[i].op == OP_JUMP_ZERO) {
+			emitf(cg, &data, "dd %" PRIu32 ", %" PRIu32 "\n",
+			      program->positions[i].column,
+			      program->positions[i].row);
+		}
+	}
+	emitf(cg, &data, "loop_profile_len: equ $ - loop_profile\n");
+	emitf(cg, &data, "loop_counts_len: equ %zu\n", 16 * cg->loop_count);
+	emitf(cg, &bss, "loop_counts: resq %zu\n", 2 * cg->loop_count);
 }
 
 struct matsplat_compilation_result
 matsplat_compile(struct matsplat_node *ast, size_t memsize)
+{
+	const struct matsplat_compile_options options = {
+		.cell_count = memsize,
+		.entry_point = MATSPLAT_ENTRY_START
+	};
+
+	return matsplat_compile_with_options(ast, &options);
+}
+
+struct matsplat_compilation_result
+matsplat_compile_with_options(struct matsplat_node *ast,
+			      const struct matsplat_compile_options *options)
+{
+	struct matsplat_compilation_result result =
+		{.source_code = NULL, .source_code_len = 0, .error_code = 0};
+	const bool is_kernel = options->entry_point == MATSPLAT_ENTRY_KERNEL;
+
+	/*
+	 * Code is generated from the optimized bytecode, so the compiler gets
+	 * folded runs, idiom rewrites, and source positions for free.
+	 */
+	struct matsplat_program program = matsplat_program_create(
+		ast, is_kernel ? MATSPLAT_KERNEL_CELL_COUNT
+		: options->cell_count);
+	if (program.error_code != 0) {
+		result.error_code = program.error_code;
+		return result;
+	}
+
+	result = matsplat_program_compile(&program, options);
+	matsplat_program_destroy(program);
+	return result;
+}
+
+struct matsplat_compilation_result
+matsplat_program_compile(const struct matsplat_program *program,
+			 const struct matsplat_compile_options *options)
 {
 	struct matsplat_compilation_result result =
 		{.source_code = NULL, .source_code_len = 0, .error_code = 0};
+	const bool is_kernel = options->entry_point == MATSPLAT_ENTRY_KERNEL;
+
+	/* Kernels must not assume a tape size, or rely on wrapping moves. */
+	if (program->cell_count != (is_kernel ? MATSPLAT_KERNEL_CELL_COUNT
+				    : options->cell_count)) {
+		result.error_code = EINVAL;
+		return result;
+	}
+
+	/*
+	 * Only standalone programs have an exit to save their counts at, and
+	 * only NASM ones count them.
+	 */
+	if ((is_kernel || options->target != MATSPLAT_TARGET_NASM)
+	    && options->profile_path != NULL) {
+		result.error_code = EINVAL;
+		return result;
+	}
+
+	uint64_t reach = max_reach(program);
+	if (program->bounded_cells > reach + 1) {
+		reach = program->bounded_cells - 1;
+	}
+
+	if (options->target == MATSPLAT_TARGET_C) {
+		return translate_program(program, options, reach);
+	} else if (options->target != MATSPLAT_TARGET_NASM) {
+		result.error_code = EINVAL;
+		return result;
+	}
 
-	initialize_asm_values();
+	struct codegen cg = {
+		.program = program,
+		.prefix = "f",
+		.is_instrumented = options->profile_path != NULL
+	};
+	if ((result.error_code = plan_loops(&cg, options->profile)) != 0) {
+		return result;
+	}
+
+	initialize_asm_values(options->entry_point);
 	result.error_code = initialize_source_blocks();
 	if (result.error_code != 0) {
-		return result;
+		goto compile_cleanup;
+	}
+
+	/*
+	 * Add memory size as static data. A kernel is handed its tape at run
+	 * time, so it has no static size.
+	 */
+	if (!is_kernel) {
+		emitf(&cg, &data, "size: equ %zu\n", options->cell_count);
 	}
 
-	/* Add memory size as static data. */
-	uintmax_t memsize_len = log10(memsize) + 1;
-	char *temp = NULL;
+	if (cg.is_instrumented) {
+		emit_loop_profile(&cg, options->profile_path);
+	}
 
 	/*
-	 * Add the lenght of the size static definition, the lenght of the
-	 * memsize, and 2 (one for the space between `equ` and `memsize`, and
-	 * one for the newline).
+	 * A kernel is generated twice. The first copy assumes a tape larger
+	 * than any offset, like a standalone program does. The second one
+	 * handles smaller tapes, and is only entered for those, or for tapes
+	 * too small for the cells flagged in bounds.
 	 */
-	temp = calloc(size_def_len + memsize_len + 2, sizeof(char *));
-	sprintf(temp, "%s %lu\n", size_def, memsize);
-	append_to_block(&data, temp, strlen(temp));
-	free(temp);
+	if (is_kernel && reach > 0) {
+		emitf(&cg, &start, "cmp r13, %" PRIu64 "\n" "jbe w_entry\n",
+		      reach);
+	}
+	cg.min_cells = is_kernel ? reach + 1 : options->cell_count;
+
+	compile_range(&cg, &start, 0, program->len);
+
+	if (is_kernel && reach > 0) {
+		cg.prefix = "w";
+		cg.is_wrapping = true;
+		emitf(&cg, &start, "w_entry:\n");
+		compile_range(&cg, &start, 0, program->len);
+	}
+
+	if (cg.error_code == 0) {
+		cg.error_code = cg.is_instrumented
+			? append_to_block(&start, done_instrumented,
+					  done_instrumented_len)
+			: append_to_block(&start, done, done_len);
+	}
 
-	/* Parse the actual syntax tree. */
-	uint8_t included_subroutines = 0x0;
-	compile(ast, &included_subroutines);
+	if (cg.error_code != 0) {
+		result.error_code = cg.error_code;
+		source_blocks_destroy(6, &global, &data, &bss, &text, &start,
+				      &cold);
+		goto compile_cleanup;
+	}
 
 	nasm_src.global = global;
 	nasm_src.data = data;
 	nasm_src.bss = bss;
 	nasm_src.text = text;
 	nasm_src.start = start;
+	nasm_src.cold = cold;
 
 	result = source_to_string(nasm_src);
 
-	source_blocks_destroy(5, &global, &data, &bss, &text, &start);
+	source_blocks_destroy(6, &global, &data, &bss, &text, &start, &cold);
+
+compile_cleanup:
+	free(cg.plans);
+	return result;
+}
+
+/*
+ * Returns a hash of the top-level instruction or loop from `begin` up to `end`.
+ * Jumps are left out, so the hash does not depend on where the unit is.
+ */
+static uint64_t
+unit_hash(const struct matsplat_program *program, const size_t begin,
+	  const size_t end)
+{
+	uint64_t hash = 0;
+
+	for (size_t i = begin; i < end; i++) {
+		const struct matsplat_instruction in = program->code[i];
+		hash = (hash ^ in.op) * UINT64_C(0x100000001b3);
+		hash = (hash ^ (uint32_t) in.offset) * UINT64_C(0x100000001b3);
+		hash = (hash ^ (uint32_t) in.arg) * UINT64_C(0x100000001b3);
+	}
+
+	return hash ^ (hash >> 32);
+}
+
+/*
+ * Returns the key of the segment from `begin` up to `end`, hashing its
+ * instructions with their jumps made relative to `begin`, into `key`.
+ * Returns 0 on success, or an errno value.
+ */
+static int
+segment_key(const struct matsplat_program *program, const size_t begin,
+	    const size_t end, uint64_t *key)
+{
+	const size_t len = end - begin;
+	struct matsplat_instruction *code = malloc(len * sizeof(*code));
+	if (code == NULL) {
+		return errno;
+	}
+
+	for (size_t i = begin; i < end; i++) {
+		code[i - begin] = program->code[i];
+		code[i - begin].jump -= code[i - begin].jump != 0 ? begin : 0;
+	}
+	*key = matsplat_cache_key((const char *) code, len * sizeof(*code),
+				  program->cell_count);
+
+	free(code);
+	return 0;
+}
+
+/*
+ * Compiles the segment from `begin` up to `end` into a function of its own,
+ * adding it to `result` and a call to it to the entry point. Labels are
+ * numbered from 0 in every segment, and the segment keeps the data it emits,
+ * so the assembly only depends on the instructions of the segment. Returns 0
+ * on success, or an errno value.
+ */
+static int
+compile_segment(struct codegen *cg, const size_t begin, const size_t end,
+		struct matsplat_segmented_compilation_result *result)
+{
+	struct matsplat_segment segment = {0};
+	const struct source_block main_data = data;
+	struct source_block blk;
+	int err;
+
+	if ((err = segment_key(cg->program, begin, end, &segment.key)) != 0
+	    || (err = source_block_create(&blk, "", 0)) != 0) {
+		return err;
+	}
+
+	/* Room is made whenever the amount of segments reaches a power of 2. */
+	if ((result->len & (result->len - 1)) == 0) {
+		struct matsplat_segment *segments = realloc(result->segments,
+			(result->len == 0 ? 1 : result->len * 2)
+			* sizeof(*segments));
+		if (segments == NULL) {
+			free(blk.block);
+			return errno;
+		}
+		result->segments = segments;
+	}
+
+	emitf(cg, &blk,
+	      "section .text\n"
+	      "extern print\n"
+	      "extern read\n"
+	      "extern scan_right\n"
+	      "extern scan_left\n");
+	emitf(cg, &blk, "global s_%016" PRIx64 "\n" "s_%016" PRIx64 ":\n",
+	      segment.key, segment.key);
+	cg->label_count = 0;
+	cg->tested = NULL;
+	if ((err = source_block_create(&data, data_section,
+				       data_section_len)) != 0) {
+		data = main_data;
+		free(blk.block);
+		return err;
+	}
+	compile_range(cg, &blk, begin, end);
+	emitf(cg, &blk, "ret\n");
+	if (cg->error_code == 0) {
+		cg->error_code = append_to_block(&blk, data.block, data.len);
+	}
+	free(data.block);
+	data = main_data;
+
+	emitf(cg, &global, "extern s_%016" PRIx64 "\n", segment.key);
+	emitf(cg, &start, "call s_%016" PRIx64 "\n", segment.key);
+	if (cg->error_code != 0) {
+		free(blk.block);
+		return cg->error_code;
+	}
+
+	segment.code.source_code = blk.block;
+	segment.code.source_code_len = blk.len;
+	result->segments[result->len++] = segment;
+	return 0;
+}
+
+static int
+compare_segments(const void *a, const void *b)
+{
+	const uint64_t key_a = ((const struct matsplat_segment *) a)->key;
+	const uint64_t key_b = ((const struct matsplat_segment *) b)->key;
+
+	return key_a < key_b ? -1 : key_a > key_b;
+}
+
+/* Sorts the segments of `result` by key, and frees all but one per key. */
+static void
+unique_segments(struct matsplat_segmented_compilation_result *result)
+{
+	size_t len = 0;
+
+	if (result->len == 0) {
+		return;
+	}
+
+	qsort(result->segments, result->len, sizeof(*result->segments),
+	      compare_segments);
+	for (size_t i = 1; i < result->len; i++) {
+		if (result->segments[i].key == result->segments[len].key) {
+			free(result->segments[i].code.source_code);
+		} else {
+			result->segments[++len] = result->segments[i];
+		}
+	}
+	result->len = len + 1;
+}
+
+struct matsplat_segmented_compilation_result
+matsplat_program_compile_segments(
+	const struct matsplat_program *program,
+	const struct matsplat_compile_options *options)
+{
+	struct matsplat_segmented_compilation_result result = {0};
+
+	if (options->entry_point != MATSPLAT_ENTRY_START
+	    || options->target != MATSPLAT_TARGET_NASM
+	    || options->profile != NULL || options->profile_path != NULL
+	    || program->cell_count != options->cell_count) {
+		result.error_code = EINVAL;
+		return result;
+	}
+
+	struct codegen cg = {
+		.program = program,
+		.prefix = "f",
+		.min_cells = options->cell_count
+	};
+	if ((result.error_code = plan_loops(&cg, NULL)) != 0) {
+		return result;
+	}
+
+	initialize_asm_values(options->entry_point);
+	result.error_code = initialize_source_blocks();
+	if (result.error_code != 0) {
+		goto compile_segments_cleanup;
+	}
+
+	/* The segments call the subroutines of the entry point. */
+	emitf(&cg, &global,
+	      "global print\n"
+	      "global read\n"
+	      "global scan_right\n"
+	      "global scan_left\n");
+	emitf(&cg, &data, "size: equ %zu\n", options->cell_count);
+	include_subroutine(&cg, SR_PRINT, sr_print, sr_print_len);
+	include_subroutine(&cg, SR_READ, sr_read, sr_read_len);
+	include_subroutine(&cg, SR_SCAN_RIGHT, sr_scan_right,
+			   sr_scan_right_len);
+	include_subroutine(&cg, SR_SCAN_LEFT, sr_scan_left, sr_scan_left_len);
+
+	/* The END instruction is left to the entry point. */
+	const size_t len = program->len - 1;
+	int err = cg.error_code;
+	uint64_t roll = 0;
+	for (size_t begin = 0, end = 0; err == 0 && end < len;) {
+		const struct matsplat_instruction in = program->code[end];
+		const size_t unit = end;
+
+		/*
+		 * Bit n of the rolling hash depends on the last n + 1 units
+		 * only, so cuts do not move after edits further back.
+		 */
+		end = in.op == OP_JUMP_ZERO || in.op == OP_SWEEP
+			? in.jump : end + 1;
+		roll = (roll << 1) + unit_hash(program, unit, end);
+		if (end < len && end - begin < SEGMENT_MAX_LEN
+		    && (end - begin < SEGMENT_MIN_LEN
+			|| (roll & SEGMENT_CUT_MASK) != 0)) {
+			continue;
+		}
+
+		err = compile_segment(&cg, begin, end, &result);
+		begin = end;
+	}
+
+	emitf(&cg, &start, "jmp done\n");
+	if (err == 0 && cg.error_code == 0) {
+		cg.error_code = append_to_block(&start, done, done_len);
+	}
+	if (err == 0) {
+		err = cg.error_code;
+	}
+
+	if (err == 0) {
+		nasm_src.global = global;
+		nasm_src.data = data;
+		nasm_src.bss = bss;
+		nasm_src.text = text;
+		nasm_src.start = start;
+		nasm_src.cold = cold;
+		result.main = source_to_string(nasm_src);
+		err = result.main.error_code;
+	}
+	source_blocks_destroy(6, &global, &data, &bss, &text, &start, &cold);
+
+	if (err != 0) {
+		matsplat_segmented_compilation_result_destroy(result);
+		result = (struct matsplat_segmented_compilation_result) {
+			.error_code = err
+		};
+	} else {
+		unique_segments(&result);
+	}
+
+compile_segments_cleanup:
+	free(cg.plans);
 	return result;
 }
 
+void
+matsplat_segmented_compilation_result_destroy(
+	struct matsplat_segmented_compilation_result result)
+{
+	matsplat_compilation_result_destroy(result.main);
+	for (size_t i = 0; i < result.len; i++) {
+		matsplat_compilation_result_destroy(result.segments[i].code);
+	}
+	free(result.segments);
+}
+
 void
 matsplat_compilation_result_destroy(struct matsplat_compilation_result result)
 {
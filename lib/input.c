@@ -0,0 +1,77 @@
+/*
+ * Mattersplatter - a compiler & interpreter for the Brainf*ck language.
+ * Copyright (C) 2021 Maxwell R. Haley
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mattersplatter.h"
+
+int
+matsplat_input_map(const char *path, struct matsplat_input *input)
+{
+	struct stat st;
+	int err = 0;
+
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		return errno;
+	}
+
+	if (fstat(fd, &st) == -1) {
+		err = errno;
+		close(fd);
+		return err;
+	}
+
+	/* Empty files cannot be mapped, and have nothing to read anyway. */
+	if (st.st_size == 0) {
+		close(fd);
+		*input = (struct matsplat_input) { .data = NULL, .len = 0 };
+		return 0;
+	}
+
+	void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	err = errno;
+	close(fd);
+	if (mapping == MAP_FAILED) {
+		return err;
+	}
+
+	/* Input is read once, front to back. */
+	posix_madvise(mapping, st.st_size, POSIX_MADV_SEQUENTIAL);
+
+	*input = (struct matsplat_input) {
+		.data = mapping,
+		.len = st.st_size,
+		.mapping = mapping,
+		.mapping_len = st.st_size
+	};
+	return 0;
+}
+
+void
+matsplat_input_unmap(struct matsplat_input input)
+{
+	if (input.mapping) {
+		munmap(input.mapping, input.mapping_len);
+	}
+}
@@ -15,12 +15,83 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
+#include <errno.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#define SCAN_BLOCKS
+#endif
 
 #include "mattersplatter.h"
 
+/* Forces inlining where it decides which code is generated, not just speed. */
+#if defined(__GNUC__)
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE inline
+#endif
+
+/* Cells compared at once by scans. */
+#define SCAN_BLOCK_SIZE 16
+
+/* Polls of a cancellable execution between two calls to its hook. */
+#define CANCEL_INTERVAL 65536
+
+/*
+ * The hook of a cancellable execution, called every `CANCEL_INTERVAL` polls.
+ * Once it returned true, `is_stopped` is set and every poll returns true.
+ */
+struct cancel {
+	bool (*is_cancelled)(void *ctx);
+	void *ctx;
+	uint32_t countdown;
+	bool is_stopped;
+};
+
+/*
+ * Instructions flagged in bounds are dispatched as operations of their own,
+ * which skip wrapping, so the flag costs no branch of its own.
+ */
+#define IN_BOUNDS(op) ((op) | MATSPLAT_IN_BOUNDS << 8)
+
+/*
+ * Superinstructions, made of the sequences of in-bounds instructions that the
+ * programs of bench/corpus run the most, as reported by `mattersplatter -p`.
+ * They only exist in the code run by the interpreter, after `fuse_program`.
+ * The operand of their second instruction is kept in `jump`, unless it is a
+ * jump itself.
+ */
+enum fused_op {
+OP_ADD_MOVE = OP_COUNT,	/* ADD, then MOVE by `jump`. */
+OP_SET_MOVE,		/* SET, then MOVE by `jump`. */
+OP_MOVE_SET,		/* MOVE by `jump`, then SET. */
+OP_MOVE_MUL,		/* MOVE by `jump`, then MUL. */
+OP_MUL_SET,		/* MUL, then SET the current cell to `jump`. */
+OP_MUL_SET_MOVE,	/* MUL_SET to `reserved[0]`, then MOVE by `jump`. */
+OP_MOVE_JUMP_ZERO,	/* MOVE by `arg`, then JUMP_ZERO. */
+OP_MOVE_JUMP_NOT_ZERO,	/* MOVE by `arg`, then JUMP_NOT_ZERO. */
+OP_ADD_JUMP_NOT_ZERO,	/* ADD, then JUMP_NOT_ZERO. */
+FUSED_OP_END
+};
+
+/* The amount of instructions each superinstruction runs. */
+static const uint8_t fused_widths[FUSED_OP_END - OP_COUNT] = {
+	[OP_ADD_MOVE - OP_COUNT] = 2,
+	[OP_SET_MOVE - OP_COUNT] = 2,
+	[OP_MOVE_SET - OP_COUNT] = 2,
+	[OP_MOVE_MUL - OP_COUNT] = 2,
+	[OP_MUL_SET - OP_COUNT] = 2,
+	[OP_MUL_SET_MOVE - OP_COUNT] = 3,
+	[OP_MOVE_JUMP_ZERO - OP_COUNT] = 2,
+	[OP_MOVE_JUMP_NOT_ZERO - OP_COUNT] = 2,
+	[OP_ADD_JUMP_NOT_ZERO - OP_COUNT] = 2,
+};
+
 static void
 execute(struct matsplat_node *node, size_t *pointer, int8_t *memory_cells,
 	size_t cell_count)
@@ -85,6 +156,11 @@ matsplat_execute(struct matsplat_node *start, size_t cell_count)
 	int8_t *memory_cells = calloc(cell_count, sizeof(int8_t));
 	uintmax_t pointer = 0;
 
+	if (memory_cells == NULL) {
+		return (struct matsplat_execution_result)
+			{ .cell_count = cell_count };
+	}
+
 	execute(start, &pointer, memory_cells, cell_count);
 
 	return (struct matsplat_execution_result)
@@ -100,3 +176,1015 @@ matsplat_execution_result_destory(struct matsplat_execution_result result)
 	result.cell_count = 0;
 	result.pointer = 0;
 }
+
+/*
+ * Returns the index of the cell `offset` cells away from `pointer`. Offsets are
+ * always smaller than the tape, so a single wrap is enough.
+ */
+static inline size_t
+cell_index(const size_t pointer, const int32_t offset, const size_t cell_count)
+{
+	if (offset >= 0) {
+		size_t index = pointer + (size_t) offset;
+		return index >= cell_count ? index - cell_count : index;
+	}
+
+	size_t distance = (size_t) -(int64_t) offset;
+	return pointer >= distance ? pointer - distance
+		: pointer + cell_count - distance;
+}
+
+#if defined(SCAN_BLOCKS)
+/* Returns a mask of the zeros among the 16 cells at `cells`. */
+static inline uint32_t
+zero_mask(const int8_t *cells)
+{
+	const __m128i block = _mm_loadu_si128((const __m128i *) cells);
+
+	return (uint32_t) _mm_movemask_epi8(
+		_mm_cmpeq_epi8(block, _mm_setzero_si128()));
+}
+#endif
+
+/*
+ * Returns the mask of the cells of a block that a scan by `stride` visits,
+ * starting from its first cell, or its last one when scanning left. Strides
+ * that do not divide the block are scanned one cell at a time, and get 0.
+ */
+static inline uint32_t
+stride_mask(const size_t stride, const bool is_left)
+{
+	switch (stride) {
+		case 1:
+			return 0xffff;
+		case 2:
+			return is_left ? 0xaaaa : 0x5555;
+		case 4:
+			return is_left ? 0x8888 : 0x1111;
+		case 8:
+			return is_left ? 0x8080 : 0x0101;
+		default:
+			return 0;
+	}
+}
+
+/*
+ * Polls the hook of `cancel`, if it is not NULL. Loops poll on every backward
+ * jump, so the hook is only called every `CANCEL_INTERVAL` polls. Returns true
+ * if the execution must stop.
+ */
+static ALWAYS_INLINE bool
+is_cancelled(struct cancel *cancel)
+{
+	if (cancel == NULL) {
+		return false;
+	} else if (--cancel->countdown == 0) {
+		cancel->countdown = CANCEL_INTERVAL;
+		cancel->is_stopped = cancel->is_stopped
+			|| cancel->is_cancelled(cancel->ctx);
+	}
+
+	return cancel->is_stopped;
+}
+
+/*
+ * Returns the first zero cell found moving right from `pointer` by `stride`
+ * cells, wrapping around like a loop of MOVEs does. Like that loop, it never
+ * returns if there is no such cell, unless `cancel` stops it when it wraps.
+ */
+static size_t
+scan_right(const int8_t *cells, size_t pointer, const size_t stride,
+	   const size_t cell_count, struct cancel *cancel)
+{
+	const uint32_t mask = stride_mask(stride, false);
+
+	for (;;) {
+		if (stride == 1) {
+			const int8_t *zero = memchr(cells + pointer, 0,
+						    cell_count - pointer);
+			if (zero != NULL) {
+				return zero - cells;
+			} else if (is_cancelled(cancel)) {
+				return pointer;
+			}
+			pointer = 0;
+			continue;
+		}
+
+#if defined(SCAN_BLOCKS)
+		/* The stride divides the block, so blocks stay in phase. */
+		while (mask != 0 && pointer + SCAN_BLOCK_SIZE <= cell_count) {
+			const uint32_t zeros = zero_mask(cells + pointer) & mask;
+			if (zeros != 0) {
+				return pointer + __builtin_ctz(zeros);
+			}
+			pointer += SCAN_BLOCK_SIZE;
+			if (pointer == cell_count) {
+				if (is_cancelled(cancel)) {
+					return 0;
+				}
+				pointer = 0;
+			}
+		}
+#else
+		(void) mask;
+#endif
+
+		if (cells[pointer] == 0) {
+			return pointer;
+		}
+		pointer += stride;
+		if (pointer >= cell_count) {
+			if (is_cancelled(cancel)) {
+				return pointer - stride;
+			}
+			pointer -= cell_count;
+		}
+	}
+}
+
+/* Like `scan_right`, moving left. */
+static size_t
+scan_left(const int8_t *cells, size_t pointer, const size_t stride,
+	  const size_t cell_count, struct cancel *cancel)
+{
+	const uint32_t mask = stride_mask(stride, true);
+
+	for (;;) {
+#if defined(SCAN_BLOCKS)
+		/* Blocks end on the pointer, and are read backwards. */
+		while (mask != 0 && pointer >= SCAN_BLOCK_SIZE - 1) {
+			const size_t first = pointer - (SCAN_BLOCK_SIZE - 1);
+			const uint32_t zeros = zero_mask(cells + first) & mask;
+			if (zeros != 0) {
+				return first + 31 - __builtin_clz(zeros);
+			} else if (first == 0 && is_cancelled(cancel)) {
+				return 0;
+			}
+			pointer = first > 0 ? first - 1 : cell_count - 1;
+		}
+#else
+		(void) mask;
+#endif
+
+		if (cells[pointer] == 0) {
+			return pointer;
+		} else if (pointer < stride && is_cancelled(cancel)) {
+			return pointer;
+		}
+		pointer = pointer >= stride ? pointer - stride
+			: pointer + cell_count - stride;
+	}
+}
+
+#if defined(SCAN_BLOCKS)
+/* Most windows a sweep's block may touch to be run a block at a time. */
+#define SWEEP_MAX_WINDOWS 8
+
+/* The cells of a sweep's block starting `start` cells from its first one. */
+struct sweep_window {
+	int64_t start;
+	__m128i adds;
+};
+
+/*
+ * Sums the `adds_len` ADDs at `adds` into the windows of a block they touch,
+ * laid out from the ADD with the lowest offset, so every window is loaded and
+ * stored once per block. Returns the amount of windows, or 0 if there are more
+ * than `SWEEP_MAX_WINDOWS`.
+ */
+static size_t
+sweep_windows(const struct matsplat_instruction *adds, const size_t adds_len,
+	      const uint32_t mask, struct sweep_window *windows)
+{
+	int8_t sums[SWEEP_MAX_WINDOWS][SCAN_BLOCK_SIZE] = {0};
+	size_t len = 0;
+	int32_t low = 0;
+
+	for (size_t i = 0; i < adds_len; i++) {
+		low = adds[i].offset < low ? adds[i].offset : low;
+	}
+
+	for (size_t i = 0; i < adds_len; i++) {
+		for (size_t lane = 0; lane < SCAN_BLOCK_SIZE; lane++) {
+			if (((mask >> lane) & 1) == 0) {
+				continue;
+			}
+
+			const int64_t cell = adds[i].offset - low + lane;
+			const int64_t start = low + cell / SCAN_BLOCK_SIZE
+				* SCAN_BLOCK_SIZE;
+			size_t w = 0;
+			while (w < len && windows[w].start != start) {
+				w++;
+			}
+			if (w == SWEEP_MAX_WINDOWS) {
+				return 0;
+			} else if (w == len) {
+				windows[len++].start = start;
+			}
+			sums[w][cell % SCAN_BLOCK_SIZE] += adds[i].arg;
+		}
+	}
+
+	for (size_t w = 0; w < len; w++) {
+		windows[w].adds = _mm_loadu_si128((const __m128i *) sums[w]);
+	}
+
+	return len;
+}
+#endif
+
+/*
+ * Runs the sweep `in`, whose body is the `adds_len` ADDs that follow it, from
+ * `pointer`, and returns where the pointer stops. Where the stride divides the
+ * block, a whole block of iterations is run at once if none of them stops the
+ * sweep and every cell they touch lies within the tape. The last iterations
+ * are run one at a time, like the loop the sweep replaced, and poll `cancel`.
+ */
+static size_t
+sweep(int8_t *cells, size_t pointer, const struct matsplat_instruction *in,
+      const size_t adds_len, const size_t cell_count, struct cancel *cancel)
+{
+	const struct matsplat_instruction *adds = in + 1;
+
+#if defined(SCAN_BLOCKS)
+	const bool is_left = in->arg < 0;
+	const size_t stride = (size_t) (is_left ? -(int64_t) in->arg : in->arg);
+	uint32_t mask = stride_mask(stride, is_left);
+	struct sweep_window windows[SWEEP_MAX_WINDOWS];
+	size_t windows_len = 0;
+	int64_t low = 0;
+	int64_t end = 0;
+
+	/* Blocks start on the pointer, or end on it when sweeping left. */
+	const int64_t first = is_left ? -(SCAN_BLOCK_SIZE - 1) : 0;
+	const int32_t step = is_left ? -SCAN_BLOCK_SIZE : SCAN_BLOCK_SIZE;
+#endif
+
+	for (;;) {
+#if defined(SCAN_BLOCKS)
+		while (mask != 0 && (int64_t) pointer + first >= 0
+		       && (int64_t) pointer + first + SCAN_BLOCK_SIZE
+		       <= (int64_t) cell_count
+		       && (zero_mask(cells + pointer + first) & mask) == 0) {
+			/* Only sweeps running whole blocks need windows. */
+			if (windows_len == 0) {
+				windows_len = sweep_windows(adds, adds_len,
+							    mask, windows);
+				if (windows_len == 0) {
+					mask = 0;
+					break;
+				}
+
+				low = windows[0].start;
+				end = windows[0].start;
+				for (size_t w = 0; w < windows_len; w++) {
+					const int64_t start = windows[w].start;
+					low = start < low ? start : low;
+					end = start > end ? start : end;
+				}
+				end += SCAN_BLOCK_SIZE;
+			}
+
+			if ((int64_t) pointer + first + low < 0
+			    || (int64_t) pointer + first + end
+			    > (int64_t) cell_count) {
+				break;
+			}
+
+			for (size_t w = 0; w < windows_len; w++) {
+				int8_t *block = cells + pointer + first
+					+ windows[w].start;
+				_mm_storeu_si128((__m128i *) block, _mm_add_epi8(
+					_mm_loadu_si128((__m128i *) block),
+					windows[w].adds));
+			}
+			pointer = cell_index(pointer, step, cell_count);
+		}
+#endif
+
+		if (cells[pointer] == 0 || is_cancelled(cancel)) {
+			return pointer;
+		}
+		for (size_t i = 0; i < adds_len; i++) {
+			cells[cell_index(pointer, adds[i].offset,
+					 cell_count)] += adds[i].arg;
+		}
+		pointer = cell_index(pointer, in->arg, cell_count);
+	}
+}
+
+/* Widest window of cells a memoized loop may touch. */
+#define MEMO_MAX_WINDOW 32
+
+/* Most memoized loops being recorded at once, nested in each other. */
+#define MEMO_MAX_DEPTH 16
+
+/* Lookups after which a loop that hits less than 1 in 8 is no longer tried. */
+#define MEMO_TRIAL 1024
+
+/*
+ * A loop whose outcome is memoized: it touches the `width` cells from `low`
+ * cells away from the pointer, and always leaves the pointer where it found
+ * it. Loops with a `width` of 0 are not memoized.
+ */
+struct memo_loop {
+	int32_t low;
+	uint32_t width;
+	bool is_tried;
+	uint64_t lookups;
+	uint64_t hits;
+};
+
+/*
+ * The cells a loop, whose `[` is at `loop` - 1, left behind in `out` when
+ * entered with `in`. Empty entries have a `loop` of 0.
+ */
+struct memo_entry {
+	size_t loop;
+	int8_t in[MEMO_MAX_WINDOW];
+	int8_t out[MEMO_MAX_WINDOW];
+};
+
+/* A loop that missed, whose outcome is stored in `slot` once it ends. */
+struct memo_pending {
+	size_t loop;
+	size_t slot;
+	int8_t in[MEMO_MAX_WINDOW];
+};
+
+struct memo {
+	struct memo_loop *loops;
+	struct memo_entry *entries;
+	size_t mask;
+	struct memo_pending pending[MEMO_MAX_DEPTH];
+	size_t depth;
+	uint64_t lookups;
+	uint64_t hits;
+};
+
+/* A loop being analyzed by `memo_create`, with offsets from the start. */
+struct memo_frame {
+	size_t at;
+	int64_t entry;
+	int64_t low;
+	int64_t high;
+	bool is_pure;
+	bool has_loops;
+};
+
+static inline void
+memo_touch(struct memo_frame *frame, const int64_t cell)
+{
+	frame->low = cell < frame->low ? cell : frame->low;
+	frame->high = cell > frame->high ? cell : frame->high;
+}
+
+/*
+ * Finds the loops of `program` worth memoizing, and allocates a table of
+ * `entries` entries for their outcomes. Those loops nest other loops, do no
+ * I/O, scans or sweeps, and every loop within them, and themselves, leaves
+ * the pointer where it found it. The cells they touch are then a window
+ * around the pointer, no wider than the tape or `MEMO_MAX_WINDOW` cells.
+ * Returns 0 on success, or an errno value.
+ */
+static int
+memo_create(struct memo *memo, const struct matsplat_program *program,
+	    size_t entries)
+{
+	struct memo_frame *frames = malloc(program->len * sizeof(*frames));
+	size_t depth = 0;
+	int64_t at = 0;
+
+	/* Keep the highest bit, for the slot to be a mask of the hash. */
+	while ((entries & (entries - 1)) != 0) {
+		entries &= entries - 1;
+	}
+
+	*memo = (struct memo) {
+		.loops = calloc(program->len, sizeof(*memo->loops)),
+		.entries = calloc(entries, sizeof(*memo->entries)),
+		.mask = entries - 1
+	};
+	if (frames == NULL || memo->loops == NULL || memo->entries == NULL) {
+		free(frames);
+		free(memo->loops);
+		free(memo->entries);
+		return errno;
+	}
+
+	for (size_t i = 0; i < program->len; i++) {
+		const struct matsplat_instruction in = program->code[i];
+		struct memo_frame *top = depth > 0 ? &frames[depth - 1] : NULL;
+		struct memo_frame frame;
+
+		switch (in.op) {
+			case OP_MOVE:
+				at += in.arg;
+				continue;
+			case OP_MUL:
+				if (top != NULL) {
+					memo_touch(top, at);
+				}
+				/* Fallthrough */
+			case OP_ADD:
+			case OP_SET:
+				if (top != NULL) {
+					memo_touch(top, at + in.offset);
+				}
+				continue;
+			case OP_JUMP_ZERO:
+				if (top != NULL) {
+					memo_touch(top, at);
+				}
+				frames[depth++] = (struct memo_frame) {
+					.at = i, .entry = at, .low = at,
+					.high = at, .is_pure = true
+				};
+				continue;
+			case OP_JUMP_NOT_ZERO:
+				frame = frames[--depth];
+				frame.is_pure = frame.is_pure
+					&& at == frame.entry;
+				break;
+			default:
+				/* I/O, scans and sweeps, which move by data. */
+				if (top != NULL) {
+					top->is_pure = false;
+				}
+				continue;
+		}
+
+		const int64_t width = frame.high - frame.low + 1;
+		if (frame.is_pure && frame.has_loops && width <= MEMO_MAX_WINDOW
+		    && (uint64_t) width <= program->cell_count) {
+			memo->loops[frame.at] = (struct memo_loop) {
+				.low = (int32_t) (frame.low - frame.entry),
+				.width = (uint32_t) width,
+				.is_tried = true
+			};
+		}
+
+		if (depth > 0) {
+			top = &frames[depth - 1];
+			memo_touch(top, frame.low);
+			memo_touch(top, frame.high);
+			top->is_pure = top->is_pure && frame.is_pure;
+			top->has_loops = true;
+		}
+	}
+
+	free(frames);
+	return 0;
+}
+
+static void
+memo_destroy(struct memo *memo)
+{
+	free(memo->loops);
+	free(memo->entries);
+}
+
+/* Copies the window of `loop` around `pointer` to `window`. */
+static inline void
+memo_load(const int8_t *cells, const size_t pointer,
+	  const struct memo_loop *loop, const size_t cell_count,
+	  int8_t *window)
+{
+	size_t cell = cell_index(pointer, loop->low, cell_count);
+
+	for (size_t i = 0; i < loop->width; i++) {
+		window[i] = cells[cell];
+		cell = cell + 1 == cell_count ? 0 : cell + 1;
+	}
+}
+
+/* Copies `window` back to the window of `loop` around `pointer`. */
+static inline void
+memo_store(int8_t *cells, const size_t pointer, const struct memo_loop *loop,
+	   const size_t cell_count, const int8_t *window)
+{
+	size_t cell = cell_index(pointer, loop->low, cell_count);
+
+	for (size_t i = 0; i < loop->width; i++) {
+		cells[cell] = window[i];
+		cell = cell + 1 == cell_count ? 0 : cell + 1;
+	}
+}
+
+static inline size_t
+memo_hash(const size_t loop, const int8_t *window)
+{
+	uint64_t hash = (loop + 1) * UINT64_C(0x9e3779b97f4a7c15);
+
+	for (size_t i = 0; i < MEMO_MAX_WINDOW; i += sizeof(uint64_t)) {
+		uint64_t word;
+		memcpy(&word, window + i, sizeof(word));
+		hash = (hash ^ word) * UINT64_C(0x100000001b3);
+	}
+
+	return (size_t) (hash ^ (hash >> 32));
+}
+
+/*
+ * Looks up the loop whose `[` is at `loop`, entered at `pointer`. On a hit,
+ * its outcome is written to the tape and true is returned. On a miss, the
+ * loop is recorded until it ends, unless too many loops already are.
+ */
+static bool
+memo_enter(struct memo *memo, const size_t loop, int8_t *cells,
+	   const size_t pointer, const size_t cell_count)
+{
+	struct memo_loop *l = &memo->loops[loop];
+	int8_t window[MEMO_MAX_WINDOW] = {0};
+
+	memo_load(cells, pointer, l, cell_count, window);
+	const size_t slot = memo_hash(loop, window) & memo->mask;
+	const struct memo_entry *entry = &memo->entries[slot];
+
+	memo->lookups++;
+	l->lookups++;
+	if (entry->loop == loop + 1
+	    && memcmp(entry->in, window, sizeof(window)) == 0) {
+		memo_store(cells, pointer, l, cell_count, entry->out);
+		memo->hits++;
+		l->hits++;
+		return true;
+	}
+
+	if (l->lookups >= MEMO_TRIAL && l->hits * 8 < l->lookups) {
+		l->is_tried = false;
+	}
+	if (memo->depth < MEMO_MAX_DEPTH) {
+		struct memo_pending *p = &memo->pending[memo->depth++];
+		p->loop = loop;
+		p->slot = slot;
+		memcpy(p->in, window, sizeof(window));
+	}
+
+	return false;
+}
+
+/* Stores the outcome of the last recorded loop, which just ended. */
+static void
+memo_leave(struct memo *memo, const int8_t *cells, const size_t pointer,
+	   const size_t cell_count)
+{
+	const struct memo_pending *p = &memo->pending[--memo->depth];
+	struct memo_entry *entry = &memo->entries[p->slot];
+
+	entry->loop = p->loop + 1;
+	memcpy(entry->in, p->in, sizeof(entry->in));
+	memset(entry->out, 0, sizeof(entry->out));
+	memo_load(cells, pointer, &memo->loops[p->loop], cell_count,
+		  entry->out);
+}
+
+/* Returns true if `in` jumps to its `jump`. */
+static inline bool
+is_jump(const struct matsplat_instruction *in)
+{
+	switch (in->op) {
+		case OP_JUMP_ZERO:
+		case OP_JUMP_NOT_ZERO:
+		case OP_SWEEP:
+		case OP_MOVE_JUMP_ZERO:
+		case OP_MOVE_JUMP_NOT_ZERO:
+		case OP_ADD_JUMP_NOT_ZERO:
+			return true;
+		default:
+			return false;
+	}
+}
+
+/*
+ * Writes the superinstruction starting the `len` instructions at `in` to
+ * `out`, or `in[0]` if none does, and returns the amount of instructions it
+ * replaces. Only the first of them may be jumped to, as `is_target` tells,
+ * and all of them must stay in bounds.
+ */
+static size_t
+fuse(const struct matsplat_instruction *in, const size_t len,
+     const bool *is_target, struct matsplat_instruction *out)
+{
+	*out = in[0];
+	if (len < 2 || is_target[1] || !(in[0].flags & MATSPLAT_IN_BOUNDS)) {
+		return 1;
+	}
+
+	const uint8_t first = in[0].op;
+	const uint8_t second = in[1].op;
+	const bool is_bounded = in[1].flags & MATSPLAT_IN_BOUNDS;
+
+	/* Jumps are never flagged in bounds, as they do not move. */
+	if (first == OP_MOVE
+	    && (second == OP_JUMP_ZERO || second == OP_JUMP_NOT_ZERO)) {
+		out->op = second == OP_JUMP_ZERO ? OP_MOVE_JUMP_ZERO
+			: OP_MOVE_JUMP_NOT_ZERO;
+		out->jump = in[1].jump;
+		return 2;
+	} else if (first == OP_ADD && second == OP_JUMP_NOT_ZERO) {
+		out->op = OP_ADD_JUMP_NOT_ZERO;
+		out->jump = in[1].jump;
+		return 2;
+	} else if (!is_bounded) {
+		return 1;
+	}
+
+	/* Multiplication loops end clearing their counter, then move back. */
+	if (first == OP_MUL && second == OP_SET && in[1].offset == 0) {
+		if (len > 2 && !is_target[2] && in[2].op == OP_MOVE
+		    && in[2].flags & MATSPLAT_IN_BOUNDS) {
+			out->op = OP_MUL_SET_MOVE;
+			out->reserved[0] = (uint8_t) in[1].arg;
+			out->jump = (uint32_t) in[2].arg;
+			return 3;
+		}
+		out->op = OP_MUL_SET;
+		out->jump = (uint32_t) in[1].arg;
+		return 2;
+	} else if ((first == OP_ADD || first == OP_SET) && second == OP_MOVE) {
+		out->op = first == OP_ADD ? OP_ADD_MOVE : OP_SET_MOVE;
+		out->jump = (uint32_t) in[1].arg;
+		return 2;
+	} else if (first == OP_MOVE && (second == OP_SET || second == OP_MUL)) {
+		*out = in[1];
+		out->op = second == OP_SET ? OP_MOVE_SET : OP_MOVE_MUL;
+		out->jump = (uint32_t) in[0].arg;
+		return 2;
+	}
+
+	return 1;
+}
+
+/*
+ * Rewrites the code of `program` into `fused`, with superinstructions in place
+ * of the sequences they run. `fused` shares everything else with `program`,
+ * and its code must be freed. Returns 0 on success, or an errno value.
+ */
+static int
+fuse_program(struct matsplat_program *fused,
+	     const struct matsplat_program *program)
+{
+	const struct matsplat_instruction *in = program->code;
+	struct matsplat_instruction *code = malloc(program->len * sizeof(*code));
+	size_t *new_index = malloc(program->len * sizeof(size_t));
+	bool *is_target = calloc(program->len, sizeof(bool));
+	size_t len = 0;
+
+	if (code == NULL || new_index == NULL || is_target == NULL) {
+		free(code);
+		free(new_index);
+		free(is_target);
+		return ENOMEM;
+	}
+
+	for (size_t i = 0; i < program->len; i++) {
+		if (is_jump(&in[i])) {
+			is_target[in[i].jump] = true;
+		}
+	}
+
+	for (size_t i = 0; i < program->len;) {
+		new_index[i] = len;
+		if (in[i].op == OP_SWEEP) {
+			/* The ADDs of a sweep are its operands. */
+			for (const size_t end = in[i].jump; i < end; i++) {
+				code[len++] = in[i];
+			}
+			continue;
+		}
+		i += fuse(&in[i], program->len - i, &is_target[i], &code[len++]);
+	}
+
+	/* Nothing jumps into a superinstruction, only to its start. */
+	for (size_t i = 0; i < len; i++) {
+		if (is_jump(&code[i])) {
+			code[i].jump = new_index[code[i].jump];
+		}
+	}
+
+	*fused = *program;
+	fused->code = code;
+	fused->len = len;
+	fused->mapping = NULL;
+	fused->mapping_len = 0;
+	free(new_index);
+	free(is_target);
+	return 0;
+}
+
+static int
+stdio_read(void *ctx)
+{
+	(void) ctx;
+	return getchar();
+}
+
+static int
+stdio_write(int c, void *ctx)
+{
+	(void) ctx;
+	return putchar(c);
+}
+
+struct matsplat_execution_result
+matsplat_program_execute(const struct matsplat_program *program)
+{
+	const struct matsplat_execute_options options = { .io = NULL };
+
+	return matsplat_program_execute_with_options(program, &options);
+}
+
+/*
+ * Runs `program`. The loop is written once, and inlined separately for the
+ * profiled, counted, memoized, cancellable and plain cases, so counting,
+ * memoizing and polling cost nothing when `profile`, `stats`, `memo` and
+ * `cancel` are NULL. Input comes from `input` if it is not NULL, and from `io`
+ * otherwise.
+ */
+static ALWAYS_INLINE struct matsplat_execution_result
+run(const struct matsplat_program *program,
+    const struct matsplat_io_callbacks *io, uint64_t *profile,
+    volatile size_t *position, struct matsplat_execution_stats *stats,
+    struct memo *memo, struct cancel *cancel,
+    const struct matsplat_input *input, const enum matsplat_eof eof)
+{
+	const size_t cell_count = program->cell_count;
+	int8_t *memory_cells = calloc(cell_count, sizeof(int8_t));
+	const struct matsplat_instruction *code = program->code;
+	const struct matsplat_instruction *ip = code;
+	struct matsplat_execution_stats counted = {0};
+	size_t pointer = 0;
+	size_t input_at = 0;
+	int c;
+
+	if (memory_cells == NULL) {
+		return (struct matsplat_execution_result)
+			{ .cell_count = cell_count };
+	}
+
+	for (;;) {
+		if (profile != NULL) {
+			profile[ip - code]++;
+			if (position != NULL) {
+				*position = ip - code;
+			}
+		}
+		if (stats != NULL) {
+			counted.steps += ip->op < OP_COUNT ? 1
+				: fused_widths[ip->op - OP_COUNT];
+		}
+
+		switch (ip->op | ip->flags << 8) {
+			case IN_BOUNDS(OP_ADD):
+				memory_cells[pointer + ip->offset] += ip->arg;
+				break;
+			case OP_ADD:
+				memory_cells[cell_index(pointer, ip->offset,
+							cell_count)] += ip->arg;
+				break;
+			case IN_BOUNDS(OP_MOVE):
+				pointer += ip->arg;
+				break;
+			case OP_MOVE:
+				pointer = cell_index(pointer, ip->arg,
+						     cell_count);
+				break;
+			case OP_SCAN:
+				pointer = ip->arg > 0
+					? scan_right(memory_cells, pointer,
+						     ip->arg, cell_count, cancel)
+					: scan_left(memory_cells, pointer,
+						    -(int64_t) ip->arg,
+						    cell_count, cancel);
+				if (cancel != NULL && cancel->is_stopped) {
+					goto execute_done;
+				}
+				break;
+			case OP_SWEEP:
+				pointer = sweep(memory_cells, pointer, ip,
+						ip->jump - (ip - code) - 1,
+						cell_count, cancel);
+				if (cancel != NULL && cancel->is_stopped) {
+					goto execute_done;
+				}
+				ip = code + ip->jump;
+				continue;
+			case IN_BOUNDS(OP_SET):
+				memory_cells[pointer + ip->offset] = ip->arg;
+				break;
+			case OP_SET:
+				memory_cells[cell_index(pointer, ip->offset,
+							cell_count)] = ip->arg;
+				break;
+			case IN_BOUNDS(OP_MUL):
+				memory_cells[pointer + ip->offset] +=
+					memory_cells[pointer] * ip->arg;
+				break;
+			case OP_MUL:
+				memory_cells[cell_index(pointer, ip->offset,
+							cell_count)] +=
+					memory_cells[pointer] * ip->arg;
+				break;
+			case IN_BOUNDS(OP_OUTPUT):
+			case OP_OUTPUT:
+				c = (uint8_t) memory_cells[cell_index(
+					pointer, ip->offset, cell_count)];
+				if (io->write(c, io->ctx) < 0) {
+					goto execute_done;
+				}
+				if (stats != NULL) {
+					counted.bytes_written++;
+				}
+				break;
+			case IN_BOUNDS(OP_INPUT):
+			case OP_INPUT:
+				if (input != NULL) {
+					c = input_at < input->len
+						? input->data[input_at++] : -1;
+				} else {
+					c = io->read(io->ctx);
+				}
+
+				/* Like `scanf`, leave the cell as is on EOF. */
+				if (c < 0 && eof == MATSPLAT_EOF_UNCHANGED) {
+					break;
+				} else if (c < 0) {
+					c = eof == MATSPLAT_EOF_ZERO ? 0 : 255;
+				} else if (stats != NULL) {
+					counted.bytes_read++;
+				}
+				memory_cells[cell_index(pointer, ip->offset,
+							cell_count)] = c;
+				break;
+			case OP_JUMP_ZERO:
+				if (memory_cells[pointer] == 0
+				    || (memo != NULL
+					&& memo->loops[ip - code].is_tried
+					&& memo_enter(memo, ip - code,
+						      memory_cells, pointer,
+						      cell_count))) {
+					ip = code + ip->jump;
+					continue;
+				}
+				break;
+			case OP_JUMP_NOT_ZERO:
+				if (memory_cells[pointer] != 0) {
+					if (is_cancelled(cancel)) {
+						goto execute_done;
+					}
+					ip = code + ip->jump;
+					continue;
+				}
+				/* `jump` follows the `[` of the loop. */
+				if (memo != NULL && memo->depth > 0
+				    && memo->pending[memo->depth - 1].loop
+				    == ip->jump - 1) {
+					memo_leave(memo, memory_cells, pointer,
+						   cell_count);
+				}
+				break;
+			case IN_BOUNDS(OP_ADD_MOVE):
+				memory_cells[pointer + ip->offset] += ip->arg;
+				pointer += (int32_t) ip->jump;
+				break;
+			case IN_BOUNDS(OP_SET_MOVE):
+				memory_cells[pointer + ip->offset] = ip->arg;
+				pointer += (int32_t) ip->jump;
+				break;
+			case IN_BOUNDS(OP_MOVE_SET):
+				pointer += (int32_t) ip->jump;
+				memory_cells[pointer + ip->offset] = ip->arg;
+				break;
+			case IN_BOUNDS(OP_MOVE_MUL):
+				pointer += (int32_t) ip->jump;
+				memory_cells[pointer + ip->offset] +=
+					memory_cells[pointer] * ip->arg;
+				break;
+			case IN_BOUNDS(OP_MUL_SET):
+				memory_cells[pointer + ip->offset] +=
+					memory_cells[pointer] * ip->arg;
+				memory_cells[pointer] = (int32_t) ip->jump;
+				break;
+			case IN_BOUNDS(OP_MUL_SET_MOVE):
+				memory_cells[pointer + ip->offset] +=
+					memory_cells[pointer] * ip->arg;
+				memory_cells[pointer] = ip->reserved[0];
+				pointer += (int32_t) ip->jump;
+				break;
+			case IN_BOUNDS(OP_MOVE_JUMP_ZERO):
+				pointer += ip->arg;
+				if (memory_cells[pointer] == 0) {
+					ip = code + ip->jump;
+					continue;
+				}
+				break;
+			case IN_BOUNDS(OP_MOVE_JUMP_NOT_ZERO):
+				pointer += ip->arg;
+				if (memory_cells[pointer] != 0) {
+					if (is_cancelled(cancel)) {
+						goto execute_done;
+					}
+					ip = code + ip->jump;
+					continue;
+				}
+				break;
+			case IN_BOUNDS(OP_ADD_JUMP_NOT_ZERO):
+				memory_cells[pointer + ip->offset] += ip->arg;
+				if (memory_cells[pointer] != 0) {
+					if (is_cancelled(cancel)) {
+						goto execute_done;
+					}
+					ip = code + ip->jump;
+					continue;
+				}
+				break;
+			case OP_END:
+			default:
+				goto execute_done;
+		}
+
+		ip++;
+	}
+
+execute_done:
+	if (stats != NULL) {
+		if (memo != NULL) {
+			counted.memo_lookups = memo->lookups;
+			counted.memo_hits = memo->hits;
+		}
+		*stats = counted;
+	}
+
+	return (struct matsplat_execution_result)
+		{ .pointer = pointer, .cell_count = cell_count,
+		  .memory_cells = memory_cells };
+}
+
+struct matsplat_execution_result
+matsplat_program_execute_with_options(const struct matsplat_program *program,
+				      const struct matsplat_execute_options
+				      *options)
+{
+	struct matsplat_io_callbacks stdio_callbacks = {
+		.read = stdio_read, .write = stdio_write, .ctx = NULL
+	};
+	const struct matsplat_io_callbacks *io =
+		options->io != NULL ? options->io : &stdio_callbacks;
+
+	const struct matsplat_input *input = options->input;
+	const enum matsplat_eof eof = options->eof;
+	struct cancel hook = {
+		.is_cancelled = options->is_cancelled,
+		.ctx = options->cancel_ctx,
+		.countdown = 1
+	};
+	struct cancel *cancel = hook.is_cancelled != NULL ? &hook : NULL;
+
+	if (options->profile != NULL) {
+		return run(program, io, options->profile, options->position,
+			   options->stats, NULL, cancel, input, eof);
+	}
+
+	/* Without room for a table, the program runs as it would without. */
+	struct memo memo;
+	if (options->memo_entries != 0
+	    && memo_create(&memo, program, options->memo_entries) == 0) {
+		struct matsplat_execution_result result =
+			run(program, io, NULL, NULL, options->stats, &memo,
+			    cancel, input, eof);
+		memo_destroy(&memo);
+		return result;
+	}
+
+	/*
+	 * Profiles and memos refer to the instructions of the program, so
+	 * only the other runs execute superinstructions. Without room for
+	 * them, the program runs as it is.
+	 */
+	struct matsplat_program fused;
+	struct matsplat_execution_result result;
+	if (fuse_program(&fused, program) == 0) {
+		if (options->stats != NULL) {
+			result = run(&fused, io, NULL, NULL, options->stats,
+				     NULL, cancel, input, eof);
+		} else if (cancel != NULL) {
+			result = run(&fused, io, NULL, NULL, NULL, NULL,
+				     cancel, input, eof);
+		} else {
+			result = run(&fused, io, NULL, NULL, NULL, NULL, NULL,
+				     input, eof);
+		}
+		free((void *) fused.code);
+		return result;
+	}
+
+	if (options->stats != NULL || cancel != NULL) {
+		return run(program, io, NULL, NULL, options->stats, NULL,
+			   cancel, input, eof);
+	}
+
+	return run(program, io, NULL, NULL, NULL, NULL, NULL, input, eof);
+}
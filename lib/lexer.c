@@ -15,11 +15,41 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 #include "mattersplatter.h"
 
+/* Sources are only split between threads in chunks of at least this size. */
+#define MIN_CHUNK_SIZE (1 << 20)
+#define MAX_THREADS 64
+
+/*
+ * A slice of the source tokenized by one thread. The source is read twice:
+ * once to count the tokens and lines of every chunk, which tells each chunk
+ * where its tokens go and what position its first token has, and once to
+ * write the tokens.
+ */
+struct chunk {
+	const char *src_code;
+	size_t begin;
+	size_t end;
+	bool is_writing;
+	/* Counted by the first pass. */
+	size_t tokens;
+	uintmax_t newlines;
+	/* Tokens after the last newline, or all of them without a newline. */
+	uintmax_t trailing;
+	/* Where the second pass writes, and the position it starts at. */
+	struct matsplat_src_token *out;
+	uintmax_t column;
+	uintmax_t row;
+};
+
 static enum matsplat_token
 check_token_type(char c)
 {
@@ -95,16 +125,18 @@ matsplat_token_to_human_readable(const enum matsplat_token type)
 	}
 }
 
-struct matsplat_tokenize_result
-matsplat_tokenize(const char *src_code, const size_t len)
+static void *
+tokenize_chunk(void *arg)
 {
-	uintmax_t col = 0;
-	uintmax_t row = 1;
+	struct chunk *chunk = arg;
+	const char *src_code = chunk->src_code;
+	uintmax_t col = chunk->column;
+	uintmax_t row = chunk->row;
 	size_t tokens_idx = 0;
-	struct matsplat_tokenize_result result = { .len = 0,
-		 .tokens = calloc(1, sizeof(struct matsplat_src_token)) };
 
-	for (size_t i = 0; i <= len; i++) {
+	chunk->newlines = 0;
+	chunk->trailing = 0;
+	for (size_t i = chunk->begin; i < chunk->end; i++) {
 		char c = src_code[i];
 		enum matsplat_token t = check_token_type(c);
 
@@ -112,17 +144,106 @@ matsplat_tokenize(const char *src_code, const size_t len)
 			if (c == '\n' || (c == '\r' && src_code[i + 1] == '\n')) {
 				col++;
 				row = 1;
+				chunk->newlines++;
+				chunk->trailing = 0;
 			}
 		} else {
-			struct matsplat_src_token new_token = {.type = t, .column = col, .row = row};
-			result.len += 1;
-			result.tokens = realloc(result.tokens,
-				result.len * sizeof(struct matsplat_src_token));
-			result.tokens[tokens_idx] = new_token;
+			if (chunk->is_writing) {
+				struct matsplat_src_token new_token = {
+					.type = t, .column = col, .row = row
+				};
+				chunk->out[tokens_idx] = new_token;
+			}
 			tokens_idx++;
 			row++;
+			chunk->trailing++;
+		}
+	}
+
+	chunk->tokens = tokens_idx;
+	return NULL;
+}
+
+/*
+ * Runs `tokenize_chunk` on every chunk, on a thread of its own for all but the
+ * first. Chunks whose thread cannot be started run on the calling thread.
+ */
+static void
+tokenize_chunks(struct chunk *chunks, const size_t chunk_count)
+{
+	pthread_t threads[MAX_THREADS];
+	bool is_started[MAX_THREADS] = {false};
+
+	for (size_t i = 1; i < chunk_count; i++) {
+		is_started[i] = pthread_create(&threads[i], NULL,
+					       tokenize_chunk, &chunks[i]) == 0;
+	}
+	tokenize_chunk(&chunks[0]);
+	for (size_t i = 1; i < chunk_count; i++) {
+		if (is_started[i]) {
+			pthread_join(threads[i], NULL);
+		} else {
+			tokenize_chunk(&chunks[i]);
 		}
 	}
+}
+
+struct matsplat_tokenize_result
+matsplat_tokenize(const char *src_code, const size_t len)
+{
+	struct matsplat_tokenize_result result = { .len = 0, .tokens = NULL };
+	struct chunk chunks[MAX_THREADS];
+	/* The terminating character is tokenized too. */
+	const size_t size = len + 1;
+
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t chunk_count = size / MIN_CHUNK_SIZE;
+	if (cpus > 0 && chunk_count > (size_t) cpus) {
+		chunk_count = (size_t) cpus;
+	}
+	if (chunk_count > MAX_THREADS) {
+		chunk_count = MAX_THREADS;
+	} else if (chunk_count == 0) {
+		chunk_count = 1;
+	}
+
+	for (size_t i = 0; i < chunk_count; i++) {
+		chunks[i] = (struct chunk) {
+			.src_code = src_code,
+			.begin = size / chunk_count * i,
+			.end = i == chunk_count - 1 ? size
+				: size / chunk_count * (i + 1),
+			.column = 0,
+			.row = 1
+		};
+	}
+	tokenize_chunks(chunks, chunk_count);
+
+	/* Every chunk starts where the chunks before it left off. */
+	uintmax_t col = 0;
+	uintmax_t row = 1;
+	for (size_t i = 0; i < chunk_count; i++) {
+		chunks[i].column = col;
+		chunks[i].row = row;
+		chunks[i].is_writing = true;
+		col += chunks[i].newlines;
+		row = (chunks[i].newlines > 0 ? 1 : row) + chunks[i].trailing;
+		result.len += chunks[i].tokens;
+	}
+
+	result.tokens = malloc(result.len * sizeof(*result.tokens));
+	if (result.tokens == NULL) {
+		result.len = 0;
+		return result;
+	}
+
+	struct matsplat_src_token *out = result.tokens;
+	for (size_t i = 0; i < chunk_count; i++) {
+		chunks[i].out = out;
+		out += chunks[i].tokens;
+	}
+	tokenize_chunks(chunks, chunk_count);
+
 	return result;
 }
 
@@ -0,0 +1,263 @@
+/*
+ * Mattersplatter - a compiler & interpreter for the Brainf*ck language.
+ * Copyright (C) 2021 Maxwell R. Haley
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mattersplatter.h"
+
+#define PROFILE_MAGIC "MSPROF"
+#define PROFILE_VERSION 1
+/* Profiles saved by instrumented programs, with binary records. */
+#define PROFILE_COMPILED_VERSION 2
+/* A loop's position and counts, as saved by an instrumented program. */
+#define PROFILE_COMPILED_LOOP_SIZE (2 * sizeof(uint32_t) + 2 * sizeof(uint64_t))
+
+static int
+compare_positions(const struct matsplat_source_position a,
+		  const struct matsplat_source_position b)
+{
+	if (a.column != b.column) {
+		return a.column < b.column ? -1 : 1;
+	}
+
+	return (a.row > b.row) - (a.row < b.row);
+}
+
+static int
+compare_loop_counts(const void *a, const void *b)
+{
+	const struct matsplat_loop_count *la = a;
+	const struct matsplat_loop_count *lb = b;
+
+	return compare_positions(la->position, lb->position);
+}
+
+struct matsplat_profile
+matsplat_profile_create(const struct matsplat_program *program,
+			const uint64_t *counts)
+{
+	struct matsplat_profile profile = {0};
+	size_t len = 0;
+
+	for (size_t i = 0; i < program->len; i++) {
+		len += program->code[i].op == OP_JUMP_ZERO;
+	}
+
+	profile.loops = calloc(len > 0 ? len : 1, sizeof(*profile.loops));
+	if (profile.loops == NULL) {
+		profile.error_code = errno;
+		return profile;
+	}
+
+	/* Every iteration of a loop ends on its JUMP_NOT_ZERO. */
+	for (size_t i = 0; i < program->len; i++) {
+		const struct matsplat_instruction in = program->code[i];
+		if (in.op == OP_JUMP_ZERO) {
+			profile.loops[profile.len++] =
+				(struct matsplat_loop_count) {
+				.position = program->positions[i],
+				.entries = counts[i],
+				.iterations = counts[in.jump - 1]
+			};
+		}
+	}
+
+	qsort(profile.loops, profile.len, sizeof(*profile.loops),
+	      compare_loop_counts);
+	return profile;
+}
+
+void
+matsplat_profile_destroy(struct matsplat_profile profile)
+{
+	free(profile.loops);
+	profile.loops = NULL;
+	profile.len = 0;
+}
+
+const struct matsplat_loop_count *
+matsplat_profile_find(const struct matsplat_profile *profile,
+		      const struct matsplat_source_position position)
+{
+	const struct matsplat_loop_count key = { .position = position };
+
+	return bsearch(&key, profile->loops, profile->len,
+		       sizeof(*profile->loops), compare_loop_counts);
+}
+
+int
+matsplat_profile_save(const struct matsplat_profile *profile,
+		      const char *path)
+{
+	FILE *f = fopen(path, "w");
+	if (f == NULL) {
+		return errno;
+	}
+
+	fprintf(f, "%s %d\n", PROFILE_MAGIC, PROFILE_VERSION);
+	for (size_t i = 0; i < profile->len; i++) {
+		const struct matsplat_loop_count loop = profile->loops[i];
+		fprintf(f, "%" PRIu32 " %" PRIu32 " %" PRIu64 " %" PRIu64 "\n",
+			loop.position.column, loop.position.row, loop.entries,
+			loop.iterations);
+	}
+
+	if (ferror(f)) {
+		fclose(f);
+		return EIO;
+	}
+
+	if (fclose(f) == EOF) {
+		return errno;
+	}
+
+	return 0;
+}
+
+/* Reads the loop counts of a profile saved as text, one loop per line. */
+static int
+load_text(FILE *f, struct matsplat_profile *loaded)
+{
+	struct matsplat_loop_count loop;
+	size_t cap = 0;
+
+	while (fscanf(f, "%" SCNu32 " %" SCNu32 " %" SCNu64 " %" SCNu64,
+		      &loop.position.column, &loop.position.row,
+		      &loop.entries, &loop.iterations) == 4) {
+		if (loaded->len == cap) {
+			cap = cap == 0 ? 64 : cap * 2;
+			struct matsplat_loop_count *loops =
+				realloc(loaded->loops, cap * sizeof(*loops));
+			if (loops == NULL) {
+				return errno;
+			}
+			loaded->loops = loops;
+		}
+		loaded->loops[loaded->len++] = loop;
+	}
+
+	return feof(f) ? 0 : EINVAL;
+}
+
+/*
+ * Reads the loop counts saved by an instrumented program, after the header
+ * line: the amount of loops, the position of every loop, then the entries and
+ * iterations of every loop, all in native byte order.
+ */
+static int
+load_compiled(FILE *f, struct matsplat_profile *loaded)
+{
+	uint64_t len;
+	long start;
+	long end;
+
+	if (fgetc(f) != '\n' || fread(&len, sizeof(len), 1, f) != 1) {
+		return EINVAL;
+	}
+
+	if ((start = ftell(f)) == -1 || fseek(f, 0L, SEEK_END) == -1
+	    || (end = ftell(f)) == -1 || fseek(f, start, SEEK_SET) == -1) {
+		return errno;
+	}
+
+	/* Check the size first, so a corrupt count allocates nothing. */
+	const uint64_t size = end - start;
+	if (len != size / PROFILE_COMPILED_LOOP_SIZE
+	    || size % PROFILE_COMPILED_LOOP_SIZE != 0) {
+		return EINVAL;
+	}
+
+	loaded->loops = calloc(len > 0 ? len : 1, sizeof(*loaded->loops));
+	if (loaded->loops == NULL) {
+		return errno;
+	}
+
+	for (uint64_t i = 0; i < len; i++) {
+		uint32_t position[2];
+		if (fread(position, sizeof(uint32_t), 2, f) != 2) {
+			return EINVAL;
+		}
+		loaded->loops[i].position = (struct matsplat_source_position) {
+			.column = position[0],
+			.row = position[1]
+		};
+	}
+
+	for (uint64_t i = 0; i < len; i++) {
+		uint64_t counts[2];
+		if (fread(counts, sizeof(uint64_t), 2, f) != 2) {
+			return EINVAL;
+		}
+		loaded->loops[i].entries = counts[0];
+		loaded->loops[i].iterations = counts[1];
+	}
+
+	loaded->len = len;
+	return 0;
+}
+
+int
+matsplat_profile_load(const char *path, struct matsplat_profile *profile)
+{
+	struct matsplat_profile loaded = {0};
+	char magic[sizeof(PROFILE_MAGIC)];
+	int version;
+	int err = 0;
+
+	FILE *f = fopen(path, "r");
+	if (f == NULL) {
+		return errno;
+	}
+
+	if (fscanf(f, "%6s %d", magic, &version) != 2
+	    || strcmp(magic, PROFILE_MAGIC) != 0) {
+		err = EINVAL;
+		goto load_error;
+	}
+
+	if (version == PROFILE_VERSION) {
+		err = load_text(f, &loaded);
+	} else if (version == PROFILE_COMPILED_VERSION) {
+		err = load_compiled(f, &loaded);
+	} else {
+		err = ENOTSUP;
+	}
+	if (err != 0) {
+		goto load_error;
+	}
+
+	/*
+	 * Text profiles may have been edited by hand, and instrumented
+	 * programs save their loops in program order.
+	 */
+	qsort(loaded.loops, loaded.len, sizeof(*loaded.loops),
+	      compare_loop_counts);
+	fclose(f);
+	*profile = loaded;
+	return 0;
+
+load_error:
+	free(loaded.loops);
+	fclose(f);
+	return err;
+}
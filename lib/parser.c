@@ -22,46 +22,60 @@
 
 void
 matsplat_ast_destroy(struct matsplat_node *ast) {
-	if (ast->left_child) {
-		matsplat_ast_destroy(ast->left_child);
-	}
-
-	if (ast->right_child) {
-		matsplat_ast_destroy(ast->right_child);
-	}
-
+	/* Every node of the tree lives in the array the root starts. */
 	free(ast);
 }
 
-static struct matsplat_node
-*ast_create(struct matsplat_src_token *tokens, size_t len, size_t *pos)
+/*
+ * Node `i` of the tree is made from token `i`. A node continues with the next
+ * token, a loop with its body, and the end of a loop returns to what follows
+ * the loop. Open loops are kept on a stack linked through their right child,
+ * which is only set for real once they are closed. An unmatched end of a loop
+ * ends the tree.
+ */
+struct matsplat_node
+*matsplat_ast_create(struct matsplat_src_token *tokens, size_t len)
 {
-	if (*pos >= len) {
+	if (len == 0) {
+		return NULL;
+	}
+
+	struct matsplat_node *nodes = calloc(len, sizeof(*nodes));
+	if (nodes == NULL) {
 		return NULL;
 	}
-	struct matsplat_src_token *t = &tokens[*pos];
-	struct matsplat_node *node =
-		(struct matsplat_node*) calloc(1, sizeof(struct matsplat_node));
-	node->token = t;
-	node->left_child = NULL;
-	node->right_child = NULL;
 
-	*pos += 1;
-	if (t->type == JUMP_FORWARD) {
-		node->left_child = ast_create(tokens, len, pos);
-		node->right_child = ast_create(tokens, len, pos);
-		return node;
-	} else if (t->type == JUMP_BACKWARDS) {
-		return node;
-	} else {
-		node->right_child = ast_create(tokens, len, pos);
-		return node;
+	struct matsplat_node *open = NULL;
+	struct matsplat_node **next = NULL;
+	for (size_t i = 0; i < len; i++) {
+		struct matsplat_node *node = &nodes[i];
+		node->token = &tokens[i];
+		if (next != NULL) {
+			*next = node;
+		}
+
+		if (tokens[i].type == JUMP_FORWARD) {
+			node->right_child = open;
+			open = node;
+			next = &node->left_child;
+		} else if (tokens[i].type == JUMP_BACKWARDS) {
+			if (open == NULL) {
+				break;
+			}
+			struct matsplat_node *loop = open;
+			open = loop->right_child;
+			loop->right_child = NULL;
+			next = &loop->right_child;
+		} else {
+			next = &node->right_child;
+		}
 	}
-}
 
-struct matsplat_node
-*matsplat_ast_create(struct matsplat_src_token *tokens, size_t len)
-{
-	size_t pos = 0;
-	return ast_create(tokens, len, &pos);
+	while (open != NULL) {
+		struct matsplat_node *loop = open;
+		open = loop->right_child;
+		loop->right_child = NULL;
+	}
+
+	return nodes;
 }
@@ -0,0 +1,497 @@
+/*
+ * Mattersplatter - a compiler & interpreter for the Brainf*ck language.
+ * Copyright (C) 2021 Maxwell R. Haley
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mattersplatter.h"
+#include "translator.h"
+
+/* Bytes of output and input buffered by standalone programs. */
+#define IO_BUFFER_SIZE 4096
+
+struct translator {
+	const struct matsplat_program *program;
+	bool is_kernel;
+	/*
+	 * Set while translating the copy of a kernel for tapes that offsets may
+	 * wrap around more than once.
+	 */
+	bool is_wrapping;
+	/* Index of the last cell returned by `cell_index`. */
+	char index[48];
+	char *text;
+	size_t len;
+	size_t capacity;
+	int error_code;
+};
+
+/*
+ * Helpers shared by every translation. `at` is the index of the cell `offset`
+ * cells away from `p`, for offsets smaller than the tape, and `wrap` the same
+ * for offsets of any size. Scans stop on the first zero cell, stepping by
+ * `stride` cells, and never return if there is none, like the loops they
+ * replace. Scans by one cell skip a word of cells at a time while the word has
+ * no zero: `memchr` does that moving right, and a bit trick moving left.
+ */
+static const char *const helpers =
+	"#include <stddef.h>\n"
+	"#include <stdint.h>\n"
+	"#include <string.h>\n"
+	"\n"
+	"static inline size_t\n"
+	"at(const size_t p, const int64_t offset, const size_t n)\n"
+	"{\n"
+	"\tif (offset >= 0) {\n"
+	"\t\tconst size_t index = p + (size_t) offset;\n"
+	"\t\treturn index >= n ? index - n : index;\n"
+	"\t}\n"
+	"\tconst size_t distance = (size_t) -offset;\n"
+	"\treturn p >= distance ? p - distance : p + n - distance;\n"
+	"}\n"
+	"\n"
+	"static inline size_t\n"
+	"wrap(const size_t p, const int64_t offset, const size_t n)\n"
+	"{\n"
+	"\tconst size_t distance = (size_t) (offset < 0 ? -offset : offset) "
+	"% n;\n"
+	"\treturn at(p, offset < 0 ? -(int64_t) distance "
+	": (int64_t) distance, n);\n"
+	"}\n"
+	"\n"
+	"static inline size_t\n"
+	"scan_right(const uint8_t *t, size_t p, const size_t stride, "
+	"const size_t n)\n"
+	"{\n"
+	"\twhile (stride == 1) {\n"
+	"\t\tconst uint8_t *zero = memchr(t + p, 0, n - p);\n"
+	"\t\tif (zero != NULL) {\n"
+	"\t\t\treturn (size_t) (zero - t);\n"
+	"\t\t}\n"
+	"\t\tp = 0;\n"
+	"\t}\n"
+	"\twhile (t[p] != 0) {\n"
+	"\t\tp = at(p, (int64_t) stride, n);\n"
+	"\t}\n"
+	"\treturn p;\n"
+	"}\n"
+	"\n"
+	"static inline size_t\n"
+	"scan_left(const uint8_t *t, size_t p, const size_t stride, "
+	"const size_t n)\n"
+	"{\n"
+	"\twhile (t[p] != 0) {\n"
+	"\t\tuint64_t word;\n"
+	"\t\tif (stride == 1 && p >= 8) {\n"
+	"\t\t\tmemcpy(&word, t + p - 8, 8);\n"
+	"\t\t\tif (((word - 0x0101010101010101u) & ~word\n"
+	"\t\t\t     & 0x8080808080808080u) == 0) {\n"
+	"\t\t\t\tp -= 8;\n"
+	"\t\t\t\tcontinue;\n"
+	"\t\t\t}\n"
+	"\t\t}\n"
+	"\t\tp = at(p, -(int64_t) stride, n);\n"
+	"\t}\n"
+	"\treturn p;\n"
+	"}\n"
+	"\n";
+
+/*
+ * I/O of a standalone program. Output is buffered, and flushed when the buffer
+ * fills up, before reading, and when the program ends, so prompts show before
+ * the program waits for input. Input is read a buffer at a time, and leaves
+ * the cell as is on EOF.
+ */
+static const char *const standalone_io =
+	"#include <unistd.h>\n"
+	"\n"
+	"static uint8_t output[%d];\n"
+	"static size_t output_len;\n"
+	"static uint8_t input[%d];\n"
+	"static size_t input_len;\n"
+	"static size_t input_at;\n"
+	"\n"
+	"static void\n"
+	"flush(void)\n"
+	"{\n"
+	"\tsize_t written = 0;\n"
+	"\twhile (written < output_len) {\n"
+	"\t\tconst ssize_t len = write(1, output + written, "
+	"output_len - written);\n"
+	"\t\tif (len <= 0) {\n"
+	"\t\t\tbreak;\n"
+	"\t\t}\n"
+	"\t\twritten += (size_t) len;\n"
+	"\t}\n"
+	"\toutput_len = 0;\n"
+	"}\n"
+	"\n"
+	"static inline void\n"
+	"put(const uint8_t c)\n"
+	"{\n"
+	"\tif (output_len == sizeof(output)) {\n"
+	"\t\tflush();\n"
+	"\t}\n"
+	"\toutput[output_len++] = c;\n"
+	"}\n"
+	"\n"
+	"static inline void\n"
+	"get(uint8_t *cell)\n"
+	"{\n"
+	"\tif (input_at == input_len) {\n"
+	"\t\tflush();\n"
+	"\t\tconst ssize_t len = read(0, input, sizeof(input));\n"
+	"\t\tif (len <= 0) {\n"
+	"\t\t\treturn;\n"
+	"\t\t}\n"
+	"\t\tinput_len = (size_t) len;\n"
+	"\t\tinput_at = 0;\n"
+	"\t}\n"
+	"\t*cell = input[input_at++];\n"
+	"}\n"
+	"\n"
+	"static uint8_t tape[%zu];\n"
+	"\n"
+	"int\n"
+	"main(void)\n"
+	"{\n"
+	"\tuint8_t *const t = tape;\n"
+	"\tconst size_t n = sizeof(tape);\n"
+	"\tsize_t p = 0;\n"
+	"\n";
+
+/* I/O of a kernel, through the caller's `matsplat_io_callbacks`. */
+static const char *const kernel_io =
+	"struct matsplat_io_callbacks {\n"
+	"\tint (*read)(void *ctx);\n"
+	"\tint (*write)(int c, void *ctx);\n"
+	"\tvoid *ctx;\n"
+	"};\n"
+	"\n"
+	"static inline void\n"
+	"get(uint8_t *cell, struct matsplat_io_callbacks *io)\n"
+	"{\n"
+	"\tconst int c = io->read(io->ctx);\n"
+	"\tif (c >= 0) {\n"
+	"\t\t*cell = (uint8_t) c;\n"
+	"\t}\n"
+	"}\n"
+	"\n"
+	"int\n"
+	"bf_run(uint8_t *tape, size_t n, struct matsplat_io_callbacks *io);\n"
+	"\n";
+
+/* Head of a copy of a kernel, named after the tapes it runs on. */
+static const char *const kernel_copy =
+	"static int\n"
+	"%s(uint8_t *const t, const size_t n, "
+	"struct matsplat_io_callbacks *io)\n"
+	"{\n"
+	"\tsize_t p = 0;\n"
+	"\n";
+
+/* Appends formatted text, indented by `depth` tabs. */
+static void
+emitf(struct translator *tr, const size_t depth, const char *format, ...)
+{
+	va_list args;
+
+	if (tr->error_code != 0) {
+		return;
+	}
+
+	va_start(args, format);
+	int len = vsnprintf(NULL, 0, format, args);
+	va_end(args);
+	if (len < 0) {
+		tr->error_code = EOVERFLOW;
+		return;
+	}
+
+	const size_t needed = tr->len + depth + len + 1;
+	if (needed > tr->capacity) {
+		size_t capacity = tr->capacity > 0 ? tr->capacity * 2 : 4096;
+		while (capacity < needed) {
+			capacity *= 2;
+		}
+
+		char *text = realloc(tr->text, capacity);
+		if (text == NULL) {
+			tr->error_code = errno;
+			return;
+		}
+		tr->text = text;
+		tr->capacity = capacity;
+	}
+
+	memset(tr->text + tr->len, '\t', depth);
+	tr->len += depth;
+	va_start(args, format);
+	vsnprintf(tr->text + tr->len, len + 1, format, args);
+	va_end(args);
+	tr->len += len;
+}
+
+/*
+ * Returns the index of the cell `offset` cells away from the pointer, as a C
+ * expression. Cells flagged in bounds need no wrap, except in the copy of a
+ * kernel for small tapes.
+ */
+static const char *
+cell_index(struct translator *tr, const int64_t offset,
+	   const bool is_in_bounds)
+{
+	if (offset == 0) {
+		return "p";
+	} else if (tr->is_wrapping) {
+		snprintf(tr->index, sizeof(tr->index),
+			 "wrap(p, %" PRId64 ", n)", offset);
+	} else if (is_in_bounds) {
+		snprintf(tr->index, sizeof(tr->index), "p %c %" PRId64,
+			 offset < 0 ? '-' : '+', offset < 0 ? -offset : offset);
+	} else {
+		snprintf(tr->index, sizeof(tr->index), "at(p, %" PRId64 ", n)",
+			 offset);
+	}
+
+	return tr->index;
+}
+
+/* Translates an addition of `arg` to the cell at `index`. */
+static void
+translate_add(struct translator *tr, const size_t depth, const char *index,
+	      const int32_t arg)
+{
+	emitf(tr, depth, "t[%s] %c= %" PRId64 ";\n", index,
+	      arg < 0 ? '-' : '+', arg < 0 ? -(int64_t) arg : arg);
+}
+
+static size_t
+translate_range(struct translator *tr, size_t begin, const size_t end,
+		const size_t depth);
+
+/*
+ * Translates the loop starting at `jz`. The trip count of a counted loop is
+ * worked out from its cell on entry, so its body runs without testing the
+ * cell. The copy of a kernel for small tapes cannot tell the cells of the
+ * body apart from the cell of the loop, so it tests the cell.
+ */
+static void
+translate_loop(struct translator *tr, const size_t jz, const size_t depth)
+{
+	const struct matsplat_instruction in = tr->program->code[jz];
+
+	if (in.arg != 0 && !tr->is_wrapping) {
+		emitf(tr, depth,
+		      "for (uint8_t count_%zu = (uint8_t) (t[p] * %" PRIu8
+		      "); count_%zu != 0; count_%zu--) {\n",
+		      depth, (uint8_t) in.arg, depth, depth);
+	} else {
+		emitf(tr, depth, "while (t[p] != 0) {\n");
+	}
+	translate_range(tr, jz + 1, in.jump - 1, depth + 1);
+	emitf(tr, depth, "}\n");
+}
+
+/* Translates the sweep at `at`, whose body is the ADDs that follow it. */
+static void
+translate_sweep(struct translator *tr, const size_t at, const size_t depth)
+{
+	const struct matsplat_instruction *code = tr->program->code;
+
+	emitf(tr, depth, "while (t[p] != 0) {\n");
+	for (size_t i = at + 1; i < code[at].jump; i++) {
+		translate_add(tr, depth + 1, cell_index(tr, code[i].offset,
+							false),
+			      code[i].arg);
+	}
+	emitf(tr, depth + 1, "p = %s;\n", cell_index(tr, code[at].arg, false));
+	emitf(tr, depth, "}\n");
+}
+
+/*
+ * Translates the instructions from `begin` up to `end`, not included. Returns
+ * the index of the instruction following the last one translated.
+ */
+static size_t
+translate_range(struct translator *tr, size_t begin, const size_t end,
+		const size_t depth)
+{
+	const struct matsplat_instruction *code = tr->program->code;
+	const char *index;
+
+	while (begin < end) {
+		const struct matsplat_instruction in = code[begin];
+		const bool is_in_bounds = in.flags & MATSPLAT_IN_BOUNDS;
+
+		switch (in.op) {
+			case OP_ADD:
+				translate_add(tr, depth,
+					      cell_index(tr, in.offset,
+							 is_in_bounds),
+					      in.arg);
+				break;
+			case OP_MOVE:
+				emitf(tr, depth, "p = %s;\n",
+				      cell_index(tr, in.arg, is_in_bounds));
+				break;
+			case OP_SCAN:
+				if (tr->is_wrapping) {
+					emitf(tr, depth,
+					      "while (t[p] != 0) {\n");
+					emitf(tr, depth + 1, "p = %s;\n",
+					      cell_index(tr, in.arg, false));
+					emitf(tr, depth, "}\n");
+				} else {
+					emitf(tr, depth,
+					      "p = scan_%s(t, p, %" PRId64
+					      ", n);\n",
+					      in.arg < 0 ? "left" : "right",
+					      in.arg < 0 ? -(int64_t) in.arg
+					      : in.arg);
+				}
+				break;
+			case OP_SWEEP:
+				translate_sweep(tr, begin, depth);
+				begin = in.jump;
+				continue;
+			case OP_SET:
+				emitf(tr, depth, "t[%s] = %" PRIu8 ";\n",
+				      cell_index(tr, in.offset, is_in_bounds),
+				      (uint8_t) in.arg);
+				break;
+			case OP_MUL:
+				index = cell_index(tr, in.offset, is_in_bounds);
+				if (in.arg == 1 || in.arg == -1) {
+					emitf(tr, depth, "t[%s] %c= t[p];\n",
+					      index, in.arg < 0 ? '-' : '+');
+				} else {
+					emitf(tr, depth,
+					      "t[%s] += t[p] * %" PRIu8 ";\n",
+					      index, (uint8_t) in.arg);
+				}
+				break;
+			case OP_OUTPUT:
+				index = cell_index(tr, in.offset, is_in_bounds);
+				if (tr->is_kernel) {
+					emitf(tr, depth,
+					      "if (io->write(t[%s], io->ctx) "
+					      "< 0) {\n", index);
+					emitf(tr, depth + 1, "return -1;\n");
+					emitf(tr, depth, "}\n");
+				} else {
+					emitf(tr, depth, "put(t[%s]);\n",
+					      index);
+				}
+				break;
+			case OP_INPUT:
+				emitf(tr, depth, "get(&t[%s]%s);\n",
+				      cell_index(tr, in.offset, is_in_bounds),
+				      tr->is_kernel ? ", io" : "");
+				break;
+			case OP_JUMP_ZERO:
+				translate_loop(tr, begin, depth);
+				begin = in.jump;
+				continue;
+			case OP_END:
+			case OP_JUMP_NOT_ZERO:
+			default:
+				/*
+				 * Translated along with their JUMP_ZERO, and at
+				 * the end of the function.
+				 */
+				break;
+		}
+
+		begin++;
+	}
+
+	return begin;
+}
+
+/* Translates a copy of a kernel into the function `name`. */
+static void
+translate_kernel_copy(struct translator *tr, const char *name)
+{
+	emitf(tr, 0, kernel_copy, name);
+	translate_range(tr, 0, tr->program->len, 1);
+	emitf(tr, 0, "\n");
+	emitf(tr, 1, "return 0;\n");
+	emitf(tr, 0, "}\n\n");
+}
+
+struct matsplat_compilation_result
+translate_program(const struct matsplat_program *program,
+		  const struct matsplat_compile_options *options,
+		  const uint64_t reach)
+{
+	struct matsplat_compilation_result result =
+		{.source_code = NULL, .source_code_len = 0, .error_code = 0};
+	struct translator tr = {
+		.program = program,
+		.is_kernel = options->entry_point == MATSPLAT_ENTRY_KERNEL
+	};
+
+	emitf(&tr, 0, "%s", helpers);
+
+	if (!tr.is_kernel) {
+		emitf(&tr, 0, standalone_io, IO_BUFFER_SIZE, IO_BUFFER_SIZE,
+		      options->cell_count);
+		translate_range(&tr, 0, program->len, 1);
+		emitf(&tr, 0, "\n");
+		emitf(&tr, 1, "flush();\n");
+		emitf(&tr, 1, "return 0;\n");
+		emitf(&tr, 0, "}\n");
+	} else {
+		/*
+		 * Like the NASM kernel, the program is translated twice: once
+		 * for tapes larger than any offset, and once for the others.
+		 */
+		emitf(&tr, 0, "%s", kernel_io);
+		translate_kernel_copy(&tr, "run");
+		tr.is_wrapping = true;
+		translate_kernel_copy(&tr, "run_wrapping");
+		emitf(&tr, 0,
+		      "int\n"
+		      "bf_run(uint8_t *tape, size_t n, "
+		      "struct matsplat_io_callbacks *io)\n"
+		      "{\n"
+		      "\tif (n == 0) {\n"
+		      "\t\treturn -1;\n"
+		      "\t}\n"
+		      "\treturn n > %" PRIu64 " ? run(tape, n, io) "
+		      ": run_wrapping(tape, n, io);\n"
+		      "}\n",
+		      reach);
+	}
+
+	if (tr.error_code != 0) {
+		free(tr.text);
+		result.error_code = tr.error_code;
+		return result;
+	}
+
+	result.source_code = tr.text;
+	result.source_code_len = tr.len;
+	return result;
+}
@@ -18,6 +18,7 @@
 #define _POSIX_C_SOURCE 200809L
 #include <assert.h>
 #include <errno.h>
+#include <getopt.h>
 #include <inttypes.h>
 #include <libgen.h>
 #include <limits.h>
@@ -28,89 +29,244 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
 
 #include <mattersplatter.h>
 
+#include "counters.h"
+#include "engine.h"
+#include "profile.h"
+#include "server.h"
+#include "stats.h"
+
+/* Entries of the memo table of --memo, when no size is given. */
+#define MEMO_ENTRIES 65536
+
+/* Where the runtime of bundles is installed, unless it lies next to us. */
+#ifndef MATSPLAT_RUNTIME
+#define MATSPLAT_RUNTIME "/usr/local/libexec/mattersplatter-runtime"
+#endif
+
 static const char *usage_msg =
-	"Usage: mattersplatter [-o outfile] [-m size] [-v] [-d] filename\n"
-	"       mattersplatter -b [-m size] [-v] [-d] filename\n"
+	"Usage: mattersplatter [-o outfile] [-f format] [-t target] [-P profile]\n"
+	"                      [-m size] [-n] [-v] [-d] [--stats[=json]]\n"
+	"                      [--instrument[=profile]] filename\n"
+	"       mattersplatter -b [-p] [-o outfile] [-m size] [-n] [-v] [-d]\n"
+	"                      [-i infile] [--eof value] [--stats[=json]]\n"
+	"                      [--counters] [--memo[=entries]] [--engine name]\n"
+	"                      filename\n"
+	"       mattersplatter -c [-o outfile] [-m size] [-v] [-d] filename\n"
+	"       mattersplatter --serve socket [--workers count] [-m size] [-n] [-v]\n"
 	"       mattersplatter -h\n"
 	"\n"
 	"       -b        \tRun in batch mode.\n"
+	"       -c        \tWrite optimized bytecode to outfile.\n"
 	"       -d        \tShow debug output.\n"
+	"       -f format \tOutput an exe, obj or shared library [exe].\n"
 	"       -h        \tDisplay this message.\n"
+	"       -i infile \tRead the input from infile in batch mode.\n"
 	"       -m size   \tSet the amount of memory cells to size [30000].\n"
+	"       -n        \tDo not use the compilation cache.\n"
 	"       -o outfile\tWrite output to outfile.\n"
-	"       -v        \tShow verbose output.";
+	"       -p        \tProfile loops in batch mode.\n"
+	"       -P profile\tOptimize loops using a profile of -p or --instrument.\n"
+	"       -t target \tGenerate nasm assembly, c or a bundle [nasm].\n"
+	"       -v        \tShow verbose output.\n"
+	"       --serve socket\tServe execution requests on a Unix socket.\n"
+	"       --workers count\tExecute up to count requests at once [cpus].\n"
+	"       --stats[=json]\tReport the cost of every phase to stderr.\n"
+	"       --counters\tCount hardware events in batch mode.\n"
+	"       --memo[=entries]\tMemoize nested loops in batch mode [65536].\n"
+	"       --eof value\tStore 0 or -1 on EOF in batch mode [unchanged].\n"
+	"       --engine name\tRun on bytecode, native code or auto [auto].\n"
+	"       --instrument[=profile]\tSave loop counts when the executable ends.";
 
 enum  options_result {
 OPTIONS_OK,
 OPTIONS_NO_FILE,
 OPTIONS_FILE_TOO_LONG,
 OPTIONS_OUT_FILE_TOO_LONG,
+OPTIONS_PROFILE_TOO_LONG,
 OPTIONS_MISSING_ARG,
 OPTIONS_UNKNOWN_ARG,
-OPTIONS_INVALID_MEMORY_SIZE
+OPTIONS_INVALID_MEMORY_SIZE,
+OPTIONS_INVALID_FORMAT,
+OPTIONS_INVALID_TARGET,
+OPTIONS_INVALID_WORKERS,
+OPTIONS_INVALID_STATS,
+OPTIONS_INVALID_INSTRUMENT,
+OPTIONS_INVALID_MEMO,
+OPTIONS_INVALID_BUNDLE,
+OPTIONS_INVALID_EOF,
+OPTIONS_INVALID_ENGINE,
+OPTIONS_NATIVE_CONFLICT,
 };
 
 enum options_mode {
 MODE_COMPILER,
 MODE_INTERPRETER,
+MODE_BYTECODE,
 MODE_HELP,
+MODE_SERVER,
+};
+
+enum output_format {
+FORMAT_EXECUTABLE,
+FORMAT_OBJECT,
+FORMAT_SHARED,
 };
 
 struct options {
 	char in_file_name[PATH_MAX];
 	char out_file_name[FILENAME_MAX];
+	char profile_file_name[PATH_MAX];
+	char instrument_file_name[PATH_MAX];
+	char input_file_name[PATH_MAX];
 	bool is_verbose;
 	bool is_debug;
+	bool use_cache;
+	bool is_profiling;
 	enum options_result result;
 	enum options_mode mode;
+	enum output_format format;
+	enum matsplat_target target;
+	bool has_target;
+	bool is_bundling;
 	char wrong_opt;
 	uintmax_t mem_size;
+	const char *socket_path;
+	uintmax_t workers;
+	enum stats_format stats_format;
+	bool use_counters;
+	bool is_instrumenting;
+	uintmax_t memo_entries;
+	enum matsplat_eof eof;
+	enum engine engine;
+	bool needs_interpreter;
+};
+
+/* Long options without a short equivalent. */
+enum long_option {
+LONG_SERVE = 256,
+LONG_WORKERS,
+LONG_STATS,
+LONG_COUNTERS,
+LONG_INSTRUMENT,
+LONG_MEMO,
+LONG_EOF,
+LONG_ENGINE,
 };
 
+static const struct option long_options[] = {
+	{ "serve", required_argument, NULL, LONG_SERVE },
+	{ "workers", required_argument, NULL, LONG_WORKERS },
+	{ "stats", optional_argument, NULL, LONG_STATS },
+	{ "counters", no_argument, NULL, LONG_COUNTERS },
+	{ "instrument", optional_argument, NULL, LONG_INSTRUMENT },
+	{ "memo", optional_argument, NULL, LONG_MEMO },
+	{ "eof", required_argument, NULL, LONG_EOF },
+	{ "engine", required_argument, NULL, LONG_ENGINE },
+	{ NULL, 0, NULL, 0 }
+};
+
+/* Parses a decimal count. Returns false if `arg` is not a valid count. */
+static bool
+parse_count(const char *arg, uintmax_t *count)
+{
+	const char pattern[] = "^[0-9]+$";
+	regex_t regex = {0};
+
+	regcomp(&regex, pattern, REG_EXTENDED | REG_NOSUB);
+	bool is_match = regexec(&regex, arg, 0, NULL, 0) == 0;
+	regfree(&regex);
+	if (!is_match) {
+		return false;
+	}
+
+	errno = 0;
+	*count = strtoumax(arg, NULL, 10);
+	return !(*count == UINTMAX_MAX && errno);
+}
+
+/* Returns true if `name` is an executable in a directory of PATH. */
+static bool
+is_on_path(const char *name)
+{
+	const char *dir = getenv("PATH");
+	char path[PATH_MAX];
+
+	while (dir != NULL && *dir != '\0') {
+		const char *end = strchr(dir, ':');
+		const int len = end != NULL ? (int) (end - dir)
+			: (int) strlen(dir);
+
+		/* Empty directories stand for the current one. */
+		int written = snprintf(path, PATH_MAX, "%.*s/%s",
+				       len > 0 ? len : 1, len > 0 ? dir : ".",
+				       name);
+		if (written > 0 && written < PATH_MAX
+		    && access(path, X_OK) == 0) {
+			return true;
+		}
+		dir = end != NULL ? end + 1 : NULL;
+	}
+
+	return false;
+}
+
 static struct options
 options_create(int argc, char *argv[])
 {
-	struct options o = { .is_verbose = false, .is_debug = false };
+	struct options o = { .is_verbose = false, .is_debug = false,
+			     .use_cache = true };
 	o.mem_size = 30000;
 	o.mode = MODE_COMPILER;
+	o.format = FORMAT_EXECUTABLE;
 	int opt;
-	const char memsize_pattern[] = "^[0-9]+$";
-	regex_t  memsize_regex = {0};
-	while ((opt = getopt(argc, argv, ":bdhm:o:v")) != -1) {
+	while ((opt = getopt_long(argc, argv, ":bcdf:hi:m:no:pP:t:v",
+				  long_options, NULL)) != -1) {
 		switch (opt) {
 			case 'b':
 				o.mode = MODE_INTERPRETER;
 				break;
+			case 'c':
+				o.mode = MODE_BYTECODE;
+				break;
 			case 'd':
 				o.is_debug = true;
 				break;
+			case 'f':
+				if (strcmp(optarg, "exe") == 0) {
+					o.format = FORMAT_EXECUTABLE;
+				} else if (strcmp(optarg, "obj") == 0) {
+					o.format = FORMAT_OBJECT;
+				} else if (strcmp(optarg, "shared") == 0) {
+					o.format = FORMAT_SHARED;
+				} else {
+					o.result = OPTIONS_INVALID_FORMAT;
+					return o;
+				}
+				break;
 			case 'h':
 				o.mode = MODE_HELP;
 				return o;
-			case 'm':
-				regcomp(&memsize_regex,
-					memsize_pattern,
-					REG_EXTENDED | REG_NOSUB);
-				if (regexec(&memsize_regex, optarg, 0, NULL, 0)
-				    != 0) {
-					o.result = OPTIONS_INVALID_MEMORY_SIZE;
-					regfree(&memsize_regex);
+			case 'i':
+				if (strlen(optarg) >= PATH_MAX) {
+					o.result = OPTIONS_FILE_TOO_LONG;
 					return o;
 				}
-				regfree(&memsize_regex);
-				errno = 0;
-				o.mem_size = strtoumax(optarg, NULL, 10);
-				if ((o.mem_size == INTMAX_MAX
-				     || o.mem_size == UINTMAX_MAX) && errno) {
+				strcpy(o.input_file_name, optarg);
+				break;
+			case 'm':
+				if (!parse_count(optarg, &o.mem_size)) {
 					o.result = OPTIONS_INVALID_MEMORY_SIZE;
 					return o;
 				}
-				printf("%lu", o.mem_size);
+				break;
+			case 'n':
+				o.use_cache = false;
 				break;
 			case 'o':
 				if (strlen(optarg) > FILENAME_MAX) {
@@ -120,9 +276,102 @@ options_create(int argc, char *argv[])
 					strncpy(o.out_file_name, optarg, FILENAME_MAX);
 				}
 				break;
+			case 'p':
+				o.mode = MODE_INTERPRETER;
+				o.is_profiling = true;
+				break;
+			case 'P':
+				if (strlen(optarg) >= PATH_MAX) {
+					o.result = OPTIONS_PROFILE_TOO_LONG;
+					return o;
+				}
+				strcpy(o.profile_file_name, optarg);
+				break;
+			case 't':
+				o.has_target = true;
+				o.is_bundling = strcmp(optarg, "bundle") == 0;
+				if (strcmp(optarg, "nasm") == 0) {
+					o.target = MATSPLAT_TARGET_NASM;
+				} else if (strcmp(optarg, "c") == 0) {
+					o.target = MATSPLAT_TARGET_C;
+				} else if (!o.is_bundling) {
+					o.result = OPTIONS_INVALID_TARGET;
+					return o;
+				}
+				break;
 			case 'v':
 				o.is_verbose = true;
 				break;
+			case LONG_SERVE:
+				o.mode = MODE_SERVER;
+				o.socket_path = optarg;
+				break;
+			case LONG_WORKERS:
+				if (!parse_count(optarg, &o.workers)
+				    || o.workers == 0) {
+					o.result = OPTIONS_INVALID_WORKERS;
+					return o;
+				}
+				break;
+			case LONG_STATS:
+				if (optarg == NULL
+				    || strcmp(optarg, "text") == 0) {
+					o.stats_format = STATS_TEXT;
+				} else if (strcmp(optarg, "json") == 0) {
+					o.stats_format = STATS_JSON;
+				} else {
+					o.result = OPTIONS_INVALID_STATS;
+					return o;
+				}
+				break;
+			case LONG_COUNTERS:
+				o.use_counters = true;
+				break;
+			case LONG_INSTRUMENT:
+				o.is_instrumenting = true;
+				if (optarg == NULL) {
+					break;
+				}
+				if (strlen(optarg) >= PATH_MAX) {
+					o.result = OPTIONS_PROFILE_TOO_LONG;
+					return o;
+				}
+				strcpy(o.instrument_file_name, optarg);
+				break;
+			case LONG_EOF:
+				if (strcmp(optarg, "unchanged") == 0) {
+					o.eof = MATSPLAT_EOF_UNCHANGED;
+				} else if (strcmp(optarg, "0") == 0) {
+					o.eof = MATSPLAT_EOF_ZERO;
+				} else if (strcmp(optarg, "-1") == 0) {
+					o.eof = MATSPLAT_EOF_MINUS_ONE;
+				} else {
+					o.result = OPTIONS_INVALID_EOF;
+					return o;
+				}
+				break;
+			case LONG_ENGINE:
+				if (strcmp(optarg, "auto") == 0) {
+					o.engine = ENGINE_AUTO;
+				} else if (strcmp(optarg, "bytecode") == 0) {
+					o.engine = ENGINE_BYTECODE;
+				} else if (strcmp(optarg, "native") == 0) {
+					o.engine = ENGINE_NATIVE;
+				} else {
+					o.result = OPTIONS_INVALID_ENGINE;
+					return o;
+				}
+				break;
+			case LONG_MEMO:
+				o.memo_entries = MEMO_ENTRIES;
+				if (optarg != NULL
+				    && (!parse_count(optarg, &o.memo_entries)
+					|| o.memo_entries == 0
+					|| o.memo_entries > SIZE_MAX)) {
+					o.result = OPTIONS_INVALID_MEMO;
+					return o;
+				}
+				break;
 			case ':':
 				o.result = OPTIONS_MISSING_ARG;
 				o.wrong_opt = optopt;
@@ -136,6 +385,12 @@ options_create(int argc, char *argv[])
 		}
 	}
 
+	/* The server receives its programs over the socket. */
+	if (o.mode == MODE_SERVER) {
+		o.result = OPTIONS_OK;
+		return o;
+	}
+
 	if (argv[optind] == NULL) {
 		o.result = OPTIONS_NO_FILE;
 	} else if (strlen(argv[optind]) >= PATH_MAX) {
@@ -160,6 +415,68 @@ options_create(int argc, char *argv[])
 		} else {
 			strncpy(o.out_file_name, "a.out", FILENAME_MAX);
 		}
+
+		const char *ext = "";
+		if (o.mode == MODE_BYTECODE) {
+			ext = ".bfc";
+		} else if (o.is_profiling) {
+			ext = ".folded";
+		} else if (o.format == FORMAT_OBJECT) {
+			ext = ".o";
+		} else if (o.format == FORMAT_SHARED) {
+			ext = ".so";
+		}
+
+		if (strlen(o.out_file_name) + strlen(ext) < FILENAME_MAX) {
+			strcat(o.out_file_name, ext);
+		}
+	}
+
+	/* Executables are bundled when they cannot be assembled. */
+	if (o.mode == MODE_COMPILER && !o.has_target
+	    && o.format == FORMAT_EXECUTABLE && !o.is_instrumenting
+	    && (!is_on_path("nasm") || !is_on_path("ld"))) {
+		o.is_bundling = true;
+	}
+	o.is_bundling = o.is_bundling && o.mode == MODE_COMPILER;
+	if (o.is_bundling && o.format != FORMAT_EXECUTABLE
+	    && o.result == OPTIONS_OK) {
+		o.result = OPTIONS_INVALID_BUNDLE;
+		return o;
+	}
+
+	/*
+	 * Only the interpreter profiles, counts, memoizes and reads input from
+	 * files, and native code needs NASM and LD.
+	 */
+	o.needs_interpreter = o.is_profiling || o.use_counters
+		|| o.memo_entries != 0 || o.input_file_name[0] != '\0'
+		|| o.eof != MATSPLAT_EOF_UNCHANGED;
+	if (o.engine == ENGINE_NATIVE && o.needs_interpreter
+	    && o.result == OPTIONS_OK) {
+		o.result = OPTIONS_NATIVE_CONFLICT;
+		return o;
+	}
+	if (o.mode == MODE_INTERPRETER && o.engine == ENGINE_AUTO
+	    && (o.needs_interpreter || !is_on_path("nasm")
+		|| !is_on_path("ld"))) {
+		o.engine = ENGINE_BYTECODE;
+	}
+
+	/* Instrumented executables save their loop counts next to them. */
+	if (o.is_instrumenting && o.result == OPTIONS_OK) {
+		if (o.mode != MODE_COMPILER || o.format != FORMAT_EXECUTABLE
+		    || o.target != MATSPLAT_TARGET_NASM || o.is_bundling) {
+			o.result = OPTIONS_INVALID_INSTRUMENT;
+		} else if (o.instrument_file_name[0] == '\0') {
+			if (strlen(o.out_file_name) + strlen(".profile")
+			    >= PATH_MAX) {
+				o.result = OPTIONS_PROFILE_TOO_LONG;
+				return o;
+			}
+			strcpy(o.instrument_file_name, o.out_file_name);
+			strcat(o.instrument_file_name, ".profile");
+		}
 	}
 
 	return o;
@@ -206,13 +523,15 @@ load_file_to_buffer_error:
 	return -1;
 }
 
+/* Writes the generated code to `path`, out.asm or out.c. */
 static size_t
-write_assembly_to_disk(const struct matsplat_compilation_result compr)
+write_source_to_disk(const struct matsplat_compilation_result compr,
+		     const char *path)
 {
 	size_t size;
-	FILE *f = fopen("out.asm", "w");
+	FILE *f = fopen(path, "w");
 	if (f == NULL) {
-		goto write_assembly_to_disk_error;
+		goto write_source_to_disk_error;
 	}
 
 	size = fputs(compr.source_code, f);
@@ -220,21 +539,37 @@ write_assembly_to_disk(const struct matsplat_compilation_result compr)
 	fclose(f);
 	return size;
 
-write_assembly_to_disk_error:
+write_source_to_disk_error:
 	if (f) {
 		fclose(f);
 	}
 	return -1;
 }
 
+/* Verbose and debug output is stamped with the time since this instant. */
+static struct timespec started;
+
+/* Statistics of this run, printed on exit when requested. */
+static struct stats stats;
+
+/* The instruction being executed, sampled on counter overflows. */
+static volatile size_t position;
+
 static void
 print_timestamp()
 {
-	time_t ltm = time(NULL);
-	struct tm *tm = localtime(&ltm);
-	char *stamp = asctime(tm);
-	stamp[strlen(stamp) - 1] = '\0';
-	printf("[%s] ", stamp);
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	printf("[%.6f] ", (double) (now.tv_sec - started.tv_sec)
+	       + (double) (now.tv_nsec - started.tv_nsec) / 1e9);
+}
+
+static void
+print_stats(void)
+{
+	fflush(stdout);
+	stats_print(stderr, &stats);
 }
 
 
@@ -272,6 +607,41 @@ printd_tokens(const struct matsplat_src_token *tokens, const size_t size,
 
 }
 
+static void
+printd_program(const struct matsplat_program *program, struct options opts)
+{
+	static const char *op_names[OP_COUNT] = {
+		[OP_ADD] = "ADD",
+		[OP_MOVE] = "MOVE",
+		[OP_SET] = "SET",
+		[OP_MUL] = "MUL",
+		[OP_OUTPUT] = "OUTPUT",
+		[OP_INPUT] = "INPUT",
+		[OP_JUMP_ZERO] = "JUMP_ZERO",
+		[OP_JUMP_NOT_ZERO] = "JUMP_NOT_ZERO",
+		[OP_END] = "END",
+		[OP_SCAN] = "SCAN",
+		[OP_SWEEP] = "SWEEP",
+	};
+
+	if (opts.is_debug) {
+		print_timestamp();
+		printf("The following is the optimized bytecode.\n");
+		for (size_t i = 0; i < program->len; i++) {
+			struct matsplat_instruction in = program->code[i];
+			printf("Instruction #%zu: %s offset %" PRId32
+			       " arg %" PRId32 " jump %" PRIu32 "%s\n",
+			       i,
+			       op_names[in.op],
+			       in.offset,
+			       in.arg,
+			       in.jump,
+			       in.flags & MATSPLAT_IN_BOUNDS ? " in bounds"
+			       : "");
+		}
+	}
+}
+
 static void
 printf_v(const struct options opts, const char *format,  ...)
 {
@@ -283,10 +653,211 @@ printf_v(const struct options opts, const char *format,  ...)
 	}
 }
 
+/*
+ * Writes the loop counts of a profiled program next to its folded stacks, as
+ * the output file with a `.profile` extension instead of `.folded`.
+ */
+static void
+save_loop_counts(const struct matsplat_program *program, const uint64_t *counts,
+		 const struct options opts)
+{
+	char path[FILENAME_MAX + 16];
+	const char *ext = strrchr(opts.out_file_name, '.');
+	int len = ext != NULL && strcmp(ext, ".folded") == 0
+		? (int) (ext - opts.out_file_name)
+		: (int) strlen(opts.out_file_name);
+
+	snprintf(path, sizeof(path), "%.*s.profile", len, opts.out_file_name);
+
+	struct matsplat_profile profile =
+		matsplat_profile_create(program, counts);
+	int err = profile.error_code;
+	if (err == 0) {
+		err = matsplat_profile_save(&profile, path);
+	}
+	matsplat_profile_destroy(profile);
+
+	if (err != 0) {
+		fprintf(stderr, "Error writing loop counts to %s: %s\n", path,
+			strerror(err));
+	} else {
+		printf_v(opts, "Wrote loop counts to %s.\n", path);
+	}
+}
+
+/*
+ * Reports the hottest loops and instruction sequences of a profiled program to
+ * stderr, and writes its folded stacks to the output file.
+ */
+static void
+report_profile(const struct matsplat_program *program, const uint64_t *counts,
+	       const struct options opts)
+{
+	char in_file[PATH_MAX];
+
+	fflush(stdout);
+	fprintf(stderr, "\nProfile of %s: ", opts.in_file_name);
+	profile_print_hot_loops(stderr, program, counts, 10);
+	fprintf(stderr, "\nHottest sequences of %s:\n", opts.in_file_name);
+	profile_print_hot_sequences(stderr, program, counts, 10);
+
+	strcpy(in_file, opts.in_file_name);
+	int err = profile_write_folded(opts.out_file_name, basename(in_file),
+				       program, counts);
+	if (err != 0) {
+		fprintf(stderr, "Error writing profile to %s: %s\n",
+			opts.out_file_name, strerror(err));
+	} else {
+		printf_v(opts, "Wrote folded stacks to %s.\n",
+			 opts.out_file_name);
+	}
+
+	save_loop_counts(program, counts, opts);
+}
+
+/*
+ * Opens the performance counters of the execution, and samples them per
+ * instruction when profiling. Returns false if no counter could be opened.
+ */
+static bool
+open_counters(struct counters *counters,
+	      struct matsplat_execute_options *eopts,
+	      const struct matsplat_program *program, const struct options opts)
+{
+	if (counters_open(counters, 0, opts.is_profiling) == 0) {
+		fprintf(stderr, "Performance counters are not available: %s\n",
+			strerror(errno));
+		return false;
+	}
+
+	if (opts.is_profiling) {
+		int err = counters_sample(counters, &position, program->len);
+		if (err != 0) {
+			fprintf(stderr, "Error sampling counters: %s\n",
+				strerror(err));
+		} else {
+			eopts->position = &position;
+		}
+	}
+
+	return true;
+}
+
+/* Returns the nanoseconds elapsed since `since`. */
+static uint64_t
+elapsed_ns(const struct timespec *since)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) (now.tv_sec - since->tv_sec) * 1000000000
+		+ (uint64_t) now.tv_nsec - (uint64_t) since->tv_nsec;
+}
+
+/*
+ * Executes a program, then frees it and exits. Unless `history` is NULL, the
+ * execution time is saved to it.
+ */
+static void
+run_program(struct matsplat_program *program, struct engine_history *history,
+	    const struct options opts)
+{
+	struct matsplat_execute_options eopts = {
+		.io = NULL,
+		.memo_entries = opts.memo_entries,
+		.eof = opts.eof
+	};
+	struct matsplat_input input = {0};
+	struct counters counters;
+	struct timespec start;
+	bool is_counting = false;
+
+	if (opts.input_file_name[0] != '\0') {
+		int err = matsplat_input_map(opts.input_file_name, &input);
+		if (err != 0) {
+			fprintf(stderr, "Error reading input %s: %s\n",
+				opts.input_file_name, strerror(err));
+			exit(err);
+		}
+		eopts.input = &input;
+	}
+
+	if (stats.format != STATS_NONE) {
+		eopts.stats = &stats.execution;
+		stats.has_executed = true;
+		stats.instructions = program->len;
+	}
+
+	if (opts.is_profiling) {
+		eopts.profile = calloc(program->len, sizeof(uint64_t));
+		if (eopts.profile == NULL) {
+			fprintf(stderr, "Error profiling: %s", strerror(errno));
+			exit(errno);
+		}
+	}
+
+	if (opts.use_counters) {
+		is_counting = open_counters(&counters, &eopts, program, opts);
+	}
+
+	printf_v(opts, "Executing bytecode (%zu instructions, %zu cells)...\n",
+		 program->len, program->cell_count);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	stats_begin(&stats);
+	if (is_counting) {
+		counters_start(&counters);
+	}
+	struct matsplat_execution_result result =
+		matsplat_program_execute_with_options(program, &eopts);
+	if (is_counting) {
+		counters_stop(&counters);
+	}
+	stats_end(&stats, STATS_EXECUTE);
+	if (result.memory_cells == NULL) {
+		fprintf(stderr, "Error executing: %s\n", strerror(ENOMEM));
+		exit(ENOMEM);
+	}
+	matsplat_execution_result_destory(result);
+
+	if (history != NULL) {
+		history->bytecode_ns = elapsed_ns(&start);
+		int err = engine_history_save(history);
+		if (err != 0) {
+			printf_v(opts, "Could not save run time: %s\n",
+				 strerror(err));
+		}
+	}
+
+	if (opts.is_profiling) {
+		report_profile(program, eopts.profile, opts);
+	}
+
+	if (is_counting) {
+		fflush(stdout);
+		fprintf(stderr, "\nCounters of %s:\n", opts.in_file_name);
+		counters_print(stderr, &counters);
+		if (eopts.position != NULL) {
+			fprintf(stderr, "\nCounters of the hottest loops:\n");
+			profile_print_loop_counters(stderr, program,
+						    eopts.profile, &counters,
+						    10);
+		}
+		counters_close(&counters);
+	}
+
+	free(eopts.profile);
+	matsplat_input_unmap(input);
+
+	matsplat_program_destroy(*program);
+	exit(EXIT_SUCCESS);
+}
+
 enum invoke_assembler_status {
 INVOKE_SUCCESS,
 INVOKE_NASM_FAIL,
 INVOKE_LD_FAIL,
+INVOKE_CC_FAIL,
+INVOKE_CACHE_FAIL,
 };
 
 struct invoke_assembler_result {
@@ -295,11 +866,87 @@ struct invoke_assembler_result {
 	int error_no;
 };
 
+/*
+ * Creates a private directory to build in, under $TMPDIR or /tmp, so that
+ * builds running at once never share their files, and writes its path to
+ * `dir`. Returns 0 on success, or an errno value with `dir` left empty.
+ */
+static int
+make_build_dir(char *dir)
+{
+	const char *tmp = getenv("TMPDIR");
+	int err;
+
+	int written = snprintf(dir, PATH_MAX, "%s/mattersplatter.XXXXXX",
+			       tmp != NULL && tmp[0] == '/' ? tmp : "/tmp");
+	if (written < 0 || written >= PATH_MAX) {
+		err = ENAMETOOLONG;
+	} else if (mkdtemp(dir) == NULL) {
+		err = errno;
+	} else {
+		return 0;
+	}
+
+	dir[0] = '\0';
+	return err;
+}
+
+/* Removes a directory made by `make_build_dir`, with the files built in it. */
+static void
+remove_build_dir(const char *dir)
+{
+	static const char *names[] = {
+		"out.asm", "out.c", "out.o", "out.bin", "out.segments",
+		"segment.asm", "segment.o"
+	};
+	char path[PATH_MAX];
+
+	for (size_t i = 0; i < sizeof(names) / sizeof(*names); i++) {
+		snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+		unlink(path);
+	}
+	rmdir(dir);
+}
+
+/* Returns the extension of cached artifacts in the given format. */
+static const char *
+format_cache_kind(const enum output_format format)
+{
+	switch (format) {
+		case FORMAT_OBJECT:
+			return "o";
+		case FORMAT_SHARED:
+			return "so";
+		case FORMAT_EXECUTABLE:
+		default:
+			return "bin";
+	}
+}
+
+/*
+ * Assembles out.asm in `dir`, and links it with the objects listed in
+ * `ld_args`, if any, unless an object file is wanted.
+ */
 static struct invoke_assembler_result
-invoke_assembler(const char *out_name)
+invoke_assembler(const char *dir, const char *out_name,
+		 const enum output_format format, const char *ld_args)
 {
 	struct invoke_assembler_result result = {0};
-	const char nasm_cmd[] = "nasm -felf64 -g out.asm 2>&1";
+	char nasm_cmd[2 * PATH_MAX + 48];
+	size_t output_len;
+
+	/* An object file is the output of NASM itself. */
+	if (format == FORMAT_OBJECT) {
+		snprintf(nasm_cmd, sizeof(nasm_cmd),
+			 "nasm -felf64 -g -o %s %s/out.asm 2>&1", out_name,
+			 dir);
+	} else {
+		snprintf(nasm_cmd, sizeof(nasm_cmd),
+			 "nasm -felf64 -g -o %s/out.o %s/out.asm 2>&1", dir,
+			 dir);
+	}
+
+	stats_begin(&stats);
 	FILE *nasm_pipe = popen(nasm_cmd, "r");
 	if (!nasm_pipe) {
 		goto invoke_assembler_nasm_error;
@@ -308,13 +955,16 @@ invoke_assembler(const char *out_name)
 	char buf[UINT8_MAX];
 	while (fgets(buf, 80, nasm_pipe) != NULL) {
 		assert(strlen(buf) <= UINT8_MAX);
+		output_len = strlen(result.cmd_output);
 		uintptr_t p =
-			(uintptr_t) strncat(result.cmd_output, buf, UINT8_MAX);
+			(uintptr_t) strncat(result.cmd_output, buf,
+					    UINT8_MAX - output_len - 1);
 		assert(p == (uintptr_t) result.cmd_output);
 	}
 	memset(buf, 0x0, UINT8_MAX);
 
 	int nasm_exit_status = pclose(nasm_pipe);
+	stats_end(&stats, STATS_NASM);
 	if (nasm_exit_status == -1) {
 		goto invoke_assembler_nasm_error;
 	} else if (nasm_exit_status > 0) {
@@ -323,9 +973,17 @@ invoke_assembler(const char *out_name)
 		return result;
 	}
 
-	char ld_cmd[FILENAME_MAX];
-	snprintf(ld_cmd, FILENAME_MAX, "ld -o %s out.o 2>&1", out_name);
+	if (format == FORMAT_OBJECT) {
+		result.status = INVOKE_SUCCESS;
+		return result;
+	}
+
+	char ld_cmd[2 * PATH_MAX + 64];
+	snprintf(ld_cmd, sizeof(ld_cmd), "ld %s-o %s %s/out.o %s 2>&1",
+		 format == FORMAT_SHARED ? "-shared " : "", out_name, dir,
+		 ld_args);
 
+	stats_begin(&stats);
 	FILE *ld_pipe = popen(ld_cmd, "r");
 	if (!ld_pipe) {
 		goto invoke_assembler_ld_error;
@@ -333,13 +991,16 @@ invoke_assembler(const char *out_name)
 
 	while (fgets(buf, UINT8_MAX, ld_pipe) != NULL) {
 		assert(strlen(buf) <= UINT8_MAX);
+		output_len = strlen(result.cmd_output);
 		uintptr_t p =
-			(uintptr_t) strncat(result.cmd_output, buf, UINT8_MAX);
+			(uintptr_t) strncat(result.cmd_output, buf,
+					    UINT8_MAX - output_len - 1);
 		assert(p == (uintptr_t) result.cmd_output);
 	}
 	memset(buf, 0x0, UINT8_MAX);
 
 	int ld_exit_status = pclose(ld_pipe);
+	stats_end(&stats, STATS_LD);
 	if (ld_exit_status == -1) {
 		goto invoke_assembler_ld_error;
 	} else if (ld_exit_status > 0) {
@@ -363,13 +1024,427 @@ invoke_assembler_ld_error:
 	return result;
 }
 
+/*
+ * Assembles the segments of `sresults` that are not cached yet into the cache,
+ * and lists the cached objects of all of them in out.segments, for `ld` to
+ * link with the entry point. Segments are assembled in `dir`, a directory made
+ * by `make_build_dir`, so builds running at once never store one another's
+ * objects.
+ */
+static struct invoke_assembler_result
+invoke_segment_assembler(
+	const struct matsplat_segmented_compilation_result *sresults,
+	const char *dir, const struct options opts)
+{
+	struct invoke_assembler_result result = {0};
+	char path[PATH_MAX];
+	char asm_path[PATH_MAX];
+	char obj_path[PATH_MAX];
+	char nasm_cmd[2 * PATH_MAX + 48];
+	FILE *list = NULL;
+	size_t assembled = 0;
+	int err;
+
+	if (snprintf(path, sizeof(path), "%s/out.segments", dir) >= PATH_MAX
+	    || snprintf(asm_path, sizeof(asm_path), "%s/segment.asm", dir)
+	    >= PATH_MAX
+	    || snprintf(obj_path, sizeof(obj_path), "%s/segment.o", dir)
+	    >= PATH_MAX) {
+		errno = ENAMETOOLONG;
+		goto invoke_segment_assembler_cache_error;
+	}
+	snprintf(nasm_cmd, sizeof(nasm_cmd), "nasm -felf64 -g -o %s %s 2>&1",
+		 obj_path, asm_path);
+
+	list = fopen(path, "w");
+	if (list == NULL) {
+		goto invoke_segment_assembler_cache_error;
+	}
+
+	for (size_t i = 0; i < sresults->len; i++) {
+		const struct matsplat_segment *segment = &sresults->segments[i];
+
+		err = matsplat_cache_path(path, PATH_MAX, segment->key,
+					  "seg.o");
+		if (err != 0) {
+			errno = err;
+			goto invoke_segment_assembler_cache_error;
+		}
+		fprintf(list, "\"%s\"\n", path);
+		if (access(path, R_OK) == 0) {
+			continue;
+		}
+
+		if (write_source_to_disk(segment->code, asm_path)
+		    == (size_t) -1) {
+			goto invoke_segment_assembler_cache_error;
+		}
+		stats_begin(&stats);
+		FILE *nasm_pipe = popen(nasm_cmd, "r");
+		if (!nasm_pipe) {
+			goto invoke_segment_assembler_nasm_error;
+		}
+
+		char buf[UINT8_MAX];
+		while (fgets(buf, UINT8_MAX, nasm_pipe) != NULL) {
+			const size_t output_len = strlen(result.cmd_output);
+			strncat(result.cmd_output, buf,
+				UINT8_MAX - output_len - 1);
+		}
+
+		int nasm_exit_status = pclose(nasm_pipe);
+		stats_end(&stats, STATS_NASM);
+		if (nasm_exit_status == -1) {
+			goto invoke_segment_assembler_nasm_error;
+		} else if (nasm_exit_status > 0) {
+			fclose(list);
+			result.status = INVOKE_NASM_FAIL;
+			return result;
+		}
+
+		err = matsplat_cache_store(segment->key, "seg.o", obj_path);
+		if (err != 0) {
+			errno = err;
+			goto invoke_segment_assembler_cache_error;
+		}
+		assembled++;
+	}
+
+	if (fclose(list) != 0) {
+		list = NULL;
+		goto invoke_segment_assembler_cache_error;
+	}
+	printf_v(opts, "Assembled %zu of %zu segments, reused the others.\n",
+		 assembled, sresults->len);
+
+	result.status = INVOKE_SUCCESS;
+	return result;
+
+invoke_segment_assembler_nasm_error:
+	result.error_no = errno;
+	result.status = INVOKE_NASM_FAIL;
+	fclose(list);
+	return result;
+
+invoke_segment_assembler_cache_error:
+	result.error_no = errno;
+	result.status = INVOKE_CACHE_FAIL;
+	if (list != NULL) {
+		fclose(list);
+	}
+	return result;
+}
+
+/*
+ * Compiles out.c in `dir` with the system C compiler, which also links it
+ * unless an object file is wanted. Kernels are compiled position independent,
+ * to be linked into shared libraries of their hosts too.
+ */
+static struct invoke_assembler_result
+invoke_c_compiler(const char *dir, const char *out_name,
+		  const enum output_format format)
+{
+	struct invoke_assembler_result result = {0};
+	char cc_cmd[2 * PATH_MAX + 48];
+	size_t output_len;
+
+	snprintf(cc_cmd, sizeof(cc_cmd), "cc -O2 %s-o %s %s/out.c 2>&1",
+		 format == FORMAT_OBJECT ? "-fPIC -c "
+		 : format == FORMAT_SHARED ? "-fPIC -shared " : "",
+		 out_name, dir);
+
+	stats_begin(&stats);
+	FILE *cc_pipe = popen(cc_cmd, "r");
+	if (!cc_pipe) {
+		goto invoke_c_compiler_error;
+	}
+
+	char buf[UINT8_MAX];
+	while (fgets(buf, UINT8_MAX, cc_pipe) != NULL) {
+		output_len = strlen(result.cmd_output);
+		strncat(result.cmd_output, buf, UINT8_MAX - output_len - 1);
+	}
+
+	int cc_exit_status = pclose(cc_pipe);
+	stats_end(&stats, STATS_CC);
+	if (cc_exit_status == -1) {
+		goto invoke_c_compiler_error;
+	} else if (cc_exit_status > 0) {
+		result.error_no = 0;
+		result.status = INVOKE_CC_FAIL;
+		return result;
+	}
+
+	result.error_no = 0;
+	result.status = INVOKE_SUCCESS;
+	return result;
+
+invoke_c_compiler_error:
+	result.error_no = errno;
+	result.status = INVOKE_CC_FAIL;
+	return result;
+}
+
+/*
+ * Finds the runtime of bundles, next to this executable when it was not
+ * installed yet, and in MATSPLAT_RUNTIME otherwise.
+ */
+static void
+find_runtime(char *runtime, const size_t len)
+{
+	char self[PATH_MAX];
+	const ssize_t self_len = readlink("/proc/self/exe", self,
+					  sizeof(self) - 1);
+
+	if (self_len > 0) {
+		self[self_len] = '\0';
+		int written = snprintf(runtime, len,
+				       "%s/mattersplatter-runtime",
+				       dirname(self));
+		if (written > 0 && (size_t) written < len
+		    && access(runtime, X_OK) == 0) {
+			return;
+		}
+	}
+
+	snprintf(runtime, len, "%s", MATSPLAT_RUNTIME);
+}
+
+/*
+ * Writes `program` to the output file as a bundle of the runtime and its
+ * bytecode, and caches it under `cache_key`. Returns 0 on success, or an errno
+ * value on failure.
+ */
+static int
+bundle_program(const struct matsplat_program *program,
+	       const uint64_t cache_key, const struct options opts)
+{
+	char runtime[PATH_MAX];
+
+	find_runtime(runtime, sizeof(runtime));
+	int err = matsplat_program_bundle(program, runtime,
+					  opts.out_file_name);
+	if (err != 0) {
+		return err;
+	}
+	printf_v(opts, "Bundled %s with the bytecode into %s.\n", runtime,
+		 opts.out_file_name);
+
+	if (opts.use_cache) {
+		int cache_err = matsplat_cache_store(
+			cache_key, format_cache_kind(opts.format),
+			opts.out_file_name);
+		if (cache_err != 0) {
+			printf_v(opts, "Could not cache binary: %s\n",
+				 strerror(cache_err));
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Compiles `program` to a native executable like compiler mode, in a private
+ * directory written to `dir`, and writes the path of the executable to `path`.
+ * It is cached under `cache_key` and `dir` is removed, or, without the cache,
+ * it is left in `dir` to be removed once it ran. Returns false if it could not
+ * be built.
+ */
+static bool
+compile_native(const struct matsplat_program *program, const uint64_t cache_key,
+	       char *dir, char *path, const struct options opts)
+{
+	const struct matsplat_compile_options copts = {
+		.cell_count = opts.mem_size,
+		.entry_point = MATSPLAT_ENTRY_START,
+		.target = MATSPLAT_TARGET_NASM
+	};
+	char asm_path[PATH_MAX];
+
+	/* Batch mode leaves the working directory alone. */
+	int err = make_build_dir(dir);
+	if (err != 0) {
+		fprintf(stderr, "Error building native code: %s\n",
+			strerror(err));
+		return false;
+	}
+	snprintf(asm_path, sizeof(asm_path), "%s/out.asm", dir);
+	snprintf(path, PATH_MAX, "%s/out.bin", dir);
+
+	printf_v(opts, "Compiling to native code in %s...\n", dir);
+	stats_begin(&stats);
+	struct matsplat_compilation_result cresults =
+		matsplat_program_compile(program, &copts);
+	if (cresults.error_code != 0) {
+		fprintf(stderr, "Error compiling: %s\n",
+			strerror(cresults.error_code));
+		goto compile_native_error;
+	}
+	const size_t asm_len = write_source_to_disk(cresults, asm_path);
+	stats_end(&stats, STATS_CODEGEN);
+	stats.asm_bytes = cresults.source_code_len;
+	matsplat_compilation_result_destroy(cresults);
+	if (asm_len == (size_t) -1) {
+		fprintf(stderr, "Error writing %s: %s\n", asm_path,
+			strerror(errno));
+		goto compile_native_error;
+	}
+
+	struct invoke_assembler_result invoke_result =
+		invoke_assembler(dir, path, FORMAT_EXECUTABLE, "");
+	if (invoke_result.status != INVOKE_SUCCESS) {
+		fprintf(stderr, "Error building native code:\n%s\n",
+			invoke_result.error_no != 0
+			? strerror(invoke_result.error_no)
+			: invoke_result.cmd_output);
+		goto compile_native_error;
+	}
+
+	if (opts.use_cache) {
+		char cached[PATH_MAX];
+		err = matsplat_cache_store(cache_key, "bin", path);
+		if (err == 0) {
+			err = matsplat_cache_path(cached, PATH_MAX, cache_key,
+						  "bin");
+		}
+		if (err != 0) {
+			printf_v(opts, "Could not cache binary: %s\n",
+				 strerror(err));
+		} else {
+			strcpy(path, cached);
+			remove_build_dir(dir);
+			dir[0] = '\0';
+		}
+	}
+
+	return true;
+
+compile_native_error:
+	remove_build_dir(dir);
+	dir[0] = '\0';
+	return false;
+}
+
+/*
+ * Runs the native executable at `path` on our standard streams, then removes
+ * `dir` unless it is empty, and exits with the status of the executable.
+ * Unless `history` is NULL, its run time is saved to it.
+ */
+static void
+run_native(const char *path, const char *dir, struct engine_history *history,
+	   const struct options opts)
+{
+	struct timespec start;
+	int status;
+
+	printf_v(opts, "Executing native code %s...\n", path);
+	fflush(stdout);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	stats_begin(&stats);
+	const pid_t pid = fork();
+	if (pid == 0) {
+		execl(path, path, (char *) NULL);
+		_exit(127);
+	}
+	if (pid == -1 || waitpid(pid, &status, 0) == -1) {
+		fprintf(stderr, "Error executing %s: %s\n", path,
+			strerror(errno));
+		exit(errno);
+	}
+	stats_end(&stats, STATS_EXECUTE);
+
+	if (history != NULL) {
+		history->native_ns = elapsed_ns(&start);
+		int err = engine_history_save(history);
+		if (err != 0) {
+			printf_v(opts, "Could not save run time: %s\n",
+				 strerror(err));
+		}
+	}
+
+	if (dir[0] != '\0') {
+		remove_build_dir(dir);
+	}
+	exit(WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE);
+}
+
+/*
+ * Executes a program on the engine of --engine, then frees it and exits. The
+ * auto engine is chosen from the features of the program, and from its past
+ * run times on each engine, saved in the cache under `cache_key`.
+ */
+static void
+run_engine(struct matsplat_program *program, const uint64_t cache_key,
+	   const struct options opts)
+{
+	struct engine_history history = { .key = cache_key };
+	enum engine engine = opts.engine;
+	char path[PATH_MAX];
+	char dir[PATH_MAX] = "";
+	bool is_compiled = false;
+
+	/* Runs doing more than executing would skew the run times. */
+	const bool is_timed = opts.use_cache && !opts.needs_interpreter
+		&& stats.format == STATS_NONE;
+	if (opts.use_cache) {
+		engine_history_load(cache_key, &history);
+		is_compiled = matsplat_cache_path(path, PATH_MAX, cache_key,
+						  "bin") == 0
+			&& access(path, X_OK) == 0;
+	}
+
+	if (engine == ENGINE_AUTO) {
+		const struct engine_features features =
+			engine_measure(program);
+		engine = engine_choose(&features, &history, is_compiled);
+		printf_v(opts, "Chose the %s engine: %zu loops nested %zu "
+			 "deep, %zu idioms, %zu instructions, last run %"
+			 PRIu64 " ns interpreted and %" PRIu64 " ns native.\n",
+			 engine_name(engine), features.loops, features.depth,
+			 features.idioms, features.instructions,
+			 history.bytecode_ns, history.native_ns);
+		if (history.native_ns == ENGINE_NOT_BUILT) {
+			printf_v(opts, "Native code failed to build before, "
+				 "clear the cache to try again.\n");
+		}
+	}
+
+	if (engine == ENGINE_NATIVE
+	    && (is_compiled
+		|| compile_native(program, cache_key, dir, path, opts))) {
+		matsplat_program_destroy(*program);
+		run_native(path, dir, is_timed ? &history : NULL, opts);
+	}
+	if (opts.engine == ENGINE_NATIVE) {
+		exit(EXIT_FAILURE);
+	}
+
+	/* Programs that failed to build are not compiled again. */
+	if (engine == ENGINE_NATIVE && opts.use_cache) {
+		history.native_ns = ENGINE_NOT_BUILT;
+		int err = engine_history_save(&history);
+		if (err != 0) {
+			printf_v(opts, "Could not save run time: %s\n",
+				 strerror(err));
+		}
+	}
+
+	run_program(program, is_timed ? &history : NULL, opts);
+}
+
 int
 main(int argc, char *argv[])
 {
+	clock_gettime(CLOCK_MONOTONIC, &started);
 	const struct options opts = options_create(argc, argv);
 	char *source_code = NULL;
 	intmax_t file_size;
 	uint8_t err = 0;
+	int program_err = 0;
+	struct matsplat_program program = {0};
+	struct matsplat_profile profile = {0};
+	char bytecode_path[PATH_MAX];
+	bool cache_bytecode = false;
 
 	if (opts.mode == MODE_HELP) {
 		puts(usage_msg);
@@ -381,41 +1456,300 @@ main(int argc, char *argv[])
 		goto main_opt_error;
 	}
 
+	if (opts.mode == MODE_SERVER) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		const struct server_options sopts = {
+			.socket_path = opts.socket_path,
+			.cell_count = opts.mem_size,
+			.workers = opts.workers != 0 ? opts.workers
+				: cpus > 0 ? (size_t) cpus : 1,
+			.cache_entries = 256,
+			.use_cache = opts.use_cache,
+			.is_verbose = opts.is_verbose
+		};
+		if ((err = serve(&sopts)) != 0) {
+			fprintf(stderr, "Error serving on %s: %s",
+				opts.socket_path, strerror(err));
+		}
+		exit(err);
+	}
+
+	if (opts.is_bundling && !opts.has_target) {
+		fprintf(stderr, "NASM or LD not found, bundling the "
+			"interpreter instead.\n");
+	}
+
+	/* Statistics are reported whichever way the run ends. */
+	stats.format = opts.stats_format;
+	if (stats.format != STATS_NONE) {
+		atexit(print_stats);
+	}
+
+	if (opts.mode == MODE_INTERPRETER) {
+		/*
+		 * Bytecode files are executed as they are, without going
+		 * through the lexer and parser.
+		 */
+		stats_begin(&stats);
+		program_err = matsplat_program_load(opts.in_file_name, &program);
+		if (program_err == 0) {
+			stats_end(&stats, STATS_LOAD);
+			printf_v(opts, "Mapped bytecode file %s.\n",
+				 opts.in_file_name);
+			run_program(&program, NULL, opts);
+		} else if (program_err == EINVAL || program_err == ENOTSUP) {
+			goto main_program_load_err;
+		}
+	}
+
 	printf_v(opts, "Beginning to load file %s to memory...\n", opts.in_file_name);
+	stats_begin(&stats);
 	file_size = load_file_to_buffer(&source_code, opts.in_file_name);
 
 	if (file_size == -1) {
 		goto main_file_read_err;
 	}
+	stats_end(&stats, STATS_LOAD);
+	stats.source_bytes = file_size;
 
 	printf_v(opts,
 		 "...file loaded into memory (enable debug for more information).\n",
 		 opts.in_file_name);
 	printd_file(source_code, opts.in_file_name, file_size, opts);
 
+	uint64_t cache_key =
+		matsplat_cache_key(source_code, file_size, opts.mem_size);
+
+	if (opts.mode == MODE_COMPILER && opts.profile_file_name[0] != '\0') {
+		program_err = matsplat_profile_load(opts.profile_file_name,
+						    &profile);
+		if (program_err != 0) {
+			goto main_profile_load_err;
+		}
+
+		/*
+		 * The binary depends on the profile too, so mix its loop
+		 * counts into the key, chaining the key through the cell
+		 * count argument.
+		 */
+		cache_key = matsplat_cache_key((const char *) profile.loops,
+					       profile.len
+					       * sizeof(*profile.loops),
+					       cache_key);
+	}
+	if (opts.is_bundling) {
+		/* The binaries of each target are cached apart. */
+		cache_key = matsplat_cache_key("bundle", 6, cache_key);
+	} else if (opts.target != MATSPLAT_TARGET_NASM) {
+		cache_key = matsplat_cache_key("c", 1, cache_key);
+	}
+	if (opts.is_instrumenting) {
+		/* Instrumented binaries depend on where they save counts. */
+		cache_key = matsplat_cache_key(opts.instrument_file_name,
+					       strlen(opts.instrument_file_name),
+					       cache_key);
+	}
+	if (opts.mode == MODE_COMPILER && opts.use_cache
+	    && matsplat_cache_fetch(cache_key, format_cache_kind(opts.format),
+				    opts.out_file_name) == 0) {
+		printf_v(opts, "Cache hit, copied cached binary to %s.\n",
+			 opts.out_file_name);
+		free(source_code);
+		exit(EXIT_SUCCESS);
+	}
+
+	if (opts.mode == MODE_INTERPRETER && opts.use_cache) {
+		cache_bytecode = matsplat_cache_path(bytecode_path, PATH_MAX,
+						     cache_key, "bfc") == 0;
+		stats_begin(&stats);
+		if (cache_bytecode
+		    && matsplat_program_load(bytecode_path, &program) == 0) {
+			stats_end(&stats, STATS_LOAD);
+			printf_v(opts, "Cache hit, using cached bytecode.\n");
+			free(source_code);
+			run_engine(&program, cache_key, opts);
+		}
+	}
+
 	printf_v(opts, "Lexer beginning to parse source code...\n");
+	stats_begin(&stats);
 	struct matsplat_tokenize_result tokenize_result =
 		matsplat_tokenize(source_code,file_size);
+	stats_end(&stats, STATS_TOKENIZE);
+	stats.tokens = tokenize_result.len;
 	printf_v(opts, "..parsing complete (enable debug for more information).\n");
 	printd_tokens(tokenize_result.tokens, tokenize_result.len, opts);
 	free(source_code);
 
+	stats_begin(&stats);
 	struct matsplat_node *ast
 		= matsplat_ast_create(tokenize_result.tokens, tokenize_result.len);
+	stats_end(&stats, STATS_PARSE);
+	if (stats.format != STATS_NONE && ast != NULL) {
+		stats.nodes = stats_count_nodes(ast);
+	}
 
 	struct invoke_assembler_result invoke_result = {0};
-	if (opts.mode == MODE_COMPILER) {
-		struct matsplat_compilation_result cresults = matsplat_compile(ast, opts.mem_size);
-		write_assembly_to_disk(cresults);
-		matsplat_compilation_result_destroy(cresults);
-		invoke_result = invoke_assembler(opts.out_file_name);
+	if (opts.mode == MODE_COMPILER && !opts.is_bundling) {
+		const struct matsplat_compile_options copts = {
+			.cell_count = opts.mem_size,
+			.entry_point = opts.format == FORMAT_EXECUTABLE
+				? MATSPLAT_ENTRY_START : MATSPLAT_ENTRY_KERNEL,
+			.profile = profile.loops != NULL ? &profile : NULL,
+			.profile_path = opts.is_instrumenting
+				? opts.instrument_file_name : NULL,
+			.target = opts.target
+		};
+
+		/* Kernels must not assume the size of the tape they run on. */
+		stats_begin(&stats);
+		program = matsplat_program_create(
+			ast, copts.entry_point == MATSPLAT_ENTRY_KERNEL
+			? MATSPLAT_KERNEL_CELL_COUNT : opts.mem_size);
+		stats_end(&stats, STATS_OPTIMIZE);
+		if ((program_err = program.error_code) != 0) {
+			goto main_program_err;
+		}
+		stats.instructions = program.len;
+		printd_program(&program, opts);
+
+		/*
+		 * Cached executables are built in segments, so a build after
+		 * an edit only assembles the segments the edit changed.
+		 */
+		const bool is_c = opts.target == MATSPLAT_TARGET_C;
+		bool is_segmented = opts.use_cache && !is_c
+			&& opts.format == FORMAT_EXECUTABLE
+			&& copts.profile == NULL && copts.profile_path == NULL;
+		struct matsplat_segmented_compilation_result sresults = {0};
+		struct matsplat_compilation_result cresults = {0};
+		stats_begin(&stats);
+		if (is_segmented) {
+			sresults = matsplat_program_compile_segments(&program,
+								     &copts);
+			/* Programs of a single segment are not worth it. */
+			is_segmented = sresults.error_code == 0
+				&& sresults.len > 1;
+			if (is_segmented) {
+				cresults = sresults.main;
+			} else {
+				matsplat_segmented_compilation_result_destroy(
+					sresults);
+			}
+		}
+		if (!is_segmented) {
+			cresults = matsplat_program_compile(&program, &copts);
+		}
+		matsplat_profile_destroy(profile);
+		matsplat_program_destroy(program);
+		if ((program_err = cresults.error_code) != 0) {
+			goto main_compile_err;
+		}
+
+		/* Builds running at once in one directory share no files. */
+		char build_dir[PATH_MAX];
+		char src_path[PATH_MAX];
+		if ((program_err = make_build_dir(build_dir)) != 0) {
+			goto main_compile_err;
+		}
+		if (snprintf(src_path, sizeof(src_path), "%s/%s", build_dir,
+			     is_c ? "out.c" : "out.asm") >= PATH_MAX) {
+			remove_build_dir(build_dir);
+			program_err = ENAMETOOLONG;
+			goto main_compile_err;
+		}
+		write_source_to_disk(cresults, src_path);
+		stats_end(&stats, STATS_CODEGEN);
+		stats.asm_bytes = cresults.source_code_len;
+		for (size_t i = 0; i < sresults.len && is_segmented; i++) {
+			stats.asm_bytes +=
+				sresults.segments[i].code.source_code_len;
+		}
+
+		if (is_c) {
+			matsplat_compilation_result_destroy(cresults);
+			invoke_result = invoke_c_compiler(
+				build_dir, opts.out_file_name, opts.format);
+		} else if (is_segmented) {
+			char ld_args[PATH_MAX + 16];
+			invoke_result = invoke_segment_assembler(
+				&sresults, build_dir, opts);
+			matsplat_segmented_compilation_result_destroy(sresults);
+			if (invoke_result.status == INVOKE_SUCCESS) {
+				snprintf(ld_args, sizeof(ld_args),
+					 "@%s/out.segments", build_dir);
+				invoke_result = invoke_assembler(
+					build_dir, opts.out_file_name,
+					opts.format, ld_args);
+			}
+		} else {
+			matsplat_compilation_result_destroy(cresults);
+			invoke_result = invoke_assembler(build_dir,
+							 opts.out_file_name,
+							 opts.format, "");
+		}
+		remove_build_dir(build_dir);
 
 		if (invoke_result.status != INVOKE_SUCCESS) {
 			goto main_invoke_assembler_err;
 		}
 
+		if (opts.use_cache) {
+			int cache_err = matsplat_cache_store(
+				cache_key, format_cache_kind(opts.format),
+				opts.out_file_name);
+			if (cache_err != 0) {
+				printf_v(opts, "Could not cache binary: %s\n",
+					 strerror(cache_err));
+			}
+		}
+
 	} else {
-		matsplat_execution_result_destory(matsplat_execute(ast, opts.mem_size));
+		stats_begin(&stats);
+		program = matsplat_program_create(ast, opts.mem_size);
+		stats_end(&stats, STATS_OPTIMIZE);
+		matsplat_tokenize_destory(tokenize_result);
+		matsplat_ast_destroy(ast);
+		if ((program_err = program.error_code) != 0) {
+			goto main_program_err;
+		}
+		stats.instructions = program.len;
+		printd_program(&program, opts);
+
+		if (opts.mode == MODE_BYTECODE) {
+			program_err = matsplat_program_save(&program,
+							    opts.out_file_name);
+			matsplat_program_destroy(program);
+			if (program_err != 0) {
+				goto main_program_err;
+			}
+			printf_v(opts, "Wrote bytecode to %s.\n",
+				 opts.out_file_name);
+			exit(EXIT_SUCCESS);
+		}
+
+		if (opts.is_bundling) {
+			stats_begin(&stats);
+			program_err = bundle_program(&program, cache_key, opts);
+			stats_end(&stats, STATS_CODEGEN);
+			matsplat_profile_destroy(profile);
+			matsplat_program_destroy(program);
+			if (program_err != 0) {
+				goto main_bundle_err;
+			}
+			exit(EXIT_SUCCESS);
+		}
+
+		if (cache_bytecode) {
+			int cache_err = matsplat_program_save(&program,
+							      bytecode_path);
+			if (cache_err != 0) {
+				printf_v(opts, "Could not cache bytecode: %s\n",
+					 strerror(cache_err));
+			}
+		}
+
+		run_engine(&program, cache_key, opts);
 	}
 
 	matsplat_tokenize_destory(tokenize_result);
@@ -428,6 +1762,11 @@ main_opt_error:
 			fprintf(stderr,
 				"Please provide a brainf*ck source file.");
 			break;
+		case OPTIONS_PROFILE_TOO_LONG:
+			fprintf(stderr,
+				"Profile name longer than maximum value of %d.",
+				PATH_MAX);
+			break;
 		case OPTIONS_FILE_TOO_LONG:
 			fprintf(stderr,
 				"File name longer than maximum value of %d.",
@@ -450,6 +1789,58 @@ main_opt_error:
 				"Invalid memory size.\n");
 			fprintf(stderr, "%s", usage_msg);
 			break;
+		case OPTIONS_INVALID_FORMAT:
+			fprintf(stderr,
+				"Invalid output format.\n");
+			fprintf(stderr, "%s", usage_msg);
+			break;
+		case OPTIONS_INVALID_TARGET:
+			fprintf(stderr,
+				"Invalid target.\n");
+			fprintf(stderr, "%s", usage_msg);
+			break;
+		case OPTIONS_INVALID_WORKERS:
+			fprintf(stderr,
+				"Invalid worker count.\n");
+			fprintf(stderr, "%s", usage_msg);
+			break;
+		case OPTIONS_INVALID_STATS:
+			fprintf(stderr,
+				"Invalid statistics format.\n");
+			fprintf(stderr, "%s", usage_msg);
+			break;
+		case OPTIONS_INVALID_INSTRUMENT:
+			fprintf(stderr,
+				"Only nasm executables can be instrumented.\n");
+			fprintf(stderr, "%s", usage_msg);
+			break;
+		case OPTIONS_INVALID_MEMO:
+			fprintf(stderr,
+				"Invalid memo table size.\n");
+			fprintf(stderr, "%s", usage_msg);
+			break;
+		case OPTIONS_INVALID_BUNDLE:
+			fprintf(stderr,
+				"Only executables can be bundled.\n");
+			fprintf(stderr, "%s", usage_msg);
+			break;
+		case OPTIONS_INVALID_EOF:
+			fprintf(stderr,
+				"Invalid EOF value.\n");
+			fprintf(stderr, "%s", usage_msg);
+			break;
+		case OPTIONS_INVALID_ENGINE:
+			fprintf(stderr,
+				"Invalid engine, expected bytecode, native or "
+				"auto.\n");
+			fprintf(stderr, "%s", usage_msg);
+			break;
+		case OPTIONS_NATIVE_CONFLICT:
+			fprintf(stderr,
+				"The native engine does not support -p, -i, "
+				"--eof, --counters or --memo.\n");
+			fprintf(stderr, "%s", usage_msg);
+			break;
 		default:
 			fprintf(stderr,
 				"An unknown error has occured.");
@@ -464,11 +1855,45 @@ main_file_read_err:
 		strerror(errno));
 	exit(errno);
 
+main_program_load_err:
+	fprintf(stderr,
+		"Error loading bytecode file %s: %s",
+		opts.in_file_name,
+		program_err == ENOTSUP ? "unsupported bytecode version"
+		: strerror(program_err));
+	exit(program_err);
+
+main_program_err:
+	fprintf(stderr, "Error generating bytecode: %s", strerror(program_err));
+	exit(program_err);
+
+main_profile_load_err:
+	fprintf(stderr,
+		"Error loading profile %s: %s",
+		opts.profile_file_name,
+		program_err == ENOTSUP ? "unsupported profile version"
+		: strerror(program_err));
+	exit(program_err);
+
+main_compile_err:
+	fprintf(stderr, "Error compiling: %s", strerror(program_err));
+	exit(program_err);
+
+main_bundle_err:
+	fprintf(stderr, "Error bundling the runtime: %s",
+		strerror(program_err));
+	exit(program_err);
+
 main_invoke_assembler_err:
 	if (invoke_result.error_no == 0) {
 		if (invoke_result.status == INVOKE_NASM_FAIL) {
 			fprintf(stderr, "NASM failed to assemble:\n%s",
 				invoke_result.cmd_output);
+		} else if (invoke_result.status == INVOKE_CC_FAIL) {
+			fprintf(stderr, "CC failed to compile:\n%s",
+				invoke_result.cmd_output);
+		} else if (invoke_result.status == INVOKE_CACHE_FAIL) {
+			fprintf(stderr, "Could not cache segments.\n");
 		} else {
 			fprintf(stderr, "LD failed to link binary:\n%s",
 				invoke_result.cmd_output);
@@ -478,6 +1903,12 @@ main_invoke_assembler_err:
 		if (invoke_result.status == INVOKE_NASM_FAIL) {
 			fprintf(stderr, "Error invoking NASM:\n%s",
 				strerror(invoke_result.error_no));
+		} else if (invoke_result.status == INVOKE_CC_FAIL) {
+			fprintf(stderr, "Error invoking CC:\n%s",
+				strerror(invoke_result.error_no));
+		} else if (invoke_result.status == INVOKE_CACHE_FAIL) {
+			fprintf(stderr, "Error caching segments:\n%s",
+				strerror(invoke_result.error_no));
 		} else {
 			fprintf(stderr, "Error invoking LD:\n%s",
 				strerror(invoke_result.error_no));
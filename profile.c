@@ -0,0 +1,393 @@
+/*
+ * Mattersplatter - a compiler & interpreter for the Brainf*ck language.
+ * Copyright (C) 2021 Maxwell R. Haley <maxwell.r.haley@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <mattersplatter.h>
+
+#include "profile.h"
+
+#define NO_LOOP SIZE_MAX
+
+/*
+ * A loop of the program, identified by the index of its JUMP_ZERO. Loops that
+ * were replaced by straight-line code are not loops anymore, and their cost is
+ * attributed to the enclosing loop.
+ */
+struct loop {
+	size_t start;
+	size_t end;
+	size_t parent;
+	uint64_t iterations;
+	uint64_t steps;
+	uint64_t self_steps;
+};
+
+struct loop_table {
+	struct loop *loops;
+	size_t len;
+	uint64_t total_steps;
+	uint64_t top_level_steps;
+};
+
+/*
+ * Rebuilds the loop nesting of `program` from its jumps, and sums up the
+ * execution counts of every loop. Returns 0 on success, or an errno value.
+ */
+static int
+loop_table_create(struct loop_table *table,
+		  const struct matsplat_program *program,
+		  const uint64_t *counts)
+{
+	size_t *open = malloc(program->len * sizeof(size_t));
+	size_t depth = 0;
+
+	*table = (struct loop_table) {
+		.loops = malloc(program->len * sizeof(struct loop))
+	};
+	if (open == NULL || table->loops == NULL) {
+		free(open);
+		free(table->loops);
+		return ENOMEM;
+	}
+
+	for (size_t i = 0; i < program->len; i++) {
+		const struct matsplat_instruction in = program->code[i];
+		const size_t current = depth > 0 ? open[depth - 1] : NO_LOOP;
+
+		table->total_steps += counts[i];
+		for (size_t d = 0; d < depth; d++) {
+			table->loops[open[d]].steps += counts[i];
+		}
+
+		if (in.op == OP_JUMP_ZERO) {
+			/* Every iteration ends on the loop's JUMP_NOT_ZERO. */
+			table->loops[table->len] = (struct loop) {
+				.start = i,
+				.end = in.jump - 1,
+				.parent = current,
+				.iterations = counts[in.jump - 1],
+				.steps = counts[i],
+				.self_steps = counts[i]
+			};
+			open[depth++] = table->len++;
+		} else if (current == NO_LOOP) {
+			table->top_level_steps += counts[i];
+		} else {
+			table->loops[current].self_steps += counts[i];
+			if (i == table->loops[current].end) {
+				depth--;
+			}
+		}
+	}
+
+	free(open);
+	return 0;
+}
+
+static int
+compare_steps(const void *a, const void *b)
+{
+	const struct loop *la = a;
+	const struct loop *lb = b;
+
+	return (la->steps < lb->steps) - (la->steps > lb->steps);
+}
+
+void
+profile_print_hot_loops(FILE *out, const struct matsplat_program *program,
+			const uint64_t *counts, const size_t top)
+{
+	struct loop_table table;
+
+	if (loop_table_create(&table, program, counts) != 0) {
+		fprintf(out, "Not enough memory to analyze the profile.\n");
+		return;
+	}
+
+	qsort(table.loops, table.len, sizeof(struct loop), compare_steps);
+
+	fprintf(out, "%" PRIu64 " steps executed, %zu loops.\n",
+		table.total_steps, table.len);
+	fprintf(out, "%4s %12s %16s %16s %7s\n",
+		"rank", "location", "iterations", "steps", "share");
+	for (size_t i = 0; i < table.len && i < top; i++) {
+		const struct loop *loop = &table.loops[i];
+		const struct matsplat_source_position pos =
+			program->positions[loop->start];
+		char location[32];
+
+		if (loop->steps == 0) {
+			break;
+		}
+
+		snprintf(location, sizeof(location), "%" PRIu32 ":%" PRIu32,
+			 pos.column, pos.row);
+		fprintf(out, "%4zu %12s %16" PRIu64 " %16" PRIu64 " %6.2f%%\n",
+			i + 1, location, loop->iterations, loop->steps,
+			100.0 * loop->steps / table.total_steps);
+	}
+
+	free(table.loops);
+}
+
+static const char *op_names[OP_COUNT] = {
+	[OP_ADD] = "ADD",
+	[OP_MOVE] = "MOVE",
+	[OP_SET] = "SET",
+	[OP_MUL] = "MUL",
+	[OP_OUTPUT] = "OUTPUT",
+	[OP_INPUT] = "INPUT",
+	[OP_JUMP_ZERO] = "JZ",
+	[OP_JUMP_NOT_ZERO] = "JNZ",
+	[OP_END] = "END",
+	[OP_SCAN] = "SCAN",
+	[OP_SWEEP] = "SWEEP",
+};
+
+/*
+ * A sequence of up to three operations, and how many times it ran from its
+ * first instruction to its last.
+ */
+struct sequence {
+	uint8_t ops[3];
+	size_t len;
+	uint64_t runs;
+};
+
+static int
+compare_runs(const void *a, const void *b)
+{
+	const struct sequence *sa = a;
+	const struct sequence *sb = b;
+
+	return (sa->runs < sb->runs) - (sa->runs > sb->runs);
+}
+
+/* Returns true if `op` may not run in the middle of a sequence. */
+static bool
+ends_sequence(const uint8_t op)
+{
+	return op == OP_JUMP_ZERO || op == OP_JUMP_NOT_ZERO || op == OP_SWEEP
+		|| op == OP_END;
+}
+
+void
+profile_print_hot_sequences(FILE *out, const struct matsplat_program *program,
+			    const uint64_t *counts, const size_t top)
+{
+	const size_t width = OP_COUNT * OP_COUNT * OP_COUNT;
+	/* Pairs are counted apart, under their own index past the triples. */
+	struct sequence *sequences = calloc(width + OP_COUNT * OP_COUNT,
+					    sizeof(struct sequence));
+	bool *is_target = calloc(program->len + 1, sizeof(bool));
+	uint64_t total_steps = 0;
+
+	if (sequences == NULL || is_target == NULL) {
+		fprintf(out, "Not enough memory to analyze the profile.\n");
+		free(sequences);
+		free(is_target);
+		return;
+	}
+
+	for (size_t i = 0; i < program->len; i++) {
+		const struct matsplat_instruction in = program->code[i];
+
+		total_steps += counts[i];
+		if (in.op == OP_JUMP_ZERO || in.op == OP_JUMP_NOT_ZERO
+		    || in.op == OP_SWEEP) {
+			is_target[in.jump] = true;
+		}
+	}
+
+	/*
+	 * A sequence runs whole whenever its first instruction runs, as long
+	 * as only its last instruction jumps, and nothing jumps into it.
+	 */
+	for (size_t i = 0; i + 1 < program->len; i++) {
+		const struct matsplat_instruction *in = &program->code[i];
+
+		if (counts[i] == 0 || ends_sequence(in[0].op)
+		    || is_target[i + 1]) {
+			continue;
+		}
+
+		struct sequence *pair = &sequences[width + in[0].op * OP_COUNT
+						   + in[1].op];
+		*pair = (struct sequence) {
+			.ops = { in[0].op, in[1].op },
+			.len = 2,
+			.runs = pair->runs + counts[i]
+		};
+
+		if (i + 2 >= program->len || ends_sequence(in[1].op)
+		    || is_target[i + 2]) {
+			continue;
+		}
+
+		struct sequence *triple = &sequences[(in[0].op * OP_COUNT
+						      + in[1].op) * OP_COUNT
+						     + in[2].op];
+		*triple = (struct sequence) {
+			.ops = { in[0].op, in[1].op, in[2].op },
+			.len = 3,
+			.runs = triple->runs + counts[i]
+		};
+	}
+
+	qsort(sequences, width + OP_COUNT * OP_COUNT, sizeof(struct sequence),
+	      compare_runs);
+
+	fprintf(out, "%4s %-24s %16s %7s\n", "rank", "sequence", "runs",
+		"share");
+	for (size_t i = 0; i < top && sequences[i].runs > 0; i++) {
+		const struct sequence *seq = &sequences[i];
+		char name[32];
+
+		snprintf(name, sizeof(name), "%s; %s%s%s", op_names[seq->ops[0]],
+			 op_names[seq->ops[1]], seq->len == 3 ? "; " : "",
+			 seq->len == 3 ? op_names[seq->ops[2]] : "");
+		fprintf(out, "%4zu %-24s %16" PRIu64 " %6.2f%%\n", i + 1, name,
+			seq->runs, 100.0 * seq->runs / total_steps);
+	}
+
+	free(sequences);
+	free(is_target);
+}
+
+/* Returns the width of the column of `event`, wide enough for its name. */
+static int
+column_width(const enum counter_event event)
+{
+	const size_t len = strlen(counters_name(event));
+
+	return len > 14 ? (int) len : 14;
+}
+
+void
+profile_print_loop_counters(FILE *out, const struct matsplat_program *program,
+			    const uint64_t *counts,
+			    const struct counters *counters, const size_t top)
+{
+	struct loop_table table;
+
+	if (loop_table_create(&table, program, counts) != 0) {
+		fprintf(out, "Not enough memory to analyze the profile.\n");
+		return;
+	}
+
+	qsort(table.loops, table.len, sizeof(struct loop), compare_steps);
+
+	fprintf(out, "%4s %12s", "rank", "location");
+	for (size_t e = 0; e < COUNTER_EVENT_COUNT; e++) {
+		if (counters->samples[e] != NULL) {
+			fprintf(out, " %*s", column_width(e), counters_name(e));
+		}
+	}
+	fprintf(out, "\n");
+
+	for (size_t i = 0; i < table.len && i < top; i++) {
+		const struct loop *loop = &table.loops[i];
+		const struct matsplat_source_position pos =
+			program->positions[loop->start];
+		char location[32];
+
+		if (loop->steps == 0) {
+			break;
+		}
+
+		snprintf(location, sizeof(location), "%" PRIu32 ":%" PRIu32,
+			 pos.column, pos.row);
+		fprintf(out, "%4zu %12s", i + 1, location);
+
+		/* Nested loops lie between the jumps of their parent. */
+		for (size_t e = 0; e < COUNTER_EVENT_COUNT; e++) {
+			uint64_t events = 0;
+
+			if (counters->samples[e] == NULL) {
+				continue;
+			}
+			for (size_t j = loop->start; j <= loop->end; j++) {
+				events += counters->samples[e][j];
+			}
+			fprintf(out, " %*" PRIu64, column_width(e), events);
+		}
+		fprintf(out, "\n");
+	}
+
+	free(table.loops);
+}
+
+/* Writes the stack of loops leading to `loop`, outermost first. */
+static void
+write_stack(FILE *f, const struct matsplat_program *program,
+	    const struct loop *loops, const size_t loop)
+{
+	if (loops[loop].parent != NO_LOOP) {
+		write_stack(f, program, loops, loops[loop].parent);
+	}
+
+	const struct matsplat_source_position pos =
+		program->positions[loops[loop].start];
+	fprintf(f, ";loop@%" PRIu32 ":%" PRIu32, pos.column, pos.row);
+}
+
+int
+profile_write_folded(const char *path, const char *root,
+		     const struct matsplat_program *program,
+		     const uint64_t *counts)
+{
+	struct loop_table table;
+	int err;
+
+	if ((err = loop_table_create(&table, program, counts)) != 0) {
+		return err;
+	}
+
+	FILE *f = fopen(path, "w");
+	if (f == NULL) {
+		err = errno;
+		free(table.loops);
+		return err;
+	}
+
+	if (table.top_level_steps > 0) {
+		fprintf(f, "%s %" PRIu64 "\n", root, table.top_level_steps);
+	}
+
+	for (size_t i = 0; i < table.len; i++) {
+		if (table.loops[i].self_steps > 0) {
+			fputs(root, f);
+			write_stack(f, program, table.loops, i);
+			fprintf(f, " %" PRIu64 "\n", table.loops[i].self_steps);
+		}
+	}
+
+	free(table.loops);
+	if (fclose(f) == EOF) {
+		return errno;
+	}
+
+	return 0;
+}
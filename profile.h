@@ -0,0 +1,67 @@
+/*
+ * Mattersplatter - a compiler & interpreter for the Brainf*ck language.
+ * Copyright (C) 2021 Maxwell R. Haley <maxwell.r.haley@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef MATTERSPLATTER_PROFILE_H
+#define MATTERSPLATTER_PROFILE_H
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <mattersplatter.h>
+
+#include "counters.h"
+
+/*
+ * Prints the `top` loops of `program` that executed the most instructions to
+ * `out`. `counts` holds the execution count of each instruction, as collected
+ * through `matsplat_execute_options.profile`.
+ */
+void
+profile_print_hot_loops(FILE *out, const struct matsplat_program *program,
+			const uint64_t *counts, const size_t top);
+
+/*
+ * Prints the `top` sequences of two or three operations that `program` ran
+ * the most to `out`, counting only sequences that always run whole: nothing
+ * jumps into them, and only their last instruction jumps.
+ */
+void
+profile_print_hot_sequences(FILE *out, const struct matsplat_program *program,
+			    const uint64_t *counts, const size_t top);
+
+/*
+ * Prints the counter events of the `top` loops of `program` that executed the
+ * most instructions to `out`, as estimated from the samples of `counters`.
+ * The events of a loop include those of the loops nested in it.
+ */
+void
+profile_print_loop_counters(FILE *out, const struct matsplat_program *program,
+			    const uint64_t *counts,
+			    const struct counters *counters, const size_t top);
+
+/*
+ * Writes the profile to `path` in the folded stack format read by flame graph
+ * tools. Each line is a stack of nested loops under the `root` frame, followed
+ * by the amount of instructions executed directly in the innermost loop.
+ * Returns 0 on success, or an errno value on failure.
+ */
+int
+profile_write_folded(const char *path, const char *root,
+		     const struct matsplat_program *program,
+		     const uint64_t *counts);
+
+#endif // MATTERSPLATTER_PROFILE_H
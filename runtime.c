@@ -0,0 +1,55 @@
+/*
+ * Mattersplatter - a compiler & interpreter for the Brainf*ck language.
+ * Copyright (C) 2021 Maxwell R. Haley <maxwell.r.haley@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The runtime of bundles written by `mattersplatter -t bundle`. It executes
+ * the program appended to its own executable, which it maps as is, so nothing
+ * is lexed or optimized when a bundle starts.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <mattersplatter.h>
+
+int
+main(int argc, char *argv[])
+{
+	struct matsplat_program program;
+	(void) argc;
+
+	int err = matsplat_program_load_bundle("/proc/self/exe", &program);
+	if (err != 0) {
+		fprintf(stderr, "%s: No program is bundled: %s\n", argv[0],
+			strerror(err));
+		return EXIT_FAILURE;
+	}
+
+	struct matsplat_execution_result result =
+		matsplat_program_execute(&program);
+	matsplat_program_destroy(program);
+	if (result.memory_cells == NULL) {
+		fprintf(stderr, "%s: Error executing: %s\n", argv[0],
+			strerror(ENOMEM));
+		return EXIT_FAILURE;
+	}
+
+	matsplat_execution_result_destory(result);
+	return EXIT_SUCCESS;
+}
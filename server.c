@@ -0,0 +1,760 @@
+/*
+ * Mattersplatter - a compiler & interpreter for the Brainf*ck language.
+ * Copyright (C) 2021 Maxwell R. Haley <maxwell.r.haley@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <mattersplatter.h>
+
+#include "server.h"
+
+#define REQUEST_MAGIC "MSRQ"
+#define RESPONSE_MAGIC "MSRS"
+#define MAX_REQUEST_LEN (1ULL << 30)
+#define MAX_REQUEST_CELLS (1ULL << 30)
+#define OUTPUT_BUFFER_SIZE 4096
+
+/*
+ * Header of a request. It is followed by `src_len` bytes of source code, and
+ * `input_len` bytes of input for the program. All fields are in host byte
+ * order. `eof` is the `enum matsplat_eof` of the program, and a `cell_count`
+ * of 0 selects the server's default.
+ */
+struct request_header {
+	char magic[4];
+	uint32_t eof;
+	uint64_t cell_count;
+	uint64_t src_len;
+	uint64_t input_len;
+};
+
+/*
+ * Trailer of a response, sent after the output of the program. `status` is 0
+ * if the program ended, or the errno value of why it did not run to its end.
+ */
+struct response_trailer {
+	char magic[4];
+	int32_t status;
+};
+
+/*
+ * An optimized program kept in memory. Entries are reference counted: the
+ * cache holds one reference for as long as the entry is cached, and every
+ * request executing the program holds another.
+ */
+struct cache_entry {
+	uint64_t key;
+	char *src_code;
+	size_t src_len;
+	size_t cell_count;
+	struct matsplat_program program;
+	size_t refs;
+	struct cache_entry *newer;
+	struct cache_entry *older;
+	struct cache_entry *bucket_next;
+};
+
+/* A hash table of programs, with the entries also kept in LRU order. */
+struct program_cache {
+	pthread_mutex_t lock;
+	struct cache_entry **buckets;
+	size_t bucket_count;
+	struct cache_entry *newest;
+	struct cache_entry *oldest;
+	size_t len;
+	size_t capacity;
+};
+
+/* Accepted connections waiting for a worker. */
+struct connection_queue {
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+	int *fds;
+	size_t cap;
+	size_t head;
+	size_t len;
+	bool is_closed;
+};
+
+/* State of a single request, also used as the context of its I/O callbacks. */
+struct connection {
+	int fd;
+	const unsigned char *input;
+	size_t input_len;
+	size_t input_pos;
+	unsigned char output[OUTPUT_BUFFER_SIZE];
+	size_t output_len;
+	bool has_failed;
+	bool is_cancelled;
+};
+
+struct server {
+	const struct server_options *options;
+	struct program_cache cache;
+	struct connection_queue queue;
+};
+
+static volatile sig_atomic_t is_stopping = 0;
+
+static void
+handle_stop_signal(int sig)
+{
+	(void) sig;
+	is_stopping = 1;
+}
+
+static void
+log_v(const struct server_options *options, const char *format, ...)
+{
+	if (options->is_verbose) {
+		va_list args;
+		va_start(args, format);
+		fprintf(stderr, "[%s] ", options->socket_path);
+		vfprintf(stderr, format, args);
+		va_end(args);
+	}
+}
+
+static int
+read_all(const int fd, void *data, size_t len)
+{
+	char *bytes = data;
+
+	while (len > 0) {
+		ssize_t read_len = read(fd, bytes, len);
+		if (read_len == 0) {
+			return ECONNRESET;
+		} else if (read_len == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return errno;
+		}
+		bytes += read_len;
+		len -= read_len;
+	}
+
+	return 0;
+}
+
+static int
+send_all(const int fd, const void *data, size_t len)
+{
+	const char *bytes = data;
+
+	while (len > 0) {
+		ssize_t sent = send(fd, bytes, len, MSG_NOSIGNAL);
+		if (sent == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return errno;
+		}
+		bytes += sent;
+		len -= sent;
+	}
+
+	return 0;
+}
+
+static int
+connection_read(void *ctx)
+{
+	struct connection *conn = ctx;
+
+	if (conn->input_pos == conn->input_len) {
+		return -1;
+	}
+
+	return conn->input[conn->input_pos++];
+}
+
+static int
+connection_flush(struct connection *conn)
+{
+	if (conn->output_len > 0
+	    && send_all(conn->fd, conn->output, conn->output_len) != 0) {
+		conn->has_failed = true;
+		return -1;
+	}
+
+	conn->output_len = 0;
+	return 0;
+}
+
+static int
+connection_write(int c, void *ctx)
+{
+	struct connection *conn = ctx;
+
+	if (conn->output_len == OUTPUT_BUFFER_SIZE
+	    && connection_flush(conn) != 0) {
+		/* The client is gone, so stop the program. */
+		return -1;
+	}
+
+	conn->output[conn->output_len++] = c;
+	return c;
+}
+
+/*
+ * Stops the program of a connection once its client hung up, since nothing
+ * would read its output, or once the server is shutting down.
+ */
+static bool
+connection_is_cancelled(void *ctx)
+{
+	struct connection *conn = ctx;
+	struct pollfd pfd = { .fd = conn->fd };
+
+	if (poll(&pfd, 1, 0) == 1 && (pfd.revents & (POLLHUP | POLLERR)) != 0) {
+		conn->has_failed = true;
+	}
+	conn->is_cancelled = conn->has_failed || is_stopping;
+
+	return conn->is_cancelled;
+}
+
+/* Ends a response with `status`, unless the client is gone already. */
+static void
+send_trailer(const int fd, const int status)
+{
+	struct response_trailer trailer = { .status = status };
+
+	memcpy(trailer.magic, RESPONSE_MAGIC, sizeof(trailer.magic));
+	send_all(fd, &trailer, sizeof(trailer));
+}
+
+/*
+ * Discards what is left of a dropped request. Closing a socket with unread
+ * data resets the connection, and the client would lose the trailer.
+ */
+static void
+discard_request(const int fd)
+{
+	char buffer[OUTPUT_BUFFER_SIZE];
+	ssize_t len;
+
+	do {
+		len = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+	} while (len > 0);
+}
+
+static void
+cache_entry_release(struct program_cache *cache, struct cache_entry *entry)
+{
+	pthread_mutex_lock(&cache->lock);
+	size_t refs = --entry->refs;
+	pthread_mutex_unlock(&cache->lock);
+
+	if (refs == 0) {
+		matsplat_program_destroy(entry->program);
+		free(entry->src_code);
+		free(entry);
+	}
+}
+
+static void
+lru_unlink(struct program_cache *cache, struct cache_entry *entry)
+{
+	if (entry->newer) {
+		entry->newer->older = entry->older;
+	} else {
+		cache->newest = entry->older;
+	}
+
+	if (entry->older) {
+		entry->older->newer = entry->newer;
+	} else {
+		cache->oldest = entry->newer;
+	}
+
+	entry->newer = NULL;
+	entry->older = NULL;
+}
+
+static void
+lru_push(struct program_cache *cache, struct cache_entry *entry)
+{
+	entry->older = cache->newest;
+	entry->newer = NULL;
+
+	if (cache->newest) {
+		cache->newest->newer = entry;
+	} else {
+		cache->oldest = entry;
+	}
+	cache->newest = entry;
+}
+
+/* Looks up a program, taking a reference on it. Requires the cache lock. */
+static struct cache_entry *
+cache_find(struct program_cache *cache, const uint64_t key,
+	   const char *src_code, const size_t src_len, const size_t cell_count)
+{
+	struct cache_entry *entry =
+		cache->buckets[key & (cache->bucket_count - 1)];
+
+	for (; entry != NULL; entry = entry->bucket_next) {
+		if (entry->key == key && entry->cell_count == cell_count
+		    && entry->src_len == src_len
+		    && memcmp(entry->src_code, src_code, src_len) == 0) {
+			lru_unlink(cache, entry);
+			lru_push(cache, entry);
+			entry->refs++;
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+/* Removes the least recently used program. Requires the cache lock. */
+static struct cache_entry *
+cache_evict(struct program_cache *cache)
+{
+	struct cache_entry *entry = cache->oldest;
+	struct cache_entry **link =
+		&cache->buckets[entry->key & (cache->bucket_count - 1)];
+
+	while (*link != entry) {
+		link = &(*link)->bucket_next;
+	}
+	*link = entry->bucket_next;
+
+	lru_unlink(cache, entry);
+	cache->len--;
+	return entry;
+}
+
+/*
+ * Builds the program for a request, going through the on-disk bytecode cache
+ * shared with batch mode when it is enabled.
+ */
+static struct matsplat_program
+build_program(const struct server_options *options, const uint64_t key,
+	      const char *src_code, const size_t src_len,
+	      const size_t cell_count)
+{
+	struct matsplat_program program = {0};
+	char path[PATH_MAX];
+	bool use_disk = options->use_cache
+		&& matsplat_cache_path(path, PATH_MAX, key, "bfc") == 0;
+
+	if (use_disk && matsplat_program_load(path, &program) == 0) {
+		return program;
+	}
+
+	struct matsplat_tokenize_result tokens =
+		matsplat_tokenize(src_code, src_len);
+	struct matsplat_node *ast = matsplat_ast_create(tokens.tokens,
+							tokens.len);
+	program = matsplat_program_create(ast, cell_count);
+	matsplat_ast_destroy(ast);
+	matsplat_tokenize_destory(tokens);
+
+	if (program.error_code == 0 && use_disk) {
+		matsplat_program_save(&program, path);
+	}
+
+	return program;
+}
+
+/*
+ * Returns the cached program for the given source, building and caching it on
+ * a miss. The caller must release the returned entry. Returns NULL, with the
+ * errno value of why in `err`, if the program could not be built.
+ */
+static struct cache_entry *
+cache_get(struct server *server, char *src_code, const size_t src_len,
+	  const size_t cell_count, int *err)
+{
+	struct program_cache *cache = &server->cache;
+	const uint64_t key = matsplat_cache_key(src_code, src_len, cell_count);
+
+	pthread_mutex_lock(&cache->lock);
+	struct cache_entry *entry =
+		cache_find(cache, key, src_code, src_len, cell_count);
+	pthread_mutex_unlock(&cache->lock);
+	if (entry) {
+		return entry;
+	}
+
+	/* Build outside of the lock, so other requests are not held up. */
+	struct cache_entry *built = calloc(1, sizeof(*built));
+	if (built == NULL) {
+		*err = ENOMEM;
+		return NULL;
+	}
+
+	built->program = build_program(server->options, key, src_code,
+				       src_len, cell_count);
+	if (built->program.error_code != 0) {
+		*err = built->program.error_code;
+		free(built);
+		return NULL;
+	}
+	built->key = key;
+	built->src_code = src_code;
+	built->src_len = src_len;
+	built->cell_count = cell_count;
+	built->refs = 2;
+
+	struct cache_entry *evicted = NULL;
+	pthread_mutex_lock(&cache->lock);
+	entry = cache_find(cache, key, src_code, src_len, cell_count);
+	if (entry == NULL) {
+		struct cache_entry **bucket =
+			&cache->buckets[key & (cache->bucket_count - 1)];
+		built->bucket_next = *bucket;
+		*bucket = built;
+		lru_push(cache, built);
+		cache->len++;
+		if (cache->len > cache->capacity) {
+			evicted = cache_evict(cache);
+		}
+	}
+	pthread_mutex_unlock(&cache->lock);
+
+	if (evicted) {
+		cache_entry_release(cache, evicted);
+	}
+
+	/* Another request cached the same program in the meantime. */
+	if (entry) {
+		matsplat_program_destroy(built->program);
+		free(built);
+		return entry;
+	}
+
+	return built;
+}
+
+static void
+handle_connection(struct server *server, const int fd)
+{
+	const struct server_options *options = server->options;
+	struct request_header header;
+	struct connection *conn = NULL;
+	char *src_code = NULL;
+	unsigned char *input = NULL;
+	int err;
+
+	if ((err = read_all(fd, &header, sizeof(header))) != 0) {
+		goto handle_connection_error;
+	}
+
+	if (memcmp(header.magic, REQUEST_MAGIC, sizeof(header.magic)) != 0
+	    || header.eof > MATSPLAT_EOF_MINUS_ONE
+	    || header.src_len > MAX_REQUEST_LEN
+	    || header.input_len > MAX_REQUEST_LEN
+	    || header.cell_count > MAX_REQUEST_CELLS) {
+		err = EPROTO;
+		goto handle_connection_error;
+	}
+
+	const size_t cell_count = header.cell_count != 0
+		? header.cell_count : options->cell_count;
+
+	/* The lexer reads the terminating NUL as the END token. */
+	src_code = calloc(header.src_len + 1, sizeof(char));
+	input = malloc(header.input_len + 1);
+	conn = malloc(sizeof(*conn));
+	if (src_code == NULL || input == NULL || conn == NULL) {
+		err = ENOMEM;
+		goto handle_connection_error;
+	}
+
+	if ((err = read_all(fd, src_code, header.src_len)) != 0
+	    || (err = read_all(fd, input, header.input_len)) != 0) {
+		goto handle_connection_error;
+	}
+
+	struct cache_entry *entry =
+		cache_get(server, src_code, header.src_len, cell_count, &err);
+	if (entry == NULL) {
+		goto handle_connection_error;
+	}
+
+	/* The source now belongs to the cache if it was not cached before. */
+	if (entry->src_code == src_code) {
+		src_code = NULL;
+	}
+
+	*conn = (struct connection) {
+		.fd = fd, .input = input, .input_len = header.input_len
+	};
+	struct matsplat_io_callbacks io = {
+		.read = connection_read, .write = connection_write, .ctx = conn
+	};
+	const struct matsplat_execute_options exec_options = {
+		.io = &io,
+		.eof = header.eof,
+		.is_cancelled = connection_is_cancelled,
+		.cancel_ctx = conn
+	};
+
+	struct matsplat_execution_result result =
+		matsplat_program_execute_with_options(&entry->program,
+						      &exec_options);
+	connection_flush(conn);
+	cache_entry_release(&server->cache, entry);
+
+	if (result.memory_cells == NULL) {
+		err = ENOMEM;
+		log_v(options, "Dropped request: %s\n", strerror(err));
+	} else if (conn->has_failed) {
+		log_v(options, "Client disconnected before the end of output.\n");
+	} else if (conn->is_cancelled) {
+		err = ECANCELED;
+		log_v(options, "Stopped request: %s\n", strerror(err));
+	}
+	if (!conn->has_failed) {
+		send_trailer(fd, err);
+	}
+	matsplat_execution_result_destory(result);
+
+	free(conn);
+	free(input);
+	free(src_code);
+	return;
+
+handle_connection_error:
+	log_v(options, "Dropped request: %s\n", strerror(err));
+	send_trailer(fd, err);
+	discard_request(fd);
+	free(conn);
+	free(input);
+	free(src_code);
+}
+
+static void *
+worker_main(void *arg)
+{
+	struct server *server = arg;
+	struct connection_queue *queue = &server->queue;
+
+	for (;;) {
+		pthread_mutex_lock(&queue->lock);
+		while (queue->len == 0 && !queue->is_closed) {
+			pthread_cond_wait(&queue->not_empty, &queue->lock);
+		}
+
+		if (queue->len == 0) {
+			pthread_mutex_unlock(&queue->lock);
+			return NULL;
+		}
+
+		int fd = queue->fds[queue->head];
+		queue->head = (queue->head + 1) % queue->cap;
+		queue->len--;
+		pthread_cond_signal(&queue->not_full);
+		pthread_mutex_unlock(&queue->lock);
+
+		handle_connection(server, fd);
+		close(fd);
+	}
+}
+
+static void
+queue_push(struct connection_queue *queue, const int fd)
+{
+	pthread_mutex_lock(&queue->lock);
+	while (queue->len == queue->cap) {
+		pthread_cond_wait(&queue->not_full, &queue->lock);
+	}
+
+	queue->fds[(queue->head + queue->len) % queue->cap] = fd;
+	queue->len++;
+	pthread_cond_signal(&queue->not_empty);
+	pthread_mutex_unlock(&queue->lock);
+}
+
+static void
+queue_close(struct connection_queue *queue)
+{
+	pthread_mutex_lock(&queue->lock);
+	queue->is_closed = true;
+	pthread_cond_broadcast(&queue->not_empty);
+	pthread_mutex_unlock(&queue->lock);
+}
+
+/*
+ * Creates the listening socket. A socket file left behind by a server that is
+ * no longer running is replaced, but a live server is never taken over.
+ */
+static int
+open_socket(const char *path, int *out_fd)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	int err;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		return ENAMETOOLONG;
+	}
+	strcpy(addr.sun_path, path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1) {
+		return errno;
+	}
+
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+		err = errno;
+		if (err != EADDRINUSE) {
+			goto open_socket_error;
+		}
+
+		int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+		bool is_live = probe != -1 && connect(probe,
+			(struct sockaddr *) &addr, sizeof(addr)) == 0;
+		if (probe != -1) {
+			close(probe);
+		}
+
+		if (is_live || unlink(path) == -1
+		    || bind(fd, (struct sockaddr *) &addr, sizeof(addr))
+		    == -1) {
+			err = is_live ? EADDRINUSE : errno;
+			goto open_socket_error;
+		}
+	}
+
+	if (listen(fd, SOMAXCONN) == -1) {
+		err = errno;
+		unlink(path);
+		goto open_socket_error;
+	}
+
+	*out_fd = fd;
+	return 0;
+
+open_socket_error:
+	close(fd);
+	return err;
+}
+
+int
+serve(const struct server_options *options)
+{
+	struct server server = { .options = options };
+	pthread_t *workers = NULL;
+	size_t worker_count = 0;
+	int listen_fd = -1;
+	int err = 0;
+	sigset_t stop_signals;
+
+	size_t bucket_count = 1;
+	while (bucket_count < options->cache_entries * 2) {
+		bucket_count *= 2;
+	}
+
+	server.cache = (struct program_cache) {
+		.buckets = calloc(bucket_count, sizeof(struct cache_entry *)),
+		.bucket_count = bucket_count,
+		.capacity = options->cache_entries
+	};
+	server.queue = (struct connection_queue) {
+		.fds = calloc(options->workers * 4, sizeof(int)),
+		.cap = options->workers * 4
+	};
+	workers = calloc(options->workers, sizeof(pthread_t));
+	if (server.cache.buckets == NULL || server.queue.fds == NULL
+	    || workers == NULL) {
+		err = ENOMEM;
+		goto serve_cleanup;
+	}
+	pthread_mutex_init(&server.cache.lock, NULL);
+	pthread_mutex_init(&server.queue.lock, NULL);
+	pthread_cond_init(&server.queue.not_empty, NULL);
+	pthread_cond_init(&server.queue.not_full, NULL);
+
+	if ((err = open_socket(options->socket_path, &listen_fd)) != 0) {
+		goto serve_cleanup;
+	}
+
+	/*
+	 * Stop signals are only handled by this thread, so they are sure to
+	 * interrupt `accept`. Workers inherit the blocked mask.
+	 */
+	struct sigaction stop_action = { .sa_handler = handle_stop_signal };
+	struct sigaction ignore_action = { .sa_handler = SIG_IGN };
+	sigemptyset(&stop_action.sa_mask);
+	sigemptyset(&ignore_action.sa_mask);
+	sigaction(SIGINT, &stop_action, NULL);
+	sigaction(SIGTERM, &stop_action, NULL);
+	sigaction(SIGPIPE, &ignore_action, NULL);
+
+	sigemptyset(&stop_signals);
+	sigaddset(&stop_signals, SIGINT);
+	sigaddset(&stop_signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+	for (; worker_count < options->workers; worker_count++) {
+		if ((err = pthread_create(&workers[worker_count], NULL,
+					  worker_main, &server)) != 0) {
+			break;
+		}
+	}
+	pthread_sigmask(SIG_UNBLOCK, &stop_signals, NULL);
+
+	if (err == 0) {
+		log_v(options, "Serving with %zu workers.\n", worker_count);
+	}
+
+	while (err == 0 && !is_stopping) {
+		int fd = accept(listen_fd, NULL, NULL);
+		if (fd == -1) {
+			if (errno != EINTR && errno != ECONNABORTED) {
+				err = errno;
+			}
+			continue;
+		}
+		queue_push(&server.queue, fd);
+	}
+
+	log_v(options, "Shutting down.\n");
+	close(listen_fd);
+	unlink(options->socket_path);
+	queue_close(&server.queue);
+	for (size_t i = 0; i < worker_count; i++) {
+		pthread_join(workers[i], NULL);
+	}
+
+	while (server.cache.len > 0) {
+		cache_entry_release(&server.cache, cache_evict(&server.cache));
+	}
+
+serve_cleanup:
+	free(workers);
+	free(server.queue.fds);
+	free(server.cache.buckets);
+	return err;
+}
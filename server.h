@@ -0,0 +1,45 @@
+/*
+ * Mattersplatter - a compiler & interpreter for the Brainf*ck language.
+ * Copyright (C) 2021 Maxwell R. Haley <maxwell.r.haley@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef MATTERSPLATTER_SERVER_H
+#define MATTERSPLATTER_SERVER_H
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Options of the execution server. `cell_count` is used for requests that do
+ * not ask for a specific amount of cells. `cache_entries` is the amount of
+ * optimized programs kept in memory.
+ */
+struct server_options {
+	const char *socket_path;
+	size_t cell_count;
+	size_t workers;
+	size_t cache_entries;
+	bool use_cache;
+	bool is_verbose;
+};
+
+/*
+ * Listens on the Unix socket at `socket_path` and executes the programs sent
+ * to it until interrupted by SIGINT or SIGTERM. Returns 0 on a clean shutdown,
+ * or an errno value if the server could not be started.
+ */
+int
+serve(const struct server_options *options);
+
+#endif // MATTERSPLATTER_SERVER_H
@@ -0,0 +1,169 @@
+/*
+ * Mattersplatter - a compiler & interpreter for the Brainf*ck language.
+ * Copyright (C) 2021 Maxwell R. Haley <maxwell.r.haley@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include <mattersplatter.h>
+
+#include "stats.h"
+
+static const char *phase_names[STATS_PHASE_COUNT] = {
+	[STATS_LOAD] = "load",
+	[STATS_TOKENIZE] = "tokenize",
+	[STATS_PARSE] = "parse",
+	[STATS_OPTIMIZE] = "optimize",
+	[STATS_CODEGEN] = "codegen",
+	[STATS_NASM] = "nasm",
+	[STATS_LD] = "ld",
+	[STATS_CC] = "cc",
+	[STATS_EXECUTE] = "execute",
+};
+
+void
+stats_begin(struct stats *stats)
+{
+	if (stats->format != STATS_NONE) {
+		clock_gettime(CLOCK_MONOTONIC, &stats->phase_start);
+	}
+}
+
+void
+stats_end(struct stats *stats, const enum stats_phase phase)
+{
+	struct timespec now;
+	struct rusage usage = {0};
+
+	if (stats->format == STATS_NONE) {
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	/* NASM, LD and CC run as child processes, waited for by `pclose`. */
+	getrusage(phase == STATS_NASM || phase == STATS_LD || phase == STATS_CC
+		  ? RUSAGE_CHILDREN : RUSAGE_SELF, &usage);
+
+	struct phase_stats *p = &stats->phases[phase];
+	p->has_run = true;
+	p->seconds += (double) (now.tv_sec - stats->phase_start.tv_sec)
+		+ (double) (now.tv_nsec - stats->phase_start.tv_nsec) / 1e9;
+	p->max_rss_kib = usage.ru_maxrss;
+}
+
+uint64_t
+stats_count_nodes(const struct matsplat_node *root)
+{
+	uint64_t count = 0;
+
+	/* Follow sequences iteratively, and only recurse into loop bodies. */
+	for (const struct matsplat_node *n = root; n != NULL;
+	     n = n->right_child) {
+		count++;
+		if (n->left_child != NULL) {
+			count += stats_count_nodes(n->left_child);
+		}
+	}
+
+	return count;
+}
+
+static void
+print_text(FILE *out, const struct stats *stats)
+{
+	double total = 0;
+
+	fprintf(out, "%-10s %12s %14s\n", "phase", "seconds", "max rss (KiB)");
+	for (size_t i = 0; i < STATS_PHASE_COUNT; i++) {
+		const struct phase_stats *p = &stats->phases[i];
+		if (p->has_run) {
+			fprintf(out, "%-10s %12.6f %14ld\n", phase_names[i],
+				p->seconds, p->max_rss_kib);
+			total += p->seconds;
+		}
+	}
+	fprintf(out, "%-10s %12.6f\n", "total", total);
+
+	fprintf(out, "source bytes %" PRIu64 ", tokens %" PRIu64
+		", nodes %" PRIu64 ", instructions %" PRIu64 "\n",
+		stats->source_bytes, stats->tokens, stats->nodes,
+		stats->instructions);
+	if (stats->asm_bytes > 0) {
+		fprintf(out, "assembly bytes %" PRIu64 "\n", stats->asm_bytes);
+	}
+	if (stats->has_executed) {
+		fprintf(out, "executed %" PRIu64 " instructions, read %" PRIu64
+			" bytes, wrote %" PRIu64 " bytes\n",
+			stats->execution.steps, stats->execution.bytes_read,
+			stats->execution.bytes_written);
+	}
+	if (stats->has_executed && stats->execution.memo_lookups > 0) {
+		fprintf(out, "memoized loops hit %" PRIu64 " of %" PRIu64
+			" lookups (%.1f%%)\n", stats->execution.memo_hits,
+			stats->execution.memo_lookups,
+			100.0 * (double) stats->execution.memo_hits
+			/ (double) stats->execution.memo_lookups);
+	}
+}
+
+static void
+print_json(FILE *out, const struct stats *stats)
+{
+	const char *separator = "";
+
+	fprintf(out, "{\"phases\": {");
+	for (size_t i = 0; i < STATS_PHASE_COUNT; i++) {
+		const struct phase_stats *p = &stats->phases[i];
+		if (p->has_run) {
+			fprintf(out, "%s\"%s\": {\"seconds\": %.9f, "
+				"\"max_rss_kib\": %ld}", separator,
+				phase_names[i], p->seconds, p->max_rss_kib);
+			separator = ", ";
+		}
+	}
+
+	fprintf(out, "}, \"source_bytes\": %" PRIu64 ", \"tokens\": %" PRIu64
+		", \"nodes\": %" PRIu64 ", \"instructions\": %" PRIu64
+		", \"asm_bytes\": %" PRIu64, stats->source_bytes, stats->tokens,
+		stats->nodes, stats->instructions, stats->asm_bytes);
+	if (stats->has_executed) {
+		fprintf(out, ", \"executed_instructions\": %" PRIu64
+			", \"bytes_read\": %" PRIu64
+			", \"bytes_written\": %" PRIu64
+			", \"memo_lookups\": %" PRIu64
+			", \"memo_hits\": %" PRIu64,
+			stats->execution.steps, stats->execution.bytes_read,
+			stats->execution.bytes_written,
+			stats->execution.memo_lookups,
+			stats->execution.memo_hits);
+	}
+	fprintf(out, "}\n");
+}
+
+void
+stats_print(FILE *out, const struct stats *stats)
+{
+	if (stats->format == STATS_TEXT) {
+		print_text(out, stats);
+	} else if (stats->format == STATS_JSON) {
+		print_json(out, stats);
+	}
+}
@@ -0,0 +1,91 @@
+/*
+ * Mattersplatter - a compiler & interpreter for the Brainf*ck language.
+ * Copyright (C) 2021 Maxwell R. Haley <maxwell.r.haley@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef MATTERSPLATTER_STATS_H
+#define MATTERSPLATTER_STATS_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <mattersplatter.h>
+
+/* The phases of a run of mattersplatter, in the order they happen. */
+enum stats_phase {
+STATS_LOAD,
+STATS_TOKENIZE,
+STATS_PARSE,
+STATS_OPTIMIZE,
+STATS_CODEGEN,
+STATS_NASM,
+STATS_LD,
+STATS_CC,
+STATS_EXECUTE,
+STATS_PHASE_COUNT
+};
+
+enum stats_format {
+STATS_NONE,
+STATS_TEXT,
+STATS_JSON,
+};
+
+struct phase_stats {
+	bool has_run;
+	double seconds;
+	/* Peak resident set at the end of the phase, of NASM and LD for theirs. */
+	long max_rss_kib;
+};
+
+/*
+ * Statistics of a run. Phases are timed from the last `stats_begin` to their
+ * `stats_end`, so phases that did not run are left out of the report.
+ */
+struct stats {
+	enum stats_format format;
+	struct timespec phase_start;
+	struct phase_stats phases[STATS_PHASE_COUNT];
+	uint64_t source_bytes;
+	uint64_t tokens;
+	uint64_t nodes;
+	uint64_t instructions;
+	uint64_t asm_bytes;
+	bool has_executed;
+	struct matsplat_execution_stats execution;
+};
+
+/* Starts timing a phase. */
+void
+stats_begin(struct stats *stats);
+
+/*
+ * Records the time and peak memory of `phase`, which started at the last
+ * `stats_begin`. The times of a phase entered more than once add up.
+ */
+void
+stats_end(struct stats *stats, const enum stats_phase phase);
+
+/* Returns the amount of nodes of the AST at `root`. */
+uint64_t
+stats_count_nodes(const struct matsplat_node *root);
+
+/* Prints the statistics to `out` in their format, as a single line for JSON. */
+void
+stats_print(FILE *out, const struct stats *stats);
+
+#endif // MATTERSPLATTER_STATS_H
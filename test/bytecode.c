@@ -0,0 +1,352 @@
+/*
+ * Mattersplatter - a compiler & interpreter for the Brainf*ck language.
+ * Copyright (C) 2021 Maxwell R. Haley <maxwell.r.haley@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Tests the `.bfc` format: saves a program and loads it back, bundles it into
+ * a copy of the runtime and loads it back, and checks that files corrupted in
+ * every field the loader validates are rejected with the right errno value.
+ */
+#define _DEFAULT_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <mattersplatter.h>
+
+/* Mirrors the header that lib/bytecode.c writes before the instructions. */
+struct bytecode_header {
+	char magic[4];
+	uint32_t version;
+	uint64_t cell_count;
+	uint64_t len;
+};
+
+/* A saved program, held in memory to be corrupted. */
+struct image {
+	unsigned char *bytes;
+	size_t len;
+};
+
+static const char *usage_msg =
+	"Usage: mattersplatter-bytecode-test runtime filename";
+
+static char dir[PATH_MAX];
+static int failures;
+
+static void
+check(const bool is_ok, const char *what)
+{
+	if (!is_ok) {
+		fprintf(stderr, "FAIL: %s\n", what);
+		failures++;
+	}
+}
+
+/* Points `path` at `name` in the test's directory. Returns false if too long. */
+static bool
+test_path(char *path, const char *name)
+{
+	int written = snprintf(path, PATH_MAX, "%s/%s", dir, name);
+	return written > 0 && written < PATH_MAX;
+}
+
+/* Reads the file at `path` into `image`. Returns 0, or an errno value. */
+static int
+read_image(const char *path, struct image *image)
+{
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) {
+		return errno;
+	}
+
+	int err = 0;
+	if (fseek(file, 0, SEEK_END) == -1) {
+		err = errno;
+	} else {
+		long size = ftell(file);
+		image->len = size < 0 ? 0 : (size_t) size;
+		image->bytes = malloc(image->len + 1);
+		rewind(file);
+		if (size < 0 || image->bytes == NULL) {
+			err = ENOMEM;
+		} else if (fread(image->bytes, 1, image->len, file)
+			   != image->len) {
+			err = EIO;
+		}
+	}
+
+	fclose(file);
+	return err;
+}
+
+/* Writes the first `len` bytes of `image` to `path`. Returns 0, or EIO. */
+static int
+write_image(const char *path, const struct image *image, const size_t len)
+{
+	FILE *file = fopen(path, "wb");
+	if (file == NULL) {
+		return errno;
+	}
+
+	bool is_written = fwrite(image->bytes, 1, len, file) == len;
+	if (fclose(file) != 0 || !is_written) {
+		return EIO;
+	}
+
+	return 0;
+}
+
+/* Returns true if both programs hold the same code, tape and positions. */
+static bool
+programs_match(const struct matsplat_program *a,
+	       const struct matsplat_program *b)
+{
+	return a->len == b->len && a->cell_count == b->cell_count
+		&& a->bounded_cells == b->bounded_cells
+		&& memcmp(a->code, b->code, a->len * sizeof(*a->code)) == 0
+		&& memcmp(a->positions, b->positions,
+			  a->len * sizeof(*a->positions)) == 0;
+}
+
+/* Returns the index of the first instruction `op` in `program`, or its len. */
+static size_t
+find_op(const struct matsplat_program *program, const enum matsplat_op op,
+	const bool is_counted)
+{
+	size_t i = 0;
+
+	while (i < program->len && (program->code[i].op != op
+				    || (is_counted && program->code[i].arg == 0))) {
+		i++;
+	}
+
+	return i;
+}
+
+/*
+ * Writes `image` to a file with the `width` bytes at byte `at` set to
+ * `value`, or cut short at byte `at` if `is_truncated`, and checks that loading
+ * it fails with `expected`.
+ */
+static void
+check_corrupt(const struct image *image, const size_t at,
+	      const uint64_t value, const size_t width, const bool is_truncated,
+	      const int expected, const char *what)
+{
+	char path[PATH_MAX];
+	struct matsplat_program program;
+
+	if (!test_path(path, "corrupt.bfc") || at + width > image->len) {
+		check(false, what);
+		return;
+	}
+
+	unsigned char saved[sizeof(value)];
+	memcpy(saved, image->bytes + at, width);
+	memcpy(image->bytes + at, &value, width);
+	int err = write_image(path, image, is_truncated ? at : image->len);
+	memcpy(image->bytes + at, saved, width);
+	if (err != 0) {
+		check(false, what);
+		return;
+	}
+
+	err = matsplat_program_load(path, &program);
+	if (err == 0) {
+		matsplat_program_destroy(program);
+	}
+	check(err == expected, what);
+	unlink(path);
+}
+
+/* Byte at which field `field` of instruction `i` is saved. */
+#define AT(i, field) (sizeof(struct bytecode_header) \
+	+ (i) * sizeof(struct matsplat_instruction) \
+	+ offsetof(struct matsplat_instruction, field))
+
+/* Corrupts every field the loader validates, one at a time. */
+static void
+check_corrupt_files(const struct matsplat_program *program,
+		    const struct image *image)
+{
+	const uint64_t cells = program->cell_count;
+	const size_t end = program->len - 1;
+	const size_t jz = find_op(program, OP_JUMP_ZERO, false);
+	const size_t counted = find_op(program, OP_JUMP_ZERO, true);
+	const size_t jnz = find_op(program, OP_JUMP_NOT_ZERO, false);
+	const size_t add = find_op(program, OP_ADD, false);
+	const size_t move = find_op(program, OP_MOVE, false);
+	uint32_t version;
+
+	if (jz == program->len || counted == program->len
+	    || jnz == program->len || add == program->len
+	    || move == program->len) {
+		check(false, "finding the instructions to corrupt");
+		return;
+	}
+
+	memcpy(&version,
+	       image->bytes + offsetof(struct bytecode_header, version),
+	       sizeof(version));
+
+	check_corrupt(image, 0, 0x58585858, 4, false, ENOEXEC, "bad magic");
+	check_corrupt(image, offsetof(struct bytecode_header, version),
+		      version + 1, 4, false, ENOTSUP, "newer version");
+	check_corrupt(image, offsetof(struct bytecode_header, version),
+		      version - 1, 4, false, ENOTSUP, "older version");
+	check_corrupt(image, offsetof(struct bytecode_header, cell_count), 0, 8,
+		      false, EINVAL, "no cells");
+	check_corrupt(image, offsetof(struct bytecode_header, cell_count),
+		      (1ULL << 32) + 1, 8, false, EINVAL, "too many cells");
+	check_corrupt(image, offsetof(struct bytecode_header, len),
+		      program->len + 1, 8, false, EINVAL, "len past the end");
+	check_corrupt(image, image->len - 1, 0, 1, true, EINVAL,
+		      "truncated file");
+	check_corrupt(image, AT(0, op), OP_COUNT, 1, false, EINVAL,
+		      "unknown op");
+	check_corrupt(image, AT(end, op), OP_ADD, 1, false, EINVAL,
+		      "no END at the end");
+	check_corrupt(image, AT(jz, jump), program->len, 4, false, EINVAL,
+		      "JUMP_ZERO past the end");
+	check_corrupt(image, AT(jz, jump), jz + 1, 4, false, EINVAL,
+		      "JUMP_ZERO onto itself");
+	check_corrupt(image, AT(jz, jump), program->code[jz].jump + 1, 4,
+		      false, EINVAL, "JUMP_ZERO past its JUMP_NOT_ZERO");
+	check_corrupt(image, AT(jnz, jump), program->len + 7, 4, false, EINVAL,
+		      "JUMP_NOT_ZERO past the end");
+	check_corrupt(image, AT(add, offset), cells, 4, false, EINVAL,
+		      "offset of a whole tape");
+	check_corrupt(image, AT(add, offset), -cells, 4, false, EINVAL,
+		      "offset of a whole tape back");
+	check_corrupt(image, AT(move, arg), cells, 4, false, EINVAL,
+		      "move of a whole tape");
+	check_corrupt(image, AT(counted, arg), program->code[counted].arg + 2,
+		      1, false, EINVAL, "wrong trip factor");
+	check_corrupt(image, AT(add, flags), 0xff, 1, false, EINVAL,
+		      "unknown flags");
+}
+
+/* Checks that a program that could not be loaded back is not saved. */
+static void
+check_invalid_save(void)
+{
+	const struct matsplat_instruction code[] = {
+		{ .op = OP_JUMP_ZERO, .jump = 99 },
+		{ .op = OP_END }
+	};
+	const struct matsplat_source_position positions[2] = { 0 };
+	const struct matsplat_program program = {
+		.len = 2,
+		.cell_count = 30000,
+		.code = code,
+		.positions = positions
+	};
+	char path[PATH_MAX];
+
+	check(test_path(path, "invalid.bfc")
+	      && matsplat_program_save(&program, path) == EINVAL,
+	      "saving an invalid program");
+	check(access(path, F_OK) == -1, "leaving an invalid program behind");
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct matsplat_program loaded;
+	struct image image = { 0 };
+	struct image src = { 0 };
+	char path[PATH_MAX];
+	char bundle[PATH_MAX];
+	int err;
+
+	if (argc != 3) {
+		fprintf(stderr, "%s\n", usage_msg);
+		return EXIT_FAILURE;
+	}
+
+	const char *tmp = getenv("TMPDIR");
+	snprintf(dir, sizeof(dir), "%s/mattersplatter-test.XXXXXX",
+		 tmp != NULL && tmp[0] == '/' ? tmp : "/tmp");
+	if (mkdtemp(dir) == NULL) {
+		fprintf(stderr, "Could not make a directory: %s\n",
+			strerror(errno));
+		return EXIT_FAILURE;
+	}
+	if ((err = read_image(argv[2], &src)) != 0) {
+		fprintf(stderr, "Could not read %s: %s\n", argv[2],
+			strerror(err));
+		rmdir(dir);
+		return EXIT_FAILURE;
+	}
+
+	struct matsplat_tokenize_result tokens =
+		matsplat_tokenize((const char *) src.bytes, src.len);
+	struct matsplat_node *ast = matsplat_ast_create(tokens.tokens,
+							tokens.len);
+	struct matsplat_program program = matsplat_program_create(ast, 30000);
+	matsplat_tokenize_destory(tokens);
+	matsplat_ast_destroy(ast);
+	free(src.bytes);
+	if (program.error_code != 0) {
+		fprintf(stderr, "Could not create the program: %s\n",
+			strerror(program.error_code));
+		return EXIT_FAILURE;
+	}
+
+	check(test_path(path, "program.bfc")
+	      && matsplat_program_save(&program, path) == 0, "saving");
+	err = matsplat_program_load(path, &loaded);
+	check(err == 0, "loading");
+	if (err == 0) {
+		check(programs_match(&program, &loaded), "loaded program");
+		matsplat_program_destroy(loaded);
+	}
+
+	check(test_path(bundle, "bundle")
+	      && matsplat_program_bundle(&program, argv[1], bundle) == 0,
+	      "bundling");
+	err = matsplat_program_load_bundle(bundle, &loaded);
+	check(err == 0, "loading the bundle");
+	if (err == 0) {
+		check(programs_match(&program, &loaded), "bundled program");
+		matsplat_program_destroy(loaded);
+	}
+	check(matsplat_program_load_bundle(argv[1], &loaded) == ENOEXEC,
+	      "loading a runtime without a program");
+
+	if (read_image(path, &image) == 0) {
+		check_corrupt_files(&program, &image);
+	} else {
+		check(false, "reading the saved program");
+	}
+	check_invalid_save();
+
+	free(image.bytes);
+	matsplat_program_destroy(program);
+	unlink(path);
+	unlink(bundle);
+	rmdir(dir);
+
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,23 @@
+Loops whose own cell steps by an odd amount other than one always end
+and are evaluated in closed form or counted; every case prints a letter
+
+Ten trips of three down from thirty add five each
+++++++++++++++++++++++++++++++[--->+++++<]>+++++++++++++++.>>
+
+Eighty five trips of three up from one wrap past zero
++[+++>+<]>.>>
+
+Eighty nine trips of three down from eleven wrap past zero
++++++++++++[--->+<]>.>>
+
+Five trips of five down from twenty five set the next cell
++++++++++++++++++++++++++[----->[-]++++++<]>++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++.>>
+
+Seven trips of three down from twenty one print as they go
+>+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++<+++++++++++++++++++++[--->.+<]>>>
+
+Nine trips of three down from twenty seven multiply and print
+>>+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++<<+++++++++++++++++++++++++++[--->+++[->++<]>.<<]>>>>
+
+A loop on a zero cell never runs
+[--->+<]>++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++.>++++++++++.
@@ -0,0 +1,20 @@
+Stores overwritten before any read are dropped; loops and scans entered on
+a cell known to be zero are dropped; every case prints a letter
+
+Additions fold into the set that overwrites them
++++++[-]+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++.>
+
+Two sets in a row leave only the last one
++++++++++[-]++++++++++[-]++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++.>
+
+A store to a cell the pointer moves past is overwritten later
+>++++++++++++++++++++<>[-]+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++.>>
+
+A cleared cell skips its loops and scans and multiplies nothing
++++++++[-][-][>+++<-][.][>][<][->++<]>++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++.>
+
+A store that is printed is kept before it is overwritten
++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++.[-]++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++.>
+
+A loop after a loop ends on a zero cell and never runs
++[>+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++<-][>+++++++++<-]>.>++++++++++.
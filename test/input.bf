@@ -0,0 +1,10 @@
+Reads five bytes from a file of three; every byte read is printed plus
+forty eight; a cell that EOF leaves unchanged prints r; one cleared to
+zero prints 0; one set to minus one prints a slash
+
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++,++++++++++++++++++++++++++++++++++++++++++++++++.>
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++,++++++++++++++++++++++++++++++++++++++++++++++++.>
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++,++++++++++++++++++++++++++++++++++++++++++++++++.>
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++,++++++++++++++++++++++++++++++++++++++++++++++++.>
+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++,++++++++++++++++++++++++++++++++++++++++++++++++.>
+++++++++++.
@@ -0,0 +1,9 @@
+Every fourth cell holds a number; for each one the loop on the cell three
+to its right runs once and sums one to the number into the cell next to
+it; that loop is entered again from the same cells whenever a number
+repeats; each sum prints as a letter; the numbers start two cells left
+of the start of the tape so that on small tapes the cells of a loop wrap
+
+<<+++>>>>+++++>>>>+++>>>>+++>>>>+++++++>>>>+++++>>>>+++>>>>++>>>>+++++++>>>>+++<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
+[>>>+[<<<[[->+>+<<]>>[-<<+>>]<<-]>>>-]<<++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++.[-]>>>]
+++++++++++.
@@ -0,0 +1,18 @@
+Scans over runs of thirty cells that straddle the end and the start of the
+tape; each line is one stride; the first letter tells where a right scan
+stopped and the second where a left scan stopped
+
+<<<<<<<<<<++++++++++++++++++++++++++++++[[->+>+<<]>>[-<<+>>]<-]<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<[>]<++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++.----------------------------------------------------------------[[-]<]>>>>>>>>>>>
+<<<<<<<<<<<<<<<<<<<<++++++++++++++++++++++++++++++[[->+>+<<]>>[-<<+>>]<-]<[<]>++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++.---------------------------------------------------------------->>>>>>>>>>>>>>>>>>>>>>>>>>>>>[[-]<]>>>>>>>>>>>>>>>>>>>>>++++++++++.[-]
+
+<<<<<<<<<<++++++++++++++++++++++++++++++[[->+>+<<]>>[-<<+>>]<-]<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<[>>]<<++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++.---------------------------------------------------------------->[[-]<]>>>>>>>>>>>
+<<<<<<<<<<<<<<<<<<<<++++++++++++++++++++++++++++++[[->+>+<<]>>[-<<+>>]<-]<[<<]>>++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++.---------------------------------------------------------------->>>>>>>>>>>>>>>>>>>>>>>>>>>>[[-]<]>>>>>>>>>>>>>>>>>>>>>++++++++++.[-]
+
+<<<<<<<<<<++++++++++++++++++++++++++++++[[->+>+<<]>>[-<<+>>]<-]<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<[>>>>]<<<<++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++.---------------------------------------------------------------->[[-]<]>>>>>>>>>>>
+<<<<<<<<<<<<<<<<<<<<++++++++++++++++++++++++++++++[[->+>+<<]>>[-<<+>>]<-]<[<<<<]>>>>++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++.---------------------------------------------------------------->>>>>>>>>>>>>>>>>>>>>>>>>>>>[[-]<]>>>>>>>>>>>>>>>>>>>>>++++++++++.[-]
+
+<<<<<<<<<<++++++++++++++++++++++++++++++[[->+>+<<]>>[-<<+>>]<-]<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<[>>>>>>>>]<<<<<<<<++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++.---------------------------------------------------------------->>>>>[[-]<]>>>>>>>>>>>
+<<<<<<<<<<<<<<<<<<<<++++++++++++++++++++++++++++++[[->+>+<<]>>[-<<+>>]<-]<[<<<<<<<<]>>>>>>>>++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++.---------------------------------------------------------------->>>>>>>>>>>>>>>>>>>>>>>>[[-]<]>>>>>>>>>>>>>>>>>>>>>++++++++++.[-]
+
+<<<<<<<<<<++++++++++++++++++++++++++++++[[->+>+<<]>>[-<<+>>]<-]<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<[>>>]<<<++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++.---------------------------------------------------------------->>[[-]<]>>>>>>>>>>>
+<<<<<<<<<<<<<<<<<<<<++++++++++++++++++++++++++++++[[->+>+<<]>>[-<<+>>]<-]<[<<<]>>>++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++.---------------------------------------------------------------->>>>>>>>>>>>>>>>>>>>>>>>>>>[[-]<]>>>>>>>>>>>>>>>>>>>>>++++++++++.[-]
@@ -0,0 +1,18 @@
+Sweeps over runs of thirty letters that straddle the end and the start of
+the tape; each line is one stride and prints a run after a right sweep and
+then a run after a left sweep
+
+<<<<<<<<<<++++++++++++++++++++++++++++++[[->+>+<<]>>[-<<+>>]<-]<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<[++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++>]<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<[+<++>>]<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.><[[-]<]>>>>>>>>>>>>
+<<<<<<<<<<<<<<<<<<<<++++++++++++++++++++++++++++++[[->+>+<<]>>[-<<+>>]<-]<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<[++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++>]<[+>++<<]>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>[[-]<]>>>>>>>>>>>>>>>>>>>>>++++++++++.[-]
+
+<<<<<<<<<<++++++++++++++++++++++++++++++[[->+>+<<]>>[-<<+>>]<-]<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<[++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++>]<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<[+<++>>>]<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.><[[-]<]>>>>>>>>>>>>
+<<<<<<<<<<<<<<<<<<<<++++++++++++++++++++++++++++++[[->+>+<<]>>[-<<+>>]<-]<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<[++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++>]<[+>++<<<]>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>[[-]<]>>>>>>>>>>>>>>>>>>>>>++++++++++.[-]
+
+<<<<<<<<<<++++++++++++++++++++++++++++++[[->+>+<<]>>[-<<+>>]<-]<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<[++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++>]<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<[+<++>>>>>]<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.><[[-]<]>>>>>>>>>>>>
+<<<<<<<<<<<<<<<<<<<<++++++++++++++++++++++++++++++[[->+>+<<]>>[-<<+>>]<-]<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<[++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++>]<[+>++<<<<<]>>>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>[[-]<]>>>>>>>>>>>>>>>>>>>>>++++++++++.[-]
+
+<<<<<<<<<<++++++++++++++++++++++++++++++[[->+>+<<]>>[-<<+>>]<-]<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<[++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++>]<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<[+<++>>>>>>>>>]<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.><[[-]<]>>>>>>>>>>>>
+<<<<<<<<<<<<<<<<<<<<++++++++++++++++++++++++++++++[[->+>+<<]>>[-<<+>>]<-]<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<[++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++>]<[+>++<<<<<<<<<]>>>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>[[-]<]>>>>>>>>>>>>>>>>>>>>>++++++++++.[-]
+
+<<<<<<<<<<++++++++++++++++++++++++++++++[[->+>+<<]>>[-<<+>>]<-]<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<[++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++>]<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<[+<++>>>>]<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.><[[-]<]>>>>>>>>>>>>
+<<<<<<<<<<<<<<<<<<<<++++++++++++++++++++++++++++++[[->+>+<<]>>[-<<+>>]<-]<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<[++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++>]<[+>++<<<<]>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>.>[[-]<]>>>>>>>>>>>>>>>>>>>>>++++++++++.[-]
@@ -0,0 +1,8 @@
+On tapes of one to three cells the offsets below wrap onto cells that
+are also written at other offsets; every line prints a character
+
+++++++++++++++++++++++++++++++>++>+++>++++<<<.
+>>[-]<<++++++++++++++++++++++++++++++++++.
+[->++<]>>>++++++++++++++++++++++++++++++++++.
+>[-]<<++++++++++++++++++++++++++++++++++>.<<
+[-]++++++++++.